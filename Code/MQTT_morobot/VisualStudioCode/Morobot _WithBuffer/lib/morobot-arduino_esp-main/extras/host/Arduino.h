@@ -0,0 +1,117 @@
+/**
+ * @file    Arduino.h
+ * @brief   Minimal Arduino API for compiling the smart servo driver on a Linux host.
+ *
+ * Only what the library sources and the host tools in this folder need is provided.
+ * The folder is put in front of the include path, so the library sources are compiled unchanged.
+ * Serial discards everything the robot classes print, the host tools print with printf().
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+#define DEC 10
+#define HEX 16
+#define F(string_literal) (string_literal)
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 1
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+class String
+{
+public:
+  String(const char *str = "") : value(str) {}
+  const char *c_str(void) const { return value.c_str(); }
+private:
+  std::string value;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t val) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while(size--)
+    {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+
+  size_t print(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t print(char val) { return write((uint8_t)val); }
+  size_t print(unsigned char val, int base = DEC) { return print((unsigned long)val, base); }
+  size_t print(int val, int base = DEC) { return print((long)val, base); }
+  size_t print(unsigned int val, int base = DEC) { return print((unsigned long)val, base); }
+  size_t print(long val, int base = DEC)
+  {
+    char buf[24];
+    snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%ld", val);
+    return print(buf);
+  }
+  size_t print(unsigned long val, int base = DEC)
+  {
+    char buf[24];
+    snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%lu", val);
+    return print(buf);
+  }
+  size_t print(double val, int digits = 2)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, val);
+    return print(buf);
+  }
+  size_t println(void) { return print("\r\n"); }
+  template <typename T> size_t println(T val) { size_t n = print(val); return n + println(); }
+  template <typename T> size_t println(T val, int base) { size_t n = print(val, base); return n + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual int peek(void) = 0;
+  virtual void flush(void) {}
+};
+
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void updateBaudRate(unsigned long baud) { (void)baud; }
+  int available(void) { return 0; }
+  int read(void) { return -1; }
+  int peek(void) { return -1; }
+  size_t write(uint8_t val) { (void)val; return 1; }
+  size_t write(const uint8_t *buffer, size_t size) { (void)buffer; return size; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file    bench_robot_moves.cpp
+ * @brief   Host benchmark: arrival of the joints of a morobot_3d and the time waitUntilIsReady() needs to notice it.
+ *
+ * The robot classes of ../../src run unchanged against the emulator, the bus is set with beginSerial() instead of
+ * begin(). Two measurements:
+ * - wait: the joints are moved with moveToAngles() and back, waitUntilIsReady() is called right away. Printed are the
+ *   travel time until the last joint arrived and the time waitUntilIsReady() returned after that, once with the
+ *   arrival reports of the servos and once without (the joints are polled, see setGoalTolerance()).
+ * - sync: the arrival time of each joint of a move of different length per joint, with and without
+ *   setSynchronizedMoves().
+ * The arrival times are taken from the emulator, they are measured from the call of moveToAngles().
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -DESP8266 -w -I. -I../../src bench_robot_moves.cpp smart_servo_emulator.cpp arduino_host.cpp ../../src/MakeblockSmartServo.cpp ../../src/morobot.cpp ../../src/morobot_3d.cpp ../../src/eef.cpp -o bench_robot_moves
+ *   ./bench_robot_moves [cycles] [speed in rpm]
+ *
+ * ESP8266 selects the board branch of the robot classes without FreeRTOS tasks, nothing of the ESP8266 core is used.
+ * -w hides the warnings of the robot classes.
+ */
+#include <Arduino.h>
+#include <morobot_3d.h>
+#include "smart_servo_emulator.h"
+#include <stdio.h>
+
+#define BENCH_JOINTS 3
+#define BENCH_SPEED  25    // rpm
+
+static long waitGoals[2][BENCH_JOINTS] = {{30, -20, 15}, {0, 0, 0}};
+static long syncGoals[2][BENCH_JOINTS] = {{60, 20, 7}, {0, 0, 0}};
+
+// Time in ms from start (micros()) until joint i arrived
+static float arrival(SmartServoEmulator &bus, uint8_t i, unsigned long start)
+{
+  return (long)(bus.getArrivalTime(i + 1) - start) / 1000.0f;
+}
+
+// Moves the joints, waits until the robot is ready and returns the time in ms it took after the last joint arrived
+static float moveAndWait(morobot_3d &robot, SmartServoEmulator &bus, long *angles, float *travel)
+{
+  unsigned long start = micros();
+  unsigned long last;
+  uint8_t i;
+  robot.moveToAngles(angles);
+  robot.waitUntilIsReady();
+  last = start;
+  for(i = 0; i < BENCH_JOINTS; i++)
+  {
+    last = max(last, bus.getArrivalTime(i + 1));
+  }
+  *travel = (long)(last - start) / 1000.0f;
+  return (long)(micros() - last) / 1000.0f;
+}
+
+static void benchWait(int cycles, uint8_t speed, bool reports)
+{
+  SmartServoEmulator bus(BENCH_JOINTS);
+  morobot_3d robot;
+  float travel, wait, travelSum = 0, waitSum = 0, waitMin = 1e9, waitMax = 0;
+  int i;
+
+  bus.setArrivalReports(reports);
+  robot.smartServos.beginSerial(&bus);
+  robot.smartServos.assignDevIdRequest();
+  robot.setSpeedRPM(speed);
+  for(i = 0; i < 2*cycles; i++)
+  {
+    wait = moveAndWait(robot, bus, waitGoals[i % 2], &travel);
+    travelSum += travel;
+    waitSum += wait;
+    waitMin = min(waitMin, wait);
+    waitMax = max(waitMax, wait);
+  }
+  printf("wait    reports %d: travel %6.1f ms, waitUntilIsReady() after arrival %6.1f ms (min %.1f, max %.1f)\n",
+         reports, travelSum / (2*cycles), waitSum / (2*cycles), waitMin, waitMax);
+}
+
+static void benchSync(uint8_t speed, bool synchronized)
+{
+  SmartServoEmulator bus(BENCH_JOINTS);
+  morobot_3d robot;
+  unsigned long start;
+  uint8_t i;
+
+  robot.smartServos.beginSerial(&bus);
+  robot.smartServos.assignDevIdRequest();
+  robot.setSpeedRPM(speed);
+  robot.setSynchronizedMoves(synchronized);
+  start = micros();
+  robot.moveToAngles(syncGoals[0]);
+  robot.waitUntilIsReady();
+  printf("sync    synchronized %d: %ld/%ld/%ld degree, arrival", synchronized, syncGoals[0][0], syncGoals[0][1], syncGoals[0][2]);
+  for(i = 0; i < BENCH_JOINTS; i++)
+  {
+    printf("%s%.0f", (i == 0) ? " " : "/", arrival(bus, i, start));
+  }
+  printf(" ms, angles %.1f/%.1f/%.1f\n", bus.getAngle(1), bus.getAngle(2), bus.getAngle(3));
+  robot.moveToAngles(syncGoals[1]);
+  robot.waitUntilIsReady();
+}
+
+int main(int argc, char **argv)
+{
+  int cycles = (argc > 1) ? atoi(argv[1]) : 5;
+  uint8_t speed = (argc > 2) ? atoi(argv[2]) : BENCH_SPEED;
+
+  printf("%d cycles at %u rpm\n", cycles, speed);
+  benchWait(cycles, speed, true);
+  benchWait(cycles, speed, false);
+  benchSync(speed, false);
+  benchSync(speed, true);
+  return 0;
+}
@@ -0,0 +1,502 @@
+/**
+ * @file    decode_capture.cpp
+ * @brief   Host tool: decodes a bus capture of the smart servo driver into a transaction timeline.
+ *
+ * Reads the output of MakeblockSmartServoBase::printCapture() (morobotClass::printBusCapture()), lines of
+ * "<time in us> <T|R> <byte in hex>"; all other lines, e.g. other output of the serial monitor, are skipped.
+ * The bytes are joined to frames and the responses are matched to their requests like the driver does it:
+ * values of GET requests by device and command, acknowledges of commands to the oldest open command of the
+ * device. A frame sent again while its request is open is counted as a retry.
+ *
+ * The timeline has one line per frame with the idle time of the bus before it and the latency of every response
+ * from the first send of its request; frames to the servos count as busy until their last byte left at the given
+ * baud rate. The summary lists latency, retries and missing responses per command and the longest idle gaps, so
+ * it shows where a cycle waited for the servos and where the bus sat idle.
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -I. -I../../src decode_capture.cpp -o decode_capture
+ *   ./decode_capture [-s] [-g gap in ms] [-b baud rate] [capture file]
+ */
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#define DECODE_DEFAULT_GAP_MS  5.0     // Idle gaps longer than this are marked in the timeline
+#define DECODE_TOP_GAPS        10      // Number of longest gaps listed in the summary
+#define DECODE_BROADCAST_MS    200     // Time further responses to a broadcast are assigned to it
+
+typedef struct
+{
+  uint64_t start;                     // time of the first byte in us
+  uint64_t end;                       // time of END_SYSEX in us
+  bool tx;
+  std::vector<uint8_t> bytes;         // START_SYSEX to END_SYSEX
+}frame_type;
+
+typedef struct
+{
+  size_t frame;                       // index of the first send in the frame list
+  uint8_t dev;
+  uint8_t srv;                        // service id of the expected response
+  uint8_t cmd;
+  std::string name;
+  uint64_t firstSend;
+  uint8_t retries;
+  bool answered;
+  uint64_t answerTime;
+}request_type;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t answered;
+  uint32_t retries;
+  uint32_t missing;
+  uint64_t latencySum;
+  uint64_t latencyMin;
+  uint64_t latencyMax;
+}command_stats_type;
+
+typedef struct
+{
+  uint64_t length;
+  size_t before;                      // frame index before and after the gap
+  size_t after;
+}gap_type;
+
+static std::string hexName(const char *prefix, uint8_t val)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s0x%02x", prefix, val);
+  return buf;
+}
+
+static std::string serviceName(uint8_t srv)
+{
+  switch(srv)
+  {
+    case CTL_ASSIGN_DEV_ID: return "CTL_ASSIGN_DEV_ID";
+    case CTL_SYSTEM_RESET: return "CTL_SYSTEM_RESET";
+    case CTL_READ_DEV_VERSION: return "CTL_READ_DEV_VERSION";
+    case CTL_SET_BAUD_RATE: return "CTL_SET_BAUD_RATE";
+    case CTL_CMD_TEST: return "CTL_CMD_TEST";
+    case CTL_ERROR_CODE: return "CTL_ERROR_CODE";
+    case SMART_SERVO: return "SMART_SERVO";
+    default: return hexName("srv ", srv);
+  }
+}
+
+static std::string commandName(uint8_t cmd)
+{
+  switch(cmd)
+  {
+    case SET_SERVO_PID: return "SET_SERVO_PID";
+    case SET_SERVO_ABSOLUTE_POS: return "SET_SERVO_ABSOLUTE_POS";
+    case SET_SERVO_RELATIVE_POS: return "SET_SERVO_RELATIVE_POS";
+    case SET_SERVO_CONTINUOUS_ROTATION: return "SET_SERVO_CONTINUOUS_ROTATION";
+    case SET_SERVO_MOTION_COMPENSATION: return "SET_SERVO_MOTION_COMPENSATION";
+    case CLR_SERVO_MOTION_COMPENSATION: return "CLR_SERVO_MOTION_COMPENSATION";
+    case SET_SERVO_BREAK: return "SET_SERVO_BREAK";
+    case SET_SERVO_RGB_LED: return "SET_SERVO_RGB_LED";
+    case SERVO_SHARKE_HAND: return "SERVO_SHARKE_HAND";
+    case SET_SERVO_CMD_MODE: return "SET_SERVO_CMD_MODE";
+    case GET_SERVO_STATUS: return "GET_SERVO_STATUS";
+    case GET_SERVO_PID: return "GET_SERVO_PID";
+    case GET_SERVO_CUR_POS: return "GET_SERVO_CUR_POS";
+    case GET_SERVO_SPEED: return "GET_SERVO_SPEED";
+    case GET_SERVO_MOTION_COMPENSATION: return "GET_SERVO_MOTION_COMPENSATION";
+    case GET_SERVO_TEMPERATURE: return "GET_SERVO_TEMPERATURE";
+    case GET_SERVO_ELECTRIC_CURRENT: return "GET_SERVO_ELECTRIC_CURRENT";
+    case GET_SERVO_VOLTAGE: return "GET_SERVO_VOLTAGE";
+    case SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES: return "SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES";
+    case SET_SERVO_ABSOLUTE_ANGLE: return "SET_SERVO_ABSOLUTE_ANGLE";
+    case SET_SERVO_RELATIVE_ANGLE: return "SET_SERVO_RELATIVE_ANGLE";
+    case SET_SERVO_ABSOLUTE_ANGLE_LONG: return "SET_SERVO_ABSOLUTE_ANGLE_LONG";
+    case SET_SERVO_RELATIVE_ANGLE_LONG: return "SET_SERVO_RELATIVE_ANGLE_LONG";
+    case SET_SERVO_PWM_MOVE: return "SET_SERVO_PWM_MOVE";
+    case GET_SERVO_CUR_ANGLE: return "GET_SERVO_CUR_ANGLE";
+    case SET_SERVO_INIT_ANGLE: return "SET_SERVO_INIT_ANGLE";
+    case REPORT_WHEN_REACH_THE_SET_POSITION: return "REPORT_WHEN_REACH_THE_SET_POSITION";
+    default: return hexName("cmd ", cmd);
+  }
+}
+
+static std::string errorName(uint8_t code)
+{
+  switch(code)
+  {
+    case PROCESS_SUC: return "PROCESS_SUC";
+    case PROCESS_BUSY: return "PROCESS_BUSY";
+    case PROCESS_ERROR: return "PROCESS_ERROR";
+    case WRONG_TYPE_OF_SERVICE: return "WRONG_TYPE_OF_SERVICE";
+    default: return hexName("code ", code);
+  }
+}
+
+// Requests the driver answers with a value on SMART_SERVO, all other commands are acknowledged on CTL_ERROR_CODE
+static bool isGetCommand(uint8_t cmd)
+{
+  return ((cmd >= GET_SERVO_STATUS) && (cmd <= GET_SERVO_VOLTAGE)) || (cmd == GET_SERVO_CUR_ANGLE);
+}
+
+static bool checksumValid(const std::vector<uint8_t> &bytes)
+{
+  uint8_t sum = 0;
+  size_t i;
+  if(bytes.size() < 5)
+  {
+    return false;
+  }
+  for(i = 1; i < bytes.size() - 2; i++)
+  {
+    sum += bytes[i];
+  }
+  return (sum & 0x7f) == bytes[bytes.size() - 2];
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: decode_capture [-s] [-g gap in ms] [-b baud rate] [capture file]\n");
+  fprintf(stderr, "  -s  summary only, no timeline\n");
+  fprintf(stderr, "  -g  mark idle gaps longer than this (default %.0f ms)\n", DECODE_DEFAULT_GAP_MS);
+  fprintf(stderr, "  -b  baud rate of the bus for the utilisation (default %d)\n", SMART_SERVO_DEFAULT_BAUD_RATE);
+}
+
+int main(int argc, char **argv)
+{
+  const char *fileName = NULL;
+  double gapMs = DECODE_DEFAULT_GAP_MS;
+  long baudRate = SMART_SERVO_DEFAULT_BAUD_RATE;
+  bool timeline = true;
+  FILE *in = stdin;
+  char line[256];
+  unsigned long time;
+  char dir;
+  unsigned int val;
+  uint32_t lastRaw = 0;
+  uint64_t now = 0;
+  bool first = true;
+  std::vector<frame_type> frames;
+  frame_type txFrame;
+  frame_type rxFrame;
+  bool txOpen = false;
+  bool rxOpen = false;
+  uint32_t bytesTx = 0;
+  uint32_t bytesRx = 0;
+  uint32_t strayBytes = 0;
+  uint32_t badFrames = 0;
+  uint32_t unmatched = 0;
+  uint32_t reports = 0;
+  std::vector<request_type> requests;
+  std::map<std::string, command_stats_type> stats;
+  std::vector<gap_type> gaps;
+  uint64_t busyEnd = 0;
+  uint64_t idleSum = 0;
+  size_t i;
+  size_t k;
+  int arg;
+
+  for(arg = 1; arg < argc; arg++)
+  {
+    if((strcmp(argv[arg], "-s") == 0))
+    {
+      timeline = false;
+    }
+    else if((strcmp(argv[arg], "-g") == 0) && (arg + 1 < argc))
+    {
+      gapMs = atof(argv[++arg]);
+    }
+    else if((strcmp(argv[arg], "-b") == 0) && (arg + 1 < argc))
+    {
+      baudRate = atol(argv[++arg]);
+    }
+    else if(argv[arg][0] == '-')
+    {
+      usage();
+      return 2;
+    }
+    else
+    {
+      fileName = argv[arg];
+    }
+  }
+  if(fileName != NULL)
+  {
+    in = fopen(fileName, "r");
+    if(in == NULL)
+    {
+      perror(fileName);
+      return 2;
+    }
+  }
+
+  /* bytes to frames, the 32 bit timestamps are unwrapped */
+  while(fgets(line, sizeof(line), in) != NULL)
+  {
+    if((sscanf(line, "%lu %c %x", &time, &dir, &val) != 3) || ((dir != 'T') && (dir != 'R')) || (val > 0xff))
+    {
+      continue;
+    }
+    now = first ? 0 : now + (uint32_t)((uint32_t)time - lastRaw);
+    lastRaw = (uint32_t)time;
+    first = false;
+    frame_type &frame = (dir == 'T') ? txFrame : rxFrame;
+    bool &open = (dir == 'T') ? txOpen : rxOpen;
+    if(dir == 'T')
+    {
+      bytesTx++;
+    }
+    else
+    {
+      bytesRx++;
+    }
+    if(val == START_SYSEX)
+    {
+      if(open == true)
+      {
+        badFrames++;
+      }
+      frame.bytes.clear();
+      frame.start = now;
+      frame.tx = (dir == 'T');
+      open = true;
+    }
+    else if(open == false)
+    {
+      strayBytes++;
+      continue;
+    }
+    frame.bytes.push_back((uint8_t)val);
+    if(val == END_SYSEX)
+    {
+      frame.end = now;
+      frames.push_back(frame);
+      open = false;
+    }
+  }
+  if(in != stdin)
+  {
+    fclose(in);
+  }
+  if(frames.empty())
+  {
+    printf("no frames found\n");
+    return 1;
+  }
+  // Both directions were recorded by one clock, the frames are ordered by their end
+  std::stable_sort(frames.begin(), frames.end(), [](const frame_type &a, const frame_type &b) { return a.end < b.end; });
+
+  if(timeline)
+  {
+    printf("%12s %9s %3s %4s  %-38s %11s  %s\n", "time[ms]", "idle[ms]", "dir", "dev", "frame", "latency[ms]", "note");
+  }
+  busyEnd = frames[0].start;
+  for(i = 0; i < frames.size(); i++)
+  {
+    const frame_type &frame = frames[i];
+    const std::vector<uint8_t> &b = frame.bytes;
+    uint64_t idle = (frame.start > busyEnd) ? frame.start - busyEnd : 0;
+    std::string what;
+    std::string note;
+    double latency = -1;
+    uint8_t dev;
+    uint8_t srv;
+    uint8_t cmd;
+
+    if(idle > 0)
+    {
+      idleSum += idle;
+      gap_type gap = {idle, (i > 0) ? i - 1 : 0, i};
+      gaps.push_back(gap);
+    }
+    // Frames to the servos are recorded when they are handed to the port, they are on the wire afterwards
+    uint64_t frameBusy = frame.end + (frame.tx ? (uint64_t)(b.size() * 10.0e6 / baudRate) : 0);
+    busyEnd = (frameBusy > busyEnd) ? frameBusy : busyEnd;
+    if(checksumValid(b) == false)
+    {
+      badFrames++;
+      what = "invalid frame";
+      dev = (b.size() > 1) ? b[1] : 0;
+    }
+    else
+    {
+      dev = b[1];
+      srv = b[2];
+      cmd = (b.size() > 5) ? b[3] : 0;
+      if(frame.tx)
+      {
+        request_type req;
+        req.frame = i;
+        req.dev = dev;
+        req.cmd = cmd;
+        req.retries = 0;
+        req.answered = false;
+        req.answerTime = 0;
+        req.firstSend = frame.end;
+        if(srv == SMART_SERVO)
+        {
+          req.name = commandName(cmd);
+          req.srv = isGetCommand(cmd) ? SMART_SERVO : CTL_ERROR_CODE;
+        }
+        else
+        {
+          req.name = serviceName(srv);
+          req.srv = (srv == CTL_ASSIGN_DEV_ID) ? CTL_ASSIGN_DEV_ID : CTL_ERROR_CODE;
+        }
+        what = req.name;
+        // The same frame again while the request is open is a retry of the driver
+        for(k = requests.size(); k > 0; k--)
+        {
+          request_type &open = requests[k - 1];
+          if((open.answered == false) && (frames[open.frame].bytes == b))
+          {
+            open.retries++;
+            note = "retry " + std::to_string(open.retries);
+            break;
+          }
+        }
+        if(k == 0)
+        {
+          requests.push_back(req);
+        }
+      }
+      else
+      {
+        request_type *match = NULL;
+        if((srv == SMART_SERVO) && (cmd == REPORT_WHEN_REACH_THE_SET_POSITION))
+        {
+          what = "position reached";
+          reports++;
+        }
+        else
+        {
+          what = (srv == CTL_ERROR_CODE) ? ("ack " + errorName(cmd)) :
+                 ((srv == SMART_SERVO) ? ("value " + commandName(cmd)) : ("response " + serviceName(srv)));
+          for(k = 0; k < requests.size(); k++)
+          {
+            request_type &req = requests[k];
+            if((req.answered == true) || (req.srv != srv) || ((req.dev != dev) && (req.dev != ALL_DEVICE)))
+            {
+              continue;
+            }
+            if((srv == SMART_SERVO) && (req.cmd != cmd))
+            {
+              continue;
+            }
+            match = &req;
+            break;
+          }
+          if(match != NULL)
+          {
+            match->answered = true;
+            match->answerTime = frame.end;
+            latency = (frame.end - match->firstSend) / 1000.0;
+            if(match->retries > 0)
+            {
+              note = "after " + std::to_string(match->retries) + " retries";
+            }
+          }
+          else
+          {
+            // Every servo answers a broadcast, the first response finished the request
+            for(k = requests.size(); k > 0; k--)
+            {
+              request_type &req = requests[k - 1];
+              if((req.dev == ALL_DEVICE) && (req.srv == srv) && (req.answered == true) &&
+                 (frame.end - req.answerTime <= DECODE_BROADCAST_MS * 1000ULL))
+              {
+                note = "broadcast response";
+                break;
+              }
+            }
+            if(k == 0)
+            {
+              unmatched++;
+              note = "unmatched";
+            }
+          }
+        }
+      }
+    }
+    if(idle > gapMs * 1000)
+    {
+      note += note.empty() ? "<-- idle" : " <-- idle";
+    }
+    if(timeline)
+    {
+      char latencyText[16] = "";
+      if(latency >= 0)
+      {
+        snprintf(latencyText, sizeof(latencyText), "%.3f", latency);
+      }
+      printf("%12.3f %9.3f %3s %4u  %-38s %11s  %s\n", frame.end / 1000.0, idle / 1000.0, frame.tx ? "TX" : "RX",
+             dev, what.c_str(), latencyText, note.c_str());
+    }
+  }
+
+  /* per command statistics */
+  for(k = 0; k < requests.size(); k++)
+  {
+    const request_type &req = requests[k];
+    command_stats_type &s = stats[req.name];
+    uint64_t latency = req.answerTime - req.firstSend;
+    if(s.count == 0)
+    {
+      memset(&s, 0, sizeof(s));
+      s.latencyMin = UINT64_MAX;
+    }
+    s.count++;
+    s.retries += req.retries;
+    if(req.answered == false)
+    {
+      s.missing++;
+      continue;
+    }
+    s.answered++;
+    s.latencySum += latency;
+    s.latencyMin = std::min(s.latencyMin, latency);
+    s.latencyMax = std::max(s.latencyMax, latency);
+  }
+
+  uint64_t span = frames.back().end - frames.front().start;
+  printf("\ncapture %.3f ms, %zu frames, %u bytes to the servos, %u bytes from the servos\n",
+         span / 1000.0, frames.size(), bytesTx, bytesRx);
+  if(span > 0)
+  {
+    printf("wire time at %ld baud: %.1f %% to the servos, %.1f %% from the servos, bus idle %.1f %% of the time\n",
+           baudRate, bytesTx * 10.0e6 / baudRate / span * 100, bytesRx * 10.0e6 / baudRate / span * 100,
+           idleSum * 100.0 / span);
+  }
+  printf("%u invalid frames, %u bytes outside frames, %u unmatched responses, %u position reports\n\n",
+         badFrames, strayBytes, unmatched, reports);
+  printf("%-38s %6s %6s %7s %7s %9s %9s %9s\n", "command", "count", "answ", "retries", "missing", "min[ms]", "avg[ms]", "max[ms]");
+  for(std::map<std::string, command_stats_type>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+  {
+    const command_stats_type &s = it->second;
+    if(s.answered > 0)
+    {
+      printf("%-38s %6u %6u %7u %7u %9.3f %9.3f %9.3f\n", it->first.c_str(), s.count, s.answered, s.retries, s.missing,
+             s.latencyMin / 1000.0, s.latencySum / 1000.0 / s.answered, s.latencyMax / 1000.0);
+    }
+    else
+    {
+      printf("%-38s %6u %6u %7u %7u %9s %9s %9s\n", it->first.c_str(), s.count, s.answered, s.retries, s.missing, "-", "-", "-");
+    }
+  }
+
+  std::sort(gaps.begin(), gaps.end(), [](const gap_type &a, const gap_type &b) { return a.length > b.length; });
+  printf("\nlongest idle gaps:\n");
+  for(k = 0; (k < gaps.size()) && (k < DECODE_TOP_GAPS); k++)
+  {
+    const frame_type &before = frames[gaps[k].before];
+    const frame_type &after = frames[gaps[k].after];
+    printf("%10.3f ms at %12.3f ms  after %s dev %u, before %s dev %u\n", gaps[k].length / 1000.0, before.end / 1000.0,
+           before.tx ? "TX" : "RX", (before.bytes.size() > 1) ? before.bytes[1] : 0,
+           after.tx ? "TX" : "RX", (after.bytes.size() > 1) ? after.bytes[1] : 0);
+  }
+  return 0;
+}
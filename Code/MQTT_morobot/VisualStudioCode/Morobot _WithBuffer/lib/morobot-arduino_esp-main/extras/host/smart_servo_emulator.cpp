@@ -0,0 +1,714 @@
+/**
+ * @file    smart_servo_emulator.cpp
+ * @brief   Host emulator of a chain of Makeblock smart servos behind a Stream (see smart_servo_emulator.h).
+ */
+#include "smart_servo_emulator.h"
+
+SmartServoEmulator::SmartServoEmulator(uint8_t numServos, long baudRate)
+{
+  uint8_t i;
+  if(numServos < 1)
+  {
+    numServos = 1;
+  }
+  if(numServos > EMULATOR_MAX_SERVOS)
+  {
+    numServos = EMULATOR_MAX_SERVOS;
+  }
+  this->numServos = numServos;
+  hostBaud = baudRate;
+  processUs = EMULATOR_PROCESS_US;
+  hopUs = EMULATOR_HOP_US;
+  arrivalReports = true;
+  statusReplies = true;
+  settling = false;
+  responseLoss = 0;
+  randomState = 1;
+  txLineFree = 0;
+  rxLineFree = 0;
+  for(i = 1; i <= numServos; i++)
+  {
+    servos[i - 1].baudRate = baudRate;
+    resetServo(i);
+  }
+  resetStats();
+}
+
+size_t SmartServoEmulator::write(uint8_t val)
+{
+  unsigned long now;
+  update();
+  now = micros();
+  txLineFree = ((txLineFree > now) ? txLineFree : now) + byteTime();
+  stats.txBusyUs += byteTime();
+  if(val == START_SYSEX)
+  {
+    rxFrame.clear();
+  }
+  rxFrame.push_back(val);
+  if(val == END_SYSEX)
+  {
+    receiveFrame(txLineFree);
+    rxFrame.clear();
+  }
+  else if(rxFrame.size() > DEFAULT_UART_BUF_SIZE)
+  {
+    rxFrame.clear();
+  }
+  return 1;
+}
+
+size_t SmartServoEmulator::write(const uint8_t *buffer, size_t size)
+{
+  size_t i;
+  for(i = 0; i < size; i++)
+  {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+int SmartServoEmulator::available(void)
+{
+  unsigned long now;
+  int count = 0;
+  std::deque<timed_byte_type>::const_iterator it;
+  update();
+  now = micros();
+  for(it = rx.begin(); (it != rx.end()) && (it->time <= now); ++it)
+  {
+    count++;
+  }
+  return count;
+}
+
+int SmartServoEmulator::read(void)
+{
+  int val;
+  update();
+  if(rx.empty() || (rx.front().time > micros()))
+  {
+    return -1;
+  }
+  val = rx.front().val;
+  rx.pop_front();
+  return val;
+}
+
+int SmartServoEmulator::peek(void)
+{
+  update();
+  if(rx.empty() || (rx.front().time > micros()))
+  {
+    return -1;
+  }
+  return rx.front().val;
+}
+
+// Like HardwareSerial::flush(): returns when the last written byte is on the wire
+void SmartServoEmulator::flush(void)
+{
+  while(micros() < txLineFree)
+  {
+  }
+}
+
+void SmartServoEmulator::begin(long baudRate)
+{
+  update();
+  hostBaud = baudRate;
+}
+
+long SmartServoEmulator::getServoBaudRate(uint8_t devId)
+{
+  if((devId < 1) || (devId > numServos))
+  {
+    return 0;
+  }
+  return servos[devId - 1].baudRate;
+}
+
+void SmartServoEmulator::setLatency(unsigned long processUs, unsigned long hopUs)
+{
+  this->processUs = processUs;
+  this->hopUs = hopUs;
+}
+
+void SmartServoEmulator::setResponseLoss(float loss, unsigned int seed)
+{
+  responseLoss = loss;
+  randomState = seed;
+}
+
+void SmartServoEmulator::setLoad(uint8_t devId, float load)
+{
+  if((devId >= 1) && (devId <= numServos))
+  {
+    servos[devId - 1].load = constrain(load, 0.0f, 1.0f);
+  }
+}
+
+float SmartServoEmulator::getAngle(uint8_t devId)
+{
+  if((devId < 1) || (devId > numServos))
+  {
+    return 0;
+  }
+  return angleAt(servos[devId - 1], micros());
+}
+
+bool SmartServoEmulator::isMoving(uint8_t devId)
+{
+  if((devId < 1) || (devId > numServos))
+  {
+    return false;
+  }
+  return speedAt(servos[devId - 1], micros()) != 0;
+}
+
+unsigned long SmartServoEmulator::getArrivalTime(uint8_t devId)
+{
+  if((devId < 1) || (devId > numServos))
+  {
+    return 0;
+  }
+  return arrivalTime(servos[devId - 1]);
+}
+
+emulator_stats_type SmartServoEmulator::getStats(void)
+{
+  update();
+  return stats;
+}
+
+void SmartServoEmulator::resetStats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  statsStart = micros();
+}
+
+float SmartServoEmulator::getTxUtilisation(void)
+{
+  unsigned long elapsed = micros() - statsStart;
+  return (elapsed == 0) ? 0 : (float)stats.txBusyUs / elapsed;
+}
+
+float SmartServoEmulator::getRxUtilisation(void)
+{
+  unsigned long elapsed = micros() - statsStart;
+  return (elapsed == 0) ? 0 : (float)stats.rxBusyUs / elapsed;
+}
+
+// Puts finished arrival reports and due responses on the wire in the order they are ready
+void SmartServoEmulator::update(void)
+{
+  unsigned long now = micros();
+  unsigned long start;
+  uint8_t i;
+  size_t j;
+  for(i = 1; i <= numServos; i++)
+  {
+    if((servos[i - 1].reportArrival == true) && (arrivalTime(servos[i - 1]) <= now))
+    {
+      sendArrivalReport(i);
+    }
+  }
+  while(!scheduled.empty() && (scheduled.begin()->first <= now))
+  {
+    unsigned long readyTime = scheduled.begin()->first;
+    uint8_t devId = scheduled.begin()->second.first;
+    std::vector<uint8_t> frame = scheduled.begin()->second.second;
+    scheduled.erase(scheduled.begin());
+    // A servo which switched to another baud rate than the driver port sends garbage, the driver discards it
+    if(servos[devId - 1].baudRate != hostBaud)
+    {
+      continue;
+    }
+    if(randomLoss() == true)
+    {
+      stats.responsesLost++;
+      continue;
+    }
+    start = (rxLineFree > readyTime) ? rxLineFree : readyTime;
+    for(j = 0; j < frame.size(); j++)
+    {
+      timed_byte_type b;
+      b.val = frame[j];
+      b.time = start + (j + 1) * byteTime();
+      rx.push_back(b);
+    }
+    rxLineFree = start + frame.size() * byteTime();
+    stats.rxBusyUs += frame.size() * byteTime();
+    stats.framesSent++;
+  }
+}
+
+void SmartServoEmulator::receiveFrame(unsigned long frameEnd)
+{
+  uint8_t checksum = 0;
+  uint8_t length;
+  size_t i;
+  // START_SYSEX, device id, service id, checksum and END_SYSEX at least
+  if((rxFrame.size() < 5) || (rxFrame[0] != START_SYSEX))
+  {
+    stats.framesDropped++;
+    return;
+  }
+  for(i = 1; i < rxFrame.size() - 2; i++)
+  {
+    checksum += rxFrame[i];
+  }
+  if((checksum & 0x7f) != rxFrame[rxFrame.size() - 2])
+  {
+    stats.framesDropped++;
+    return;
+  }
+  stats.framesReceived++;
+  length = rxFrame.size() - 5;
+  processFrame(rxFrame[1], rxFrame[2], &rxFrame[3], length, frameEnd);
+}
+
+void SmartServoEmulator::processFrame(uint8_t devId, uint8_t srvId, const uint8_t *payload, uint8_t length, unsigned long frameEnd)
+{
+  uint8_t first = devId;
+  uint8_t last = devId;
+  uint8_t i;
+  if(srvId == CTL_ASSIGN_DEV_ID)
+  {
+    // Every servo takes the next id and passes the frame on, the chain ends at the first servo which does not listen
+    for(i = 1; (i <= numServos) && (servos[i - 1].baudRate == hostBaud); i++)
+    {
+      std::vector<uint8_t> response;
+      response.push_back(START_SYSEX);
+      response.push_back(i);
+      response.push_back(CTL_ASSIGN_DEV_ID);
+      response.push_back(0x00);
+      response.push_back((i + CTL_ASSIGN_DEV_ID) & 0x7f);
+      response.push_back(END_SYSEX);
+      sendFrame(i, response, responseTime(i, frameEnd));
+    }
+    return;
+  }
+  if(devId == ALL_DEVICE)
+  {
+    first = 1;
+    last = numServos;
+  }
+  else if((devId < 1) || (devId > numServos))
+  {
+    return;
+  }
+  for(i = first; i <= last; i++)
+  {
+    if(servos[i - 1].baudRate != hostBaud)
+    {
+      stats.framesDropped++;
+      continue;
+    }
+    switch(srvId)
+    {
+      case CTL_SET_BAUD_RATE:
+        if(length >= 5)
+        {
+          servos[i - 1].baudRate = decode7bit<int32_t>(payload);
+        }
+        break;
+      case CTL_SYSTEM_RESET:
+        resetServo(i);
+        break;
+      case CTL_CMD_TEST:
+        sendAck(i, PROCESS_SUC, responseTime(i, frameEnd));
+        break;
+      case SMART_SERVO:
+        if(length >= 1)
+        {
+          processServoCmd(i, payload[0], payload + 1, length - 1, frameEnd);
+        }
+        break;
+      default:
+        sendAck(i, WRONG_TYPE_OF_SERVICE, responseTime(i, frameEnd));
+        break;
+    }
+  }
+}
+
+void SmartServoEmulator::processServoCmd(uint8_t devId, uint8_t cmd, const uint8_t *payload, uint8_t length, unsigned long frameEnd)
+{
+  emulated_servo_type &servo = servos[devId - 1];
+  unsigned long readyTime = responseTime(devId, frameEnd);
+  uint8_t data[SMART_SERVO_STATUS_SIZE];
+  float angle = angleAt(servo, frameEnd);
+  float rpm = speedAt(servo, frameEnd);
+  float current = EMULATOR_IDLE_CURRENT + EMULATOR_MOVE_CURRENT * fabs(rpm) / SERVO_MAX_SPEED_RPM + 0.3f * servo.load;
+  float temperature = EMULATOR_AMBIENT_TEMP + 8.0f * servo.load;
+  float voltage = EMULATOR_VOLTAGE;
+  int16_t pwm;
+  switch(cmd)
+  {
+    case SET_SERVO_ABSOLUTE_ANGLE_LONG:
+    case SET_SERVO_RELATIVE_ANGLE_LONG:
+    case SET_SERVO_ABSOLUTE_ANGLE:
+    case SET_SERVO_RELATIVE_ANGLE:
+    {
+      // long angle and 2 byte speed, or short angle and 2 byte speed
+      uint8_t angleBytes = ((cmd == SET_SERVO_ABSOLUTE_ANGLE_LONG) || (cmd == SET_SERVO_RELATIVE_ANGLE_LONG)) ? 5 : 3;
+      float target;
+      if(length < angleBytes + 2)
+      {
+        sendAck(devId, PROCESS_ERROR, readyTime);
+        return;
+      }
+      target = (angleBytes == 5) ? decode7bit<int32_t>(payload) : decode7bit<int16_t>(payload, 3);
+      if((cmd == SET_SERVO_RELATIVE_ANGLE_LONG) || (cmd == SET_SERVO_RELATIVE_ANGLE))
+      {
+        target += (servo.continuous == true) ? angle : servo.targetAngle;
+      }
+      startMove(devId, target, decode7bit<int16_t>(payload + angleBytes, 2), arrivalReports, frameEnd);
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    }
+    case SET_SERVO_PWM_MOVE:
+      pwm = (length >= 3) ? decode7bit<int16_t>(payload, 3) : 0;
+      stopAt(devId, angle, frameEnd);
+      if(pwm != 0)
+      {
+        servo.continuous = true;
+        servo.speed = constrain(pwm, -255, 255) / 255.0f * SERVO_MAX_SPEED_RPM * 6.0f / 1000000.0f * (1.0f - 0.5f * servo.load);
+      }
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SET_SERVO_INIT_ANGLE:
+      // mode 0 returns to the nearest multiple of 360 degree, the servo does not report the arrival
+      if((length >= 3) && (payload[0] == 0))
+      {
+        startMove(devId, 360.0f * (long)floor(angle / 360.0f + 0.5f), decode7bit<int16_t>(payload + 1, 2), false, frameEnd);
+      }
+      else if(length >= 3)
+      {
+        startMove(devId, 0, decode7bit<int16_t>(payload + 1, 2), false, frameEnd);
+      }
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES:
+      stopAt(devId, 0, frameEnd);
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SET_SERVO_BREAK:
+      servo.breakStatus = (length >= 1) ? payload[0] : 0;
+      stopAt(devId, angle, frameEnd);
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SET_SERVO_RGB_LED:
+      if(length >= 6)
+      {
+        servo.rgb[0] = decode7bit<uint8_t>(payload);
+        servo.rgb[1] = decode7bit<uint8_t>(payload + 2);
+        servo.rgb[2] = decode7bit<uint8_t>(payload + 4);
+      }
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SET_SERVO_PID:
+      // P, I and D as float
+      if(length >= 15)
+      {
+        servo.pid[0] = decode7bit<float>(payload);
+        servo.pid[1] = decode7bit<float>(payload + 5);
+        servo.pid[2] = decode7bit<float>(payload + 10);
+      }
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case SERVO_SHARKE_HAND:
+    case SET_SERVO_CMD_MODE:
+    case SET_SERVO_MOTION_COMPENSATION:
+    case CLR_SERVO_MOTION_COMPENSATION:
+      sendAck(devId, PROCESS_SUC, readyTime);
+      break;
+    case GET_SERVO_CUR_ANGLE:
+    case GET_SERVO_CUR_POS:
+      encode7bit<int32_t>((int32_t)floor(angle + 0.5f), data);
+      sendValue(devId, cmd, data, 5, readyTime);
+      break;
+    case GET_SERVO_SPEED:
+      encode7bit<float>(rpm, data);
+      sendValue(devId, cmd, data, 5, readyTime);
+      break;
+    case GET_SERVO_TEMPERATURE:
+      encode7bit<float>(temperature, data);
+      sendValue(devId, cmd, data, 5, readyTime);
+      break;
+    case GET_SERVO_ELECTRIC_CURRENT:
+      encode7bit<float>(current, data);
+      sendValue(devId, cmd, data, 5, readyTime);
+      break;
+    case GET_SERVO_VOLTAGE:
+      encode7bit<float>(voltage, data);
+      sendValue(devId, cmd, data, 5, readyTime);
+      break;
+    case GET_SERVO_PID:
+      encode7bit<float>(servo.pid[0], data);
+      encode7bit<float>(servo.pid[1], data + 5);
+      encode7bit<float>(servo.pid[2], data + 10);
+      sendValue(devId, cmd, data, 15, readyTime);
+      break;
+    case GET_SERVO_MOTION_COMPENSATION:
+      encode7bit<int16_t>(0, data);
+      sendValue(devId, cmd, data, 3, readyTime);
+      break;
+    case GET_SERVO_STATUS:
+      if(statusReplies == false)
+      {
+        sendAck(devId, WRONG_TYPE_OF_SERVICE, readyTime);
+        break;
+      }
+      encode7bit<int32_t>((int32_t)floor(angle + 0.5f), data);
+      encode7bit<float>(rpm, data + 5);
+      encode7bit<float>(voltage, data + 10);
+      encode7bit<float>(temperature, data + 15);
+      encode7bit<float>(current, data + 20);
+      sendValue(devId, cmd, data, SMART_SERVO_STATUS_SIZE, readyTime);
+      break;
+    default:
+      sendAck(devId, WRONG_TYPE_OF_SERVICE, readyTime);
+      break;
+  }
+}
+
+void SmartServoEmulator::resetServo(uint8_t devId)
+{
+  emulated_servo_type &servo = servos[devId - 1];
+  long baudRate = servo.baudRate;
+  memset(&servo, 0, sizeof(servo));
+  servo.baudRate = baudRate;
+  servo.breakStatus = 1;
+  servo.pid[0] = 1.0f;
+}
+
+void SmartServoEmulator::startMove(uint8_t devId, float target, int16_t rpm, bool report, unsigned long now)
+{
+  emulated_servo_type &servo = servos[devId - 1];
+  stopAt(devId, angleAt(servo, now), now);
+  rpm = constrain(abs(rpm), 1, SERVO_MAX_SPEED_RPM);
+  servo.targetAngle = target;
+  servo.speed = rpm * 6.0f / 1000000.0f * (1.0f - 0.5f * servo.load);
+  servo.reportArrival = report;
+  if(settling == true)
+  {
+    startSettling(servo);
+  }
+}
+
+/*
+ * Parameters of the settling at the end of the move: a larger P makes the controller faster and less damped,
+ * D adds damping, I removes the error the load leaves but reduces the damping. The numbers give an underdamped
+ * servo with the default gains (P = 1).
+ */
+void SmartServoEmulator::startSettling(emulated_servo_type &servo)
+{
+  float p = (servo.pid[0] > 0.01f) ? servo.pid[0] : 0.01f;
+  float i = (servo.pid[1] > 0) ? servo.pid[1] : 0;
+  float d = (servo.pid[2] > 0) ? servo.pid[2] : 0;
+  unsigned long t;
+  servo.settleUs = 0;
+  if(servo.targetAngle == servo.startAngle)
+  {
+    return;
+  }
+  servo.settleOmega = 40.0f * sqrt(p) / sqrt(1.0f + servo.load);
+  if(servo.settleOmega > 120.0f)
+  {
+    servo.settleOmega = 120.0f;
+  }
+  servo.settleZeta = (0.2f + 4.0f * d) / sqrt(p) - 0.5f * i;
+  if(servo.settleZeta < 0.05f)
+  {
+    servo.settleZeta = 0.05f;
+  }
+  servo.settleSag = servo.load * 2.0f / (1.0f + 5.0f * i);
+  servo.settleVelocity = 0.2f * servo.speed * 1000000.0f;
+  // The arrival is reported once the error stays within EMULATOR_SETTLE_BAND of its final value
+  for(t = EMULATOR_SETTLE_MAX_US; t > 0; t -= 1000)
+  {
+    if(fabs(settleError(servo, t / 1000000.0f) + servo.settleSag) > EMULATOR_SETTLE_BAND)
+    {
+      break;
+    }
+  }
+  servo.settleUs = t;
+}
+
+// Deviation in degree from the goal in the direction of the move, t seconds after the end of the ramp
+float SmartServoEmulator::settleError(const emulated_servo_type &servo, float t)
+{
+  float w = servo.settleOmega;
+  float z = servo.settleZeta;
+  float y0 = servo.settleSag;         // deviation from the final angle -settleSag
+  float v0 = servo.settleVelocity;
+  float wd;
+  float r1;
+  float r2;
+  float c1;
+  float y;
+  if(z < 0.999f)
+  {
+    wd = w * sqrt(1.0f - z * z);
+    y = exp(-z * w * t) * (y0 * cos(wd * t) + (v0 + z * w * y0) / wd * sin(wd * t));
+  }
+  else if(z < 1.001f)
+  {
+    y = (y0 + (v0 + w * y0) * t) * exp(-w * t);
+  }
+  else
+  {
+    r1 = -w * (z - sqrt(z * z - 1.0f));
+    r2 = -w * (z + sqrt(z * z - 1.0f));
+    c1 = (v0 - r2 * y0) / (r1 - r2);
+    y = c1 * exp(r1 * t) + (y0 - c1) * exp(r2 * t);
+  }
+  return y - servo.settleSag;
+}
+
+// Ends the current move at angle, a move which has finished before still reports its arrival
+void SmartServoEmulator::stopAt(uint8_t devId, float angle, unsigned long now)
+{
+  emulated_servo_type &servo = servos[devId - 1];
+  if((servo.reportArrival == true) && (arrivalTime(servo) <= now))
+  {
+    sendArrivalReport(devId);
+  }
+  servo.startAngle = angle;
+  servo.targetAngle = angle;
+  servo.speed = 0;
+  servo.startTime = now;
+  servo.continuous = false;
+  servo.reportArrival = false;
+  servo.settleUs = 0;
+}
+
+float SmartServoEmulator::angleAt(const emulated_servo_type &servo, unsigned long now)
+{
+  float distance;
+  float delta = servo.targetAngle - servo.startAngle;
+  if(now <= servo.startTime)
+  {
+    return servo.startAngle;
+  }
+  distance = servo.speed * (now - servo.startTime);
+  if(servo.continuous == true)
+  {
+    return servo.startAngle + distance;
+  }
+  if(fabs(delta) <= distance)
+  {
+    if((servo.settleUs > 0) && (now < arrivalTime(servo)))
+    {
+      distance = settleError(servo, (now - rampEnd(servo)) / 1000000.0f);
+      return servo.targetAngle + ((delta > 0) ? distance : -distance);
+    }
+    if(servo.settleUs > 0)
+    {
+      return servo.targetAngle + ((delta > 0) ? -servo.settleSag : servo.settleSag);
+    }
+    return servo.targetAngle;
+  }
+  return servo.startAngle + ((delta > 0) ? distance : -distance);
+}
+
+// Speed in rpm at time now
+float SmartServoEmulator::speedAt(const emulated_servo_type &servo, unsigned long now)
+{
+  float rpm = servo.speed * 1000000.0f / 6.0f;
+  if(servo.continuous == true)
+  {
+    return rpm;
+  }
+  if((now < servo.startTime) || (now >= arrivalTime(servo)))
+  {
+    return 0;
+  }
+  if(now >= rampEnd(servo))
+  {
+    // settling, degree per ms to rpm
+    return (angleAt(servo, now + 1000) - angleAt(servo, now)) * 1000.0f / 6.0f;
+  }
+  return (servo.targetAngle > servo.startAngle) ? rpm : -rpm;
+}
+
+unsigned long SmartServoEmulator::arrivalTime(const emulated_servo_type &servo)
+{
+  return rampEnd(servo) + servo.settleUs;
+}
+
+// End of the move at constant speed, the arrival is later if the servo settles
+unsigned long SmartServoEmulator::rampEnd(const emulated_servo_type &servo)
+{
+  if((servo.speed == 0) || (servo.continuous == true))
+  {
+    return servo.startTime;
+  }
+  return servo.startTime + (unsigned long)(fabs(servo.targetAngle - servo.startAngle) / servo.speed);
+}
+
+void SmartServoEmulator::sendArrivalReport(uint8_t devId)
+{
+  std::vector<uint8_t> frame;
+  frame.push_back(START_SYSEX);
+  frame.push_back(devId);
+  frame.push_back(SMART_SERVO);
+  frame.push_back(REPORT_WHEN_REACH_THE_SET_POSITION);
+  frame.push_back((devId + SMART_SERVO + REPORT_WHEN_REACH_THE_SET_POSITION) & 0x7f);
+  frame.push_back(END_SYSEX);
+  sendFrame(devId, frame, arrivalTime(servos[devId - 1]) + devId * hopUs);
+  servos[devId - 1].reportArrival = false;
+}
+
+void SmartServoEmulator::sendAck(uint8_t devId, uint8_t code, unsigned long readyTime)
+{
+  std::vector<uint8_t> frame;
+  frame.push_back(START_SYSEX);
+  frame.push_back(devId);
+  frame.push_back(CTL_ERROR_CODE);
+  frame.push_back(code);
+  frame.push_back((devId + CTL_ERROR_CODE + code) & 0x7f);
+  frame.push_back(END_SYSEX);
+  sendFrame(devId, frame, readyTime);
+}
+
+void SmartServoEmulator::sendValue(uint8_t devId, uint8_t cmd, const uint8_t *data, uint8_t length, unsigned long readyTime)
+{
+  std::vector<uint8_t> frame;
+  uint8_t checksum = devId + SMART_SERVO + cmd;
+  uint8_t i;
+  frame.push_back(START_SYSEX);
+  frame.push_back(devId);
+  frame.push_back(SMART_SERVO);
+  frame.push_back(cmd);
+  for(i = 0; i < length; i++)
+  {
+    frame.push_back(data[i]);
+    checksum += data[i];
+  }
+  frame.push_back(checksum & 0x7f);
+  frame.push_back(END_SYSEX);
+  sendFrame(devId, frame, readyTime);
+}
+
+void SmartServoEmulator::sendFrame(uint8_t devId, const std::vector<uint8_t> &frame, unsigned long readyTime)
+{
+  scheduled.insert(std::make_pair(readyTime, std::make_pair(devId, frame)));
+}
+
+// The request passes devId - 1 servos to reach the servo, the response passes them again on the way back
+unsigned long SmartServoEmulator::responseTime(uint8_t devId, unsigned long frameEnd)
+{
+  return frameEnd + processUs + 2 * devId * hopUs;
+}
+
+bool SmartServoEmulator::randomLoss(void)
+{
+  if(responseLoss <= 0)
+  {
+    return false;
+  }
+  randomState = randomState * 1103515245 + 12345;
+  return ((randomState >> 16) & 0x7fff) < responseLoss * 32768;
+}
@@ -9,33 +9,76 @@
  * 
  * \par Method List:
  *	  0. void beginSerial(Stream* servoPort);
- *    1. uint8_t MakeblockSmartServo::readByte(uint8_t *argv,int16_t idx);
- *    2. short MakeblockSmartServo::readShort(uint8_t *argv,int16_t idx,bool ignore_high);
- *    3. float MakeblockSmartServo::readFloat(uint8_t *argv,int16_t idx);
- *    4. long MakeblockSmartServo::readLong(uint8_t *argv,int idx);
- *    5. uint8_t MakeblockSmartServo::sendByte(uint8_t val);
- *    6. uint8_t MakeblockSmartServo::sendShort(int16_t val,bool ignore_high);
- *    7. uint8_t MakeblockSmartServo::sendFloat(float val);
- *    8. uint8_t MakeblockSmartServo::sendLong(long val);
- *    9. bool MakeblockSmartServo::assignDevIdRequest(void);
- *    10. bool MakeblockSmartServo::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
- *    11. bool MakeblockSmartServo::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
- *    12. bool MakeblockSmartServo::setZero(uint8_t dev_id);
- *    13. bool MakeblockSmartServo::setBreak(uint8_t dev_id, uint8_t breakStatus);
- *    14. bool MakeblockSmartServo::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value);
- *    15. bool MakeblockSmartServo::handSharke(uint8_t dev_id);
- *    16. bool MakeblockSmartServo::setPwmMove(uint8_t dev_id, int16_t pwm_value);
- *    17. bool MakeblockSmartServo::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed);
- *    18. long MakeblockSmartServo::getAngleRequest(uint8_t devId);
- *    19. float MakeblockSmartServo::getSpeedRequest(uint8_t devId);
- *    20. float MakeblockSmartServo::getVoltageRequest(uint8_t devId);
- *    21. float MakeblockSmartServo::getTempRequest(uint8_t devId);
- *    22. float MakeblockSmartServo::getCurrentRequest(uint8_t devId);
- *    23. void MakeblockSmartServo::assignDevIdResponse(void *arg);
- *    24. void MakeblockSmartServo::processSysexMessage(void);
- *    25. void MakeblockSmartServo::smartServoEventHandle(void);
- *    26. void MakeblockSmartServo::errorCodeCheckResponse(void *arg);
- *    27. void MakeblockSmartServo::smartServoCmdResponse(void *arg);
+ *    1. uint8_t MakeblockSmartServoBase::readByte(uint8_t *argv,int16_t idx);
+ *    2. short MakeblockSmartServoBase::readShort(uint8_t *argv,int16_t idx,bool ignore_high);
+ *    3. float MakeblockSmartServoBase::readFloat(uint8_t *argv,int16_t idx);
+ *    4. long MakeblockSmartServoBase::readLong(uint8_t *argv,int idx);
+ *    5. uint8_t MakeblockSmartServoBase::sendByte(uint8_t val);
+ *    6. uint8_t MakeblockSmartServoBase::sendShort(int16_t val,bool ignore_high);
+ *    7. uint8_t MakeblockSmartServoBase::sendFloat(float val);
+ *    8. uint8_t MakeblockSmartServoBase::sendLong(long val);
+ *    9. bool MakeblockSmartServoBase::assignDevIdRequest(void);
+ *    10. bool MakeblockSmartServoBase::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
+ *    11. bool MakeblockSmartServoBase::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
+ *    12. bool MakeblockSmartServoBase::setZero(uint8_t dev_id);
+ *    13. bool MakeblockSmartServoBase::setBreak(uint8_t dev_id, uint8_t breakStatus);
+ *    14. bool MakeblockSmartServoBase::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value);
+ *    15. bool MakeblockSmartServoBase::handSharke(uint8_t dev_id);
+ *    16. bool MakeblockSmartServoBase::setPwmMove(uint8_t dev_id, int16_t pwm_value);
+ *    17. bool MakeblockSmartServoBase::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed);
+ *    18. long MakeblockSmartServoBase::getAngleRequest(uint8_t devId,bool forceRefresh);
+ *    19. float MakeblockSmartServoBase::getSpeedRequest(uint8_t devId,bool forceRefresh);
+ *    20. float MakeblockSmartServoBase::getVoltageRequest(uint8_t devId,bool forceRefresh);
+ *    21. float MakeblockSmartServoBase::getTempRequest(uint8_t devId,bool forceRefresh);
+ *    22. float MakeblockSmartServoBase::getCurrentRequest(uint8_t devId,bool forceRefresh);
+ *    23. void MakeblockSmartServoBase::assignDevIdResponse(void *arg);
+ *    24. void MakeblockSmartServoBase::processSysexMessage(void);
+ *    25. void MakeblockSmartServoBase::smartServoEventHandle(void);
+ *    26. void MakeblockSmartServoBase::errorCodeCheckResponse(void *arg);
+ *    27. void MakeblockSmartServoBase::smartServoCmdResponse(void *arg);
+ *    28. smartServoHandle MakeblockSmartServoBase::requestAsync(uint8_t devId,uint8_t cmd,smartServoTransactionCb callback);
+ *    29. smartServoHandle MakeblockSmartServoBase::moveToAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback);
+ *    30. smartServoHandle MakeblockSmartServoBase::moveAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback);
+ *    31. bool MakeblockSmartServoBase::isDone(smartServoHandle handle);
+ *    32. bool MakeblockSmartServoBase::waitFor(smartServoHandle handle);
+ *    33. bool MakeblockSmartServoBase::waitForAll(const smartServoHandle *handles,uint8_t count);
+ *    34. uint8_t MakeblockSmartServoBase::pendingTransactions(void);
+ *    35. servo_device_type MakeblockSmartServoBase::getDeviceData(uint8_t devId);
+ *    36. bool MakeblockSmartServoBase::beginReceiveTask(HardwareSerial *uart,UBaseType_t priority,BaseType_t core);
+ *    37. uint16_t MakeblockSmartServoBase::getResponseSeq(uint8_t devId,uint8_t field);
+ *    38. uint8_t MakeblockSmartServoBase::getMoveState(uint8_t devId);
+ *    39. bool MakeblockSmartServoBase::reportsPositionReached(uint8_t devId);
+ *    40. void MakeblockSmartServoBase::setPositionReached(uint8_t devId);
+ *    41. bool MakeblockSmartServoBase::waitForPositionReached(const uint8_t *devIds,uint8_t count,unsigned long timeout);
+ *    42. bool MakeblockSmartServoBase::isReportOverdue(uint8_t devId);
+ *    43. bool MakeblockSmartServoBase::pollPositionReached(uint8_t devId);
+ *    44. void MakeblockSmartServoBase::setBaudRate(uint8_t dev_id,long baudRate);
+ *    45. uint8_t MakeblockSmartServoBase::getNumDevices(void);
+ *    46. void MakeblockSmartServoBase::setCacheTTL(uint8_t field,uint16_t ttl);
+ *    47. uint16_t MakeblockSmartServoBase::getCacheTTL(uint8_t field);
+ *    48. bool MakeblockSmartServoBase::isCacheFresh(uint8_t devId,uint8_t field);
+ *    49. void MakeblockSmartServoBase::setMaxRetries(uint8_t retries);
+ *    50. uint8_t MakeblockSmartServoBase::getMaxRetries(void);
+ *    51. servo_link_stats_type MakeblockSmartServoBase::getLinkStats(uint8_t devId);
+ *    52. void MakeblockSmartServoBase::resetLinkStats(uint8_t devId);
+ *    53. servo_bus_stats_type MakeblockSmartServoBase::getBusStats(void);
+ *    54. servo_service_stats_type MakeblockSmartServoBase::getServiceStats(uint8_t srv_id);
+ *    55. void MakeblockSmartServoBase::resetBusStats(void);
+ *    56. uint16_t MakeblockSmartServoBase::getLatencyBucketLimit(uint8_t bucket);
+ *    57. void MakeblockSmartServoBase::printBusStats(Print &out);
+ *    58. servo_device_type MakeblockSmartServo<N>::getDeviceData<DEV_ID>(void);
+ *    59. bool MakeblockSmartServoBase::streamMoveTo(uint8_t dev_id,long angle_value,float speed);
+ *    60. bool MakeblockSmartServoBase::streamPwmMove(uint8_t dev_id,int16_t pwm_value);
+ *    61. bool MakeblockSmartServoBase::setPid(uint8_t dev_id,float p,float i,float d);
+ *    62. bool MakeblockSmartServoBase::getPidRequest(uint8_t devId,servo_pid_type *pid);
+ *    63. uint8_t MakeblockSmartServoBase::measureStepResponse(uint8_t devId,long angle_value,float speed,servo_step_response_type *response);
+ *    64. bool MakeblockSmartServoBase::tunePid(uint8_t devId,long angleA,long angleB,float speed,servo_pid_tune_type *result);
+ *    65. bool MakeblockSmartServoBase::getStatusRequest(uint8_t devId,bool forceRefresh);
+ *    66. uint8_t MakeblockSmartServoBase::getStatusSupport(uint8_t devId);
+ *    67. void MakeblockSmartServoBase::beginCapture(servo_capture_type *buffer,uint16_t size);
+ *    68. void MakeblockSmartServoBase::endCapture(void);
+ *    69. uint16_t MakeblockSmartServoBase::getCaptureCount(void);
+ *    70. void MakeblockSmartServoBase::printCapture(Print &out);
  *
  * \par History:
  * <pre>
@@ -50,14 +93,37 @@
 #include <Arduino.h> 
 #include "MakeblockSmartServo.h"
 
-#ifdef ME_PORT_DEFINED
+#ifndef ME_PORT_DEFINED
+/**
+ * Constructor which uses the device storage of the derived MakeblockSmartServo<N>.
+ * \param[in]
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates, devices with a higher id are driven but their values are not stored.
+ */
+MakeblockSmartServoBase::MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices)
+                        : devices(deviceStates), maxDevices(maxDevices)
+{
+  parsingSysex = false;
+  sysex = {0};
+  sysexBytesRead = 0;
+  servo_num_max = 0;
+  resFlag = 0;
+  cmdTimeOutValue = 0;
+  _callback = NULL;
+  port = NULL;
+}
+#else // ME_PORT_DEFINED
 /**
  * Alternate Constructor which can call your own function to map the Me Smart Servo to arduino port,
  * no pins are used or initialized here.
  * \param[in]
- *   None
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates.
  */
-MakeblockSmartServo::MakeblockSmartServo() : MeSerialStandalone(0)
+MakeblockSmartServoBase::MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices)
+                        : MeSerialStandalone(0), devices(deviceStates), maxDevices(maxDevices)
 {
   parsingSysex = false;
   sysex = {0};
@@ -69,14 +135,19 @@ MakeblockSmartServo::MakeblockSmartServo() : MeSerialStandalone(0)
  * Alternate Constructor which can call your own function to map the Me Smart Servo to arduino port,
  * If the hardware serial was selected, it will used the hardware serial.
  * \param[in]
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates.
+ * \param[in]
  *   receivePin - the rx pin of serial(arduino port).
  * \param[in]
  *   transmitPin - the tx pin of serial(arduino port).
  * \param[in]
  *   inverse_logic - Whether the Serial level need inv.
  */
-MakeblockSmartServo::MakeblockSmartServo(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic)\
-                        : MeSerialStandalone(receivePin, transmitPin, inverse_logic)
+MakeblockSmartServoBase::MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices,\
+                        uint8_t receivePin, uint8_t transmitPin, bool inverse_logic)\
+                        : MeSerialStandalone(receivePin, transmitPin, inverse_logic), devices(deviceStates), maxDevices(maxDevices)
 {
   parsingSysex = false;
   sysex = {0};
@@ -101,7 +172,7 @@ MakeblockSmartServo::MakeblockSmartServo(uint8_t receivePin, uint8_t transmitPin
  * \par Others
  *   None
  */
-void MakeblockSmartServo::beginSerial(Stream* servoPort)
+void MakeblockSmartServoBase::beginSerial(Stream* servoPort)
 {
 	port = servoPort;
 }
@@ -122,13 +193,9 @@ void MakeblockSmartServo::beginSerial(Stream* servoPort)
  * \par Others
  *   None
  */
-uint8_t MakeblockSmartServo::readByte(uint8_t *argv,int16_t idx)
+uint8_t MakeblockSmartServoBase::readByte(uint8_t *argv,int16_t idx)
 {
-  uint8_t temp;
-  val1byte.byteVal[0] = argv[idx] & 0x7f;
-  temp = argv[idx+1] << 7;
-  val1byte.byteVal[0] |= temp;
-  return val1byte.charVal;
+  return decode7bit<uint8_t>(&argv[idx]);
 }
 
 /**
@@ -149,21 +216,10 @@ uint8_t MakeblockSmartServo::readByte(uint8_t *argv,int16_t idx)
  * \par Others
  *   None
  */
-short MakeblockSmartServo::readShort(uint8_t *argv,int16_t idx,bool ignore_high)
+short MakeblockSmartServoBase::readShort(uint8_t *argv,int16_t idx,bool ignore_high)
 {
-  uint8_t temp;
-  val2byte.byteVal[0] = argv[idx] & 0x7f;
-  temp = argv[idx+1] << 7;
-  val2byte.byteVal[0] |= temp;
-  val2byte.byteVal[1] = (argv[idx+1] >> 1) & 0x7f;
-
   //Send analog can ignored high
-  if(ignore_high == false)
-  {
-    temp = (argv[idx+2] << 6);
-    val2byte.byteVal[1] |= temp;
-  }
-  return val2byte.shortVal;
+  return decode7bit<int16_t>(&argv[idx],(ignore_high == false) ? 3 : 2);
 }
 
 /**
@@ -182,26 +238,9 @@ short MakeblockSmartServo::readShort(uint8_t *argv,int16_t idx,bool ignore_high)
  * \par Others
  *   None
  */
-float MakeblockSmartServo::readFloat(uint8_t *argv,int16_t idx)
+float MakeblockSmartServoBase::readFloat(uint8_t *argv,int16_t idx)
 {
-  uint8_t temp;
-  val4byte.byteVal[0] = argv[idx] & 0x7f;
-  temp = argv[idx+1] << 7;
-  val4byte.byteVal[0] |= temp;
-
-  val4byte.byteVal[1] =  (argv[idx+1] >> 1) & 0x7f;
-  temp = (argv[idx+2] << 6);
-  val4byte.byteVal[1] += temp;
-
-  val4byte.byteVal[2] =  (argv[idx+2] >> 2) & 0x7f;
-  temp = (argv[idx+3] << 5);
-  val4byte.byteVal[2] += temp;
-
-  val4byte.byteVal[3] =  (argv[idx+3] >> 3) & 0x7f;
-  temp = (argv[idx+4] << 4);
-  val4byte.byteVal[3] += temp;
-
-  return val4byte.floatVal;
+  return decode7bit<float>(&argv[idx]);
 }
 
 /**
@@ -220,26 +259,10 @@ float MakeblockSmartServo::readFloat(uint8_t *argv,int16_t idx)
  * \par Others
  *   None
  */
-long MakeblockSmartServo::readLong(uint8_t *argv,int idx)
+long MakeblockSmartServoBase::readLong(uint8_t *argv,int idx)
 {
-  uint8_t temp;
-  val4byte.byteVal[0] = argv[idx] & 0x7f;
-  temp = argv[idx+1] << 7;
-  val4byte.byteVal[0] |= temp;
-
-  val4byte.byteVal[1] =  (argv[idx+1] >> 1) & 0x7f;
-  temp = (argv[idx+2] << 6);
-  val4byte.byteVal[1] += temp;
-
-  val4byte.byteVal[2] =  (argv[idx+2] >> 2) & 0x7f;
-  temp = (argv[idx+3] << 5);
-  val4byte.byteVal[2] += temp;
-
-  val4byte.byteVal[3] =  (argv[idx+3] >> 3) & 0x7f;
-  temp = (argv[idx+4] << 4);
-  val4byte.byteVal[3] += temp;
-
-  return val4byte.longVal;
+  // long is 8 bytes on some hosts, the protocol always transfers 4 bytes
+  return decode7bit<int32_t>(&argv[idx]);
 }
 
 /**
@@ -256,17 +279,12 @@ long MakeblockSmartServo::readLong(uint8_t *argv,int idx)
  * \par Others
  *   None
  */
-uint8_t MakeblockSmartServo::sendByte(uint8_t val)
+uint8_t MakeblockSmartServoBase::sendByte(uint8_t val)
 {
   uint8_t checksum;
   uint8_t val_7bit[2]={0};
-  val1byte.charVal = val;
-  val_7bit[0] = val1byte.byteVal[0] & 0x7f;
-  port->write(val_7bit[0]);
-  val_7bit[1] = (val1byte.byteVal[0] >> 7) & 0x7f;
-  port->write(val_7bit[1]);
-  checksum = val_7bit[0] + val_7bit[1];
-  checksum = checksum & 0x7f;
+  checksum = encode7bit<uint8_t>(val,val_7bit);
+  port->write(val_7bit,2);
   return checksum;
 }
 
@@ -286,24 +304,13 @@ uint8_t MakeblockSmartServo::sendByte(uint8_t val)
  * \par Others
  *   None
  */
-uint8_t MakeblockSmartServo::sendShort(int16_t val,bool ignore_high)
+uint8_t MakeblockSmartServoBase::sendShort(int16_t val,bool ignore_high)
 {
   uint8_t checksum;
+  uint8_t count = (ignore_high == false) ? 3 : 2;
   uint8_t val_7bit[3]={0};
-  val2byte.shortVal = val;
-  val_7bit[0] = val2byte.byteVal[0] & 0x7f;
-  port->write(val_7bit[0]);
-  val_7bit[1] = ((val2byte.byteVal[1] << 1) | (val2byte.byteVal[0] >> 7)) & 0x7f;
-  port->write(val_7bit[1]);
-  checksum = val_7bit[0] + val_7bit[1];
-  //Send analog can ignored high
-  if(ignore_high == false)
-  {
-    val_7bit[2] = (val2byte.byteVal[1] >> 6) & 0x7f;
-    checksum += val_7bit[2];
-    port->write(val_7bit[2]);
-  }
-  checksum = checksum & 0x7f;
+  checksum = encode7bit<int16_t>(val,val_7bit,count);
+  port->write(val_7bit,count);
   return checksum;
 }
 
@@ -321,23 +328,12 @@ uint8_t MakeblockSmartServo::sendShort(int16_t val,bool ignore_high)
  * \par Others
  *   None
  */
-uint8_t MakeblockSmartServo::sendFloat(float val)
+uint8_t MakeblockSmartServoBase::sendFloat(float val)
 {
   uint8_t checksum;
   uint8_t val_7bit[5]={0};
-  val4byte.floatVal = val;
-  val_7bit[0] = val4byte.byteVal[0] & 0x7f;
-  port->write(val_7bit[0]);
-  val_7bit[1] = ((val4byte.byteVal[1] << 1) | (val4byte.byteVal[0] >> 7)) & 0x7f;
-  port->write(val_7bit[1]);
-  val_7bit[2] = ((val4byte.byteVal[2] << 2) | (val4byte.byteVal[1] >> 6)) & 0x7f;
-  port->write(val_7bit[2]);
-  val_7bit[3] = ((val4byte.byteVal[3] << 3) | (val4byte.byteVal[2] >> 5)) & 0x7f;
-  port->write(val_7bit[3]);
-  val_7bit[4] = (val4byte.byteVal[3] >> 4) & 0x7f;
-  port->write(val_7bit[4]);
-  checksum = val_7bit[0] + val_7bit[1] + val_7bit[2] + val_7bit[3] + val_7bit[4];
-  checksum = checksum & 0x7f;
+  checksum = encode7bit<float>(val,val_7bit);
+  port->write(val_7bit,5);
   return checksum;
 }
 
@@ -355,23 +351,12 @@ uint8_t MakeblockSmartServo::sendFloat(float val)
  * \par Others
  *   None
  */
-uint8_t MakeblockSmartServo::sendLong(long val)
+uint8_t MakeblockSmartServoBase::sendLong(long val)
 {
   uint8_t checksum;
   uint8_t val_7bit[5]={0};
-  val4byte.longVal = val;
-  val_7bit[0] = val4byte.byteVal[0] & 0x7f;
-  port->write(val_7bit[0]);
-  val_7bit[1] = ((val4byte.byteVal[1] << 1) | (val4byte.byteVal[0] >> 7)) & 0x7f;
-  port->write(val_7bit[1]);
-  val_7bit[2] = ((val4byte.byteVal[2] << 2) | (val4byte.byteVal[1] >> 6)) & 0x7f;
-  port->write(val_7bit[2]);
-  val_7bit[3] = ((val4byte.byteVal[3] << 3) | (val4byte.byteVal[2] >> 5)) & 0x7f;
-  port->write(val_7bit[3]);
-  val_7bit[4] = (val4byte.byteVal[3] >> 4) & 0x7f;
-  port->write(val_7bit[4]);
-  checksum = val_7bit[0] + val_7bit[1] + val_7bit[2] + val_7bit[3] + val_7bit[4];
-  checksum = checksum & 0x7f;
+  checksum = encode7bit<int32_t>(val,val_7bit);
+  port->write(val_7bit,5);
   return checksum;
 }
 
@@ -389,19 +374,18 @@ uint8_t MakeblockSmartServo::sendLong(long val)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::assignDevIdRequest(void)
+bool MakeblockSmartServoBase::assignDevIdRequest(void)
 {
-  port->write(START_SYSEX);
-  port->write(ALL_DEVICE);
-  port->write(CTL_ASSIGN_DEV_ID);
-  port->write((byte)0x00);
-  port->write(0x0f);
-  port->write(END_SYSEX);
+  servo_frame_type frame;
+  beginFrame(&frame,ALL_DEVICE,CTL_ASSIGN_DEV_ID);
+  frameAddRaw(&frame,0x00);
+  sendFrame(&frame);
   resFlag &= 0xfe;
   cmdTimeOutValue = millis();
   while(((resFlag & 0x01) != 0x01) || (millis() - cmdTimeOutValue < 150))
   {
     smartServoEventHandle();
+    waitForResponse();
     if(millis() - cmdTimeOutValue > 1200)
     {
       resFlag &= 0xfe;
@@ -433,38 +417,14 @@ bool MakeblockSmartServo::assignDevIdRequest(void)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback)
+bool MakeblockSmartServoBase::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback)
 {
-  uint8_t checksum;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_ABSOLUTE_ANGLE_LONG);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_ABSOLUTE_ANGLE_LONG);
-  checksum += sendLong(angle_value);
-  checksum += sendShort((int)speed,true);
-  checksum = checksum & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
   _callback = callback;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  return waitFor(moveToAsync(dev_id,angle_value,speed));
 }
 
 /**
@@ -487,38 +447,14 @@ bool MakeblockSmartServo::moveTo(uint8_t dev_id,long angle_value,float speed,sma
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback)
+bool MakeblockSmartServoBase::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback)
 {
-  uint8_t checksum;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_RELATIVE_ANGLE_LONG);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_RELATIVE_ANGLE_LONG);
-  checksum += sendLong(angle_value);
-  checksum += sendShort((int)speed,true);
-  checksum = checksum & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
   _callback = callback;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  return waitFor(moveAsync(dev_id,angle_value,speed));
 }
 
 /**
@@ -535,34 +471,19 @@ bool MakeblockSmartServo::move(uint8_t dev_id,long angle_value,float speed,smart
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::setZero(uint8_t dev_id)
+bool MakeblockSmartServoBase::setZero(uint8_t dev_id)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES,NULL);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -581,35 +502,20 @@ bool MakeblockSmartServo::setZero(uint8_t dev_id)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::setBreak(uint8_t dev_id, uint8_t breakStatus)
+bool MakeblockSmartServoBase::setBreak(uint8_t dev_id, uint8_t breakStatus)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_BREAK);
-  port->write(breakStatus);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_BREAK + breakStatus) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_BREAK,NULL);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_BREAK);
+  frameAddRaw(&frame,breakStatus);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -632,38 +538,22 @@ bool MakeblockSmartServo::setBreak(uint8_t dev_id, uint8_t breakStatus)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value)
+bool MakeblockSmartServoBase::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_RGB_LED);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_RGB_LED);
-  checksum += sendByte(r_value);
-  checksum += sendByte(g_value);
-  checksum += sendByte(b_value);
-  checksum &= 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_RGB_LED,NULL);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_RGB_LED);
+  frameAddByte(&frame,r_value);
+  frameAddByte(&frame,g_value);
+  frameAddByte(&frame,b_value);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -680,34 +570,19 @@ bool MakeblockSmartServo::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_v
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::handSharke(uint8_t dev_id)
+bool MakeblockSmartServoBase::handSharke(uint8_t dev_id)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SERVO_SHARKE_HAND);
-  checksum = (dev_id + SMART_SERVO + SERVO_SHARKE_HAND) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SERVO_SHARKE_HAND,NULL);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SERVO_SHARKE_HAND);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -726,36 +601,21 @@ bool MakeblockSmartServo::handSharke(uint8_t dev_id)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::setPwmMove(uint8_t dev_id, int16_t pwm_value)
+bool MakeblockSmartServoBase::setPwmMove(uint8_t dev_id, int16_t pwm_value)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_PWM_MOVE);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_PWM_MOVE);
-  checksum += sendShort(pwm_value,false);
-  checksum &= 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_PWM_MOVE,NULL);
+  setMoveState(dev_id,MOVE_STATE_UNTRACKED);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_PWM_MOVE);
+  frameAddShort(&frame,pwm_value,false);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -776,37 +636,22 @@ bool MakeblockSmartServo::setPwmMove(uint8_t dev_id, int16_t pwm_value)
  * \par Others
  *   None
  */
-bool MakeblockSmartServo::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed)
+bool MakeblockSmartServoBase::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed)
 {
-  uint8_t checksum;
+  servo_frame_type frame;
+  smartServoHandle handle;
   if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(dev_id);
-  port->write(SMART_SERVO);
-  port->write(SET_SERVO_INIT_ANGLE);
-  port->write(mode);
-  checksum = (dev_id + SMART_SERVO + SET_SERVO_INIT_ANGLE + mode);
-  checksum += sendShort(abs(speed),true);
-  checksum &= 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xbf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x40) != 0x40)
-  {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      resFlag &= 0xbf;
-      //wdt_reset();
-      return false;
-    }
-  }
-  resFlag &= 0xbf;
-  return true;
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_INIT_ANGLE,NULL);
+  setMoveState(dev_id,MOVE_STATE_UNTRACKED);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_INIT_ANGLE);
+  frameAddRaw(&frame,mode);
+  frameAddShort(&frame,abs(speed),true);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
 }
 
 /**
@@ -816,6 +661,8 @@ bool MakeblockSmartServo::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed
  *   This function used to get the smart servo's angle.
  * \param[in]
  *   devId - the device id of servo that we want to read its angle.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -823,34 +670,17 @@ bool MakeblockSmartServo::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed
  * \par Others
  *   None
  */
-long MakeblockSmartServo::getAngleRequest(uint8_t devId)
+long MakeblockSmartServoBase::getAngleRequest(uint8_t devId,bool forceRefresh)
 {
-  uint8_t checksum;
   if((devId > servo_num_max) && (devId != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(devId);
-  port->write(SMART_SERVO);
-  port->write(GET_SERVO_CUR_ANGLE);
-  port->write((byte)0x00);
-  checksum = (devId + SMART_SERVO + GET_SERVO_CUR_ANGLE + 0x00) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xfd;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x02) != 0x02)
+  if((forceRefresh == true) || (isCacheFresh(devId,SERVO_FIELD_ANGLE) == false))
   {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      //wdt_reset();
-      break;
-    }
+    waitFor(requestAsync(devId,GET_SERVO_CUR_ANGLE));
   }
-  resFlag &= 0xfd;
-  return servo_dev_list[devId - 1].angleValue;
+  return ((devId >= 1) && (devId <= maxDevices)) ? devices[devId - 1].values.angleValue : 0;
 }
 
 /**
@@ -860,6 +690,8 @@ long MakeblockSmartServo::getAngleRequest(uint8_t devId)
  *   This function used to get the smart servo's speed.
  * \param[in]
  *   devId - the device id of servo that we want to read its speed.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -867,34 +699,17 @@ long MakeblockSmartServo::getAngleRequest(uint8_t devId)
  * \par Others
  *   None
  */
-float MakeblockSmartServo::getSpeedRequest(uint8_t devId)
+float MakeblockSmartServoBase::getSpeedRequest(uint8_t devId,bool forceRefresh)
 {
-  uint8_t checksum;
   if((devId > servo_num_max) && (devId != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(devId);
-  port->write(SMART_SERVO);
-  port->write(GET_SERVO_SPEED);
-  port->write((byte)0x00);
-  checksum = (devId + SMART_SERVO + GET_SERVO_SPEED + 0x00) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xfb;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x04) != 0x04)
+  if((forceRefresh == true) || (isCacheFresh(devId,SERVO_FIELD_SPEED) == false))
   {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      //wdt_reset();
-      break;
-    }
+    waitFor(requestAsync(devId,GET_SERVO_SPEED));
   }
-  resFlag &= 0xfb;
-  return servo_dev_list[devId - 1].servoSpeed;
+  return ((devId >= 1) && (devId <= maxDevices)) ? devices[devId - 1].values.servoSpeed : 0;
 }
 
 /**
@@ -904,6 +719,8 @@ float MakeblockSmartServo::getSpeedRequest(uint8_t devId)
  *   This function used to get the smart servo's voltage.
  * \param[in]
  *   devId - the device id of servo that we want to read its voltage.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -911,33 +728,17 @@ float MakeblockSmartServo::getSpeedRequest(uint8_t devId)
  * \par Others
  *   None
  */
-float MakeblockSmartServo::getVoltageRequest(uint8_t devId)
+float MakeblockSmartServoBase::getVoltageRequest(uint8_t devId,bool forceRefresh)
 {
-  uint8_t checksum;
   if((devId > servo_num_max) && (devId != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(devId);
-  port->write(SMART_SERVO);
-  port->write(GET_SERVO_VOLTAGE);
-  port->write((byte)0x00);
-  checksum = (devId + SMART_SERVO + GET_SERVO_VOLTAGE + 0x00) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xf7;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x08) != 0x08)
+  if((forceRefresh == true) || (isCacheFresh(devId,SERVO_FIELD_VOLTAGE) == false))
   {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      //wdt_reset();
-      break;
-    }
+    waitFor(requestAsync(devId,GET_SERVO_VOLTAGE));
   }
-  return servo_dev_list[devId - 1].voltage;
+  return ((devId >= 1) && (devId <= maxDevices)) ? devices[devId - 1].values.voltage : 0;
 }
 
 /**
@@ -947,6 +748,8 @@ float MakeblockSmartServo::getVoltageRequest(uint8_t devId)
  *   This function used to get the smart servo's temperature.
  * \param[in]
  *   devId - the device id of servo that we want to read its temperature.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -954,34 +757,17 @@ float MakeblockSmartServo::getVoltageRequest(uint8_t devId)
  * \par Others
  *   None
  */
-float MakeblockSmartServo::getTempRequest(uint8_t devId)
+float MakeblockSmartServoBase::getTempRequest(uint8_t devId,bool forceRefresh)
 {
-  uint8_t checksum;
   if((devId > servo_num_max) && (devId != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(devId);
-  port->write(SMART_SERVO);
-  port->write(GET_SERVO_TEMPERATURE);
-  port->write((byte)0x00);
-  checksum = (devId + SMART_SERVO + GET_SERVO_TEMPERATURE + 0x00) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xef;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x10) != 0x10)
+  if((forceRefresh == true) || (isCacheFresh(devId,SERVO_FIELD_TEMPERATURE) == false))
   {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      //wdt_reset();
-      break;
-    }
+    waitFor(requestAsync(devId,GET_SERVO_TEMPERATURE));
   }
-  resFlag &= 0xf7;
-  return servo_dev_list[devId - 1].temperature;
+  return ((devId >= 1) && (devId <= maxDevices)) ? devices[devId - 1].values.temperature : 0;
 }
 
 /**
@@ -991,6 +777,8 @@ float MakeblockSmartServo::getTempRequest(uint8_t devId)
  *   This function used to get the smart servo's current.
  * \param[in]
  *   devId - the device id of servo that we want to read its current.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -998,34 +786,17 @@ float MakeblockSmartServo::getTempRequest(uint8_t devId)
  * \par Others
  *   None
  */
-float MakeblockSmartServo::getCurrentRequest(uint8_t devId)
+float MakeblockSmartServoBase::getCurrentRequest(uint8_t devId,bool forceRefresh)
 {
-  uint8_t checksum;
   if((devId > servo_num_max) && (devId != ALL_DEVICE))
   {
     return false;
   }
-  port->write(START_SYSEX);
-  port->write(devId);
-  port->write(SMART_SERVO);
-  port->write(GET_SERVO_ELECTRIC_CURRENT);
-  port->write((byte)0x00);
-  checksum = (devId + SMART_SERVO + GET_SERVO_ELECTRIC_CURRENT + 0x00) & 0x7f;
-  port->write(checksum);
-  port->write(END_SYSEX);
-  resFlag &= 0xdf;
-  cmdTimeOutValue = millis();
-  while((resFlag & 0x20) != 0x20)
+  if((forceRefresh == true) || (isCacheFresh(devId,SERVO_FIELD_CURRENT) == false))
   {
-    smartServoEventHandle();
-    if(millis() - cmdTimeOutValue > 1200)
-    {
-      //wdt_reset();
-      break;
-    }
+    waitFor(requestAsync(devId,GET_SERVO_ELECTRIC_CURRENT));
   }
-  resFlag &= 0xdf;
-  return servo_dev_list[devId - 1].current;
+  return ((devId >= 1) && (devId <= maxDevices)) ? devices[devId - 1].values.current : 0;
 }
 
 /**
@@ -1042,7 +813,7 @@ float MakeblockSmartServo::getCurrentRequest(uint8_t devId)
  * \par Others
  *   None
  */
-void MakeblockSmartServo::assignDevIdResponse(void *arg)
+void MakeblockSmartServoBase::assignDevIdResponse(void *arg)
 {
   //The arg from value[0]
   uint8_t DeviceId = 0;
@@ -1070,9 +841,15 @@ void MakeblockSmartServo::assignDevIdResponse(void *arg)
  * \par Others
  *   None
  */
-void MakeblockSmartServo::processSysexMessage(void)
+void MakeblockSmartServoBase::processSysexMessage(void)
 {
   uint8_t i;
+  uint8_t idx = serviceIndex(sysex.val.srv_id);
+  busStats.framesReceived++;
+  if(idx < SMART_SERVO_STAT_SERVICES)
+  {
+    serviceStats[idx].received++;
+  }
   if(sysex.val.dev_id != ALL_DEVICE)
   {
     switch(sysex.val.srv_id)
@@ -1106,39 +883,22 @@ void MakeblockSmartServo::processSysexMessage(void)
  * \par Others
  *   None
  */
-void MakeblockSmartServo::smartServoEventHandle(void)
+void MakeblockSmartServoBase::smartServoEventHandle(void)
 {
-  while (port->available())
+#ifdef ESP32
+  // While the receive task runs, it is the only reader of the port
+  if((rxTaskHandle != NULL) && (xTaskGetCurrentTaskHandle() != rxTaskHandle))
   {
-    // get the new byte:
-    uint8_t inputData = port->read();
-    if(parsingSysex)
-    {
-      if (inputData == END_SYSEX)
-      {
-        //stop sysex byte
-        parsingSysex = false;
-        //fire off handler function
-        processSysexMessage();
-      }
-      else
-      {
-        //normal data byte - add to buffer
-        sysex.storedInputData[sysexBytesRead] = inputData;
-        sysexBytesRead++;
-        if(sysexBytesRead > DEFAULT_UART_BUF_SIZE-1)
-        {
-          parsingSysex = false;
-          sysexBytesRead = 0;
-        }
-      }
-    }
-    else if(inputData == START_SYSEX)
-    {
-      parsingSysex = true;
-      sysexBytesRead = 0;
-    }
+    lock();
+    checkTransactionTimeouts();
+    unlock();
+    return;
   }
+#endif
+  lock();
+  processReceivedBytes();
+  checkTransactionTimeouts();
+  unlock();
 }
 
 /**
@@ -1155,7 +915,7 @@ void MakeblockSmartServo::smartServoEventHandle(void)
  * \par Others
  *   None
  */
-void MakeblockSmartServo::errorCodeCheckResponse(void *arg)
+void MakeblockSmartServoBase::errorCodeCheckResponse(void *arg)
 {
   uint8_t DeviceId = 0;
   uint8_t ServiceId = 0;
@@ -1166,6 +926,12 @@ void MakeblockSmartServo::errorCodeCheckResponse(void *arg)
   {
     errorcode = sysex.val.value[0];
     resFlag |= 0x40;
+    // Firmware without GET_SERVO_STATUS rejects it with an error code instead of a status reply
+    if((errorcode != PROCESS_SUC) && (DeviceId >= 1) && (DeviceId <= maxDevices) && (rejectStatusRequest(DeviceId) == true))
+    {
+      return;
+    }
+    finishTransaction(DeviceId,CTL_ERROR_CODE,0);
   }
 }
 
@@ -1183,43 +949,104 @@ void MakeblockSmartServo::errorCodeCheckResponse(void *arg)
  * \par Others
  *   None
  */
-void MakeblockSmartServo::smartServoCmdResponse(void *arg)
+void MakeblockSmartServoBase::smartServoCmdResponse(void *arg)
 {
   long angle_v;
   float speed_v;
   float temp_v;
   float vol_v;
   float current_v;
+  uint8_t field;
   uint8_t servoNum = sysex.val.dev_id;
   int16_t cmd = (int16_t)sysex.val.value[0];
+  if((servoNum < 1) || (servoNum > maxDevices))
+  {
+    return;
+  }
   switch(cmd)
   {
     case GET_SERVO_CUR_ANGLE:
       angle_v = readLong(sysex.val.value,1);
-      servo_dev_list[sysex.val.dev_id - 1].angleValue = angle_v;
+      devices[sysex.val.dev_id - 1].values.angleValue = angle_v;
+      devices[servoNum - 1].responseTime[SERVO_FIELD_ANGLE] = millis();
+      devices[servoNum - 1].responseSeq[SERVO_FIELD_ANGLE]++;
       resFlag |= 0x02;
       break;
     case GET_SERVO_SPEED:
       speed_v = readFloat(sysex.val.value,1);
-      servo_dev_list[sysex.val.dev_id - 1].servoSpeed = speed_v;
+      devices[sysex.val.dev_id - 1].values.servoSpeed = speed_v;
+      devices[servoNum - 1].responseTime[SERVO_FIELD_SPEED] = millis();
+      devices[servoNum - 1].responseSeq[SERVO_FIELD_SPEED]++;
       resFlag |= 0x04;
       break;
     case GET_SERVO_VOLTAGE:
       vol_v = readFloat(sysex.val.value,1);
-      servo_dev_list[sysex.val.dev_id - 1].voltage = vol_v;
+      devices[sysex.val.dev_id - 1].values.voltage = vol_v;
+      devices[servoNum - 1].responseTime[SERVO_FIELD_VOLTAGE] = millis();
+      devices[servoNum - 1].responseSeq[SERVO_FIELD_VOLTAGE]++;
       resFlag |= 0x08;
       break;
     case GET_SERVO_TEMPERATURE:
       temp_v = readFloat(sysex.val.value,1);
-      servo_dev_list[sysex.val.dev_id - 1].temperature = temp_v;
+      devices[sysex.val.dev_id - 1].values.temperature = temp_v;
+      devices[servoNum - 1].responseTime[SERVO_FIELD_TEMPERATURE] = millis();
+      devices[servoNum - 1].responseSeq[SERVO_FIELD_TEMPERATURE]++;
       resFlag |= 0x10;
       break;
     case GET_SERVO_ELECTRIC_CURRENT:
       current_v = readFloat(sysex.val.value,1);
-      servo_dev_list[sysex.val.dev_id - 1].current = current_v;
+      devices[sysex.val.dev_id - 1].values.current = current_v;
+      devices[servoNum - 1].responseTime[SERVO_FIELD_CURRENT] = millis();
+      devices[servoNum - 1].responseSeq[SERVO_FIELD_CURRENT]++;
       resFlag |= 0x20;
       break;
+    case GET_SERVO_STATUS:
+      if(sysexBytesRead - 4 < SMART_SERVO_STATUS_SIZE)
+      {
+        devices[servoNum - 1].statusSupport = SERVO_STATUS_UNSUPPORTED;
+        break;
+      }
+      vol_v = readFloat(sysex.val.value,11);
+      temp_v = readFloat(sysex.val.value,16);
+      // The layout is not documented: a reply with a voltage or temperature out of range (or NaN) is not decoded
+      // and the device is asked with the single requests from now on
+      if(!((vol_v >= SMART_SERVO_STATUS_MIN_VOLTAGE) && (vol_v <= SMART_SERVO_STATUS_MAX_VOLTAGE) &&
+           (temp_v >= SMART_SERVO_STATUS_MIN_TEMPERATURE) && (temp_v <= SMART_SERVO_STATUS_MAX_TEMPERATURE)))
+      {
+        devices[servoNum - 1].statusSupport = SERVO_STATUS_UNSUPPORTED;
+        break;
+      }
+      devices[servoNum - 1].values.angleValue = readLong(sysex.val.value,1);
+      devices[servoNum - 1].values.servoSpeed = readFloat(sysex.val.value,6);
+      devices[servoNum - 1].values.voltage = vol_v;
+      devices[servoNum - 1].values.temperature = temp_v;
+      devices[servoNum - 1].values.current = readFloat(sysex.val.value,21);
+      for(field = 0; field < SERVO_FIELD_COUNT; field++)
+      {
+        devices[servoNum - 1].responseTime[field] = millis();
+        devices[servoNum - 1].responseSeq[field]++;
+      }
+      devices[servoNum - 1].statusSupport = SERVO_STATUS_SUPPORTED;
+      resFlag |= 0x3e;
+      break;
+    case GET_SERVO_PID:
+      // P, I and D as floats, shorter replies are ignored
+      if(sysexBytesRead - 4 >= 15)
+      {
+        devices[servoNum - 1].pid.p = readFloat(sysex.val.value,1);
+        devices[servoNum - 1].pid.i = readFloat(sysex.val.value,6);
+        devices[servoNum - 1].pid.d = readFloat(sysex.val.value,11);
+      }
+      break;
     case REPORT_WHEN_REACH_THE_SET_POSITION:
+      devices[servoNum - 1].moveState = MOVE_STATE_IDLE;
+      devices[servoNum - 1].positionReports = true;
+#ifdef ESP32
+      if(responseEvent != NULL)
+      {
+        xSemaphoreGive(responseEvent);
+      }
+#endif
       if(_callback != NULL)
       {
         _callback(servoNum);
@@ -1228,4 +1055,2783 @@ void MakeblockSmartServo::smartServoCmdResponse(void *arg)
     default:
       break;
   }
+  finishTransaction(servoNum,SMART_SERVO,(uint8_t)cmd);
+}
+
+/**
+ * \par Function
+ *   requestAsync
+ * \par Description
+ *   Sends a read request without waiting for the response.
+ * \param[in]
+ *   devId - the device id of servo that we want to read from.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \param[in]
+ *   callback - callback function when the response arrived or the request timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the request could not be sent.
+ * \par Others
+ *   None
+ */
+smartServoHandle MakeblockSmartServoBase::requestAsync(uint8_t devId,uint8_t cmd,smartServoTransactionCb callback)
+{
+  smartServoHandle handle;
+  if((devId > servo_num_max) && (devId != ALL_DEVICE))
+  {
+    return SMART_SERVO_INVALID_HANDLE;
+  }
+  handle = beginTransaction(devId,SMART_SERVO,cmd,callback);
+  sendRequestFrame(handle,devId,cmd);
+  return handle;
+}
+
+/**
+ * \par Function
+ *   moveToAsync
+ * \par Description
+ *   smart servo moves to the absolute angle. Does not wait for the acknowledge of the servo.
+ * \param[in]
+ *    dev_id - the device id of servo that we want to move.
+ * \param[in]
+ *    angle_value - the absolute angle value we want move to.
+ * \param[in]
+ *    speed - move speed value(The unit is rpm).
+ * \param[in]
+ *    callback - callback function when the command was acknowledged or timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the command could not be sent.
+ * \par Others
+ *   None
+ */
+smartServoHandle MakeblockSmartServoBase::moveToAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback)
+{
+  servo_frame_type frame;
+  smartServoHandle handle;
+  if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
+  {
+    return SMART_SERVO_INVALID_HANDLE;
+  }
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_ABSOLUTE_ANGLE_LONG,callback);
+  setMoveState(dev_id,MOVE_STATE_MOVING);
+  setReportDeadline(dev_id,angle_value,speed,true);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_ABSOLUTE_ANGLE_LONG);
+  frameAddLong(&frame,angle_value);
+  frameAddShort(&frame,(int)speed,true);
+  sendTransactionFrame(handle,&frame);
+  return handle;
+}
+
+/**
+ * \par Function
+ *   moveAsync
+ * \par Description
+ *   smart servo moves to the relative angle. Does not wait for the acknowledge of the servo.
+ * \param[in]
+ *    dev_id - the device id of servo that we want to move.
+ * \param[in]
+ *    angle_value - the relative angle value we want move to.
+ * \param[in]
+ *    speed - move speed value(The unit is rpm).
+ * \param[in]
+ *    callback - callback function when the command was acknowledged or timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the command could not be sent.
+ * \par Others
+ *   None
+ */
+smartServoHandle MakeblockSmartServoBase::moveAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback)
+{
+  servo_frame_type frame;
+  smartServoHandle handle;
+  if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
+  {
+    return SMART_SERVO_INVALID_HANDLE;
+  }
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_RELATIVE_ANGLE_LONG,callback);
+  setMoveState(dev_id,MOVE_STATE_MOVING);
+  setReportDeadline(dev_id,angle_value,speed,false);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_RELATIVE_ANGLE_LONG);
+  frameAddLong(&frame,angle_value);
+  frameAddShort(&frame,(int)speed,true);
+  sendTransactionFrame(handle,&frame);
+  return handle;
+}
+
+/**
+ * \par Function
+ *   streamMoveTo
+ * \par Description
+ *   smart servo moves to the absolute angle. For setpoints which are sent periodically: no transaction is
+ *   started, the frame is not sent again and the acknowledge of the servo is not waited for.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to move.\n
+ * \param[in]
+ *   angle_value - the absolute angle value we want move to.\n
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).\n
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent.
+ * \par Others
+ *   A lost setpoint is replaced by the next one. The acknowledges are counted in the bus statistics
+ *   (streamAcks) instead of as unmatched responses.
+ */
+bool MakeblockSmartServoBase::streamMoveTo(uint8_t dev_id,long angle_value,float speed)
+{
+  servo_frame_type frame;
+  if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
+  {
+    return false;
+  }
+  // Process the acknowledges of earlier setpoints, there is no transaction which would do it
+  smartServoEventHandle();
+  setMoveState(dev_id,MOVE_STATE_MOVING);
+  setReportDeadline(dev_id,angle_value,speed,true);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_ABSOLUTE_ANGLE_LONG);
+  frameAddLong(&frame,angle_value);
+  frameAddShort(&frame,(int)speed,true);
+  sendStreamFrame(dev_id,&frame);
+  return true;
+}
+
+/**
+ * \par Function
+ *   streamPwmMove
+ * \par Description
+ *   set the pwm motion of smart servo. For setpoints which are sent periodically: no transaction is
+ *   started, the frame is not sent again and the acknowledge of the servo is not waited for.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to set.\n
+ * \param[in]
+ *   pwm_value - the pwm value we wan't set the servo motor.\n
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent.
+ * \par Others
+ *   See streamMoveTo().
+ */
+bool MakeblockSmartServoBase::streamPwmMove(uint8_t dev_id,int16_t pwm_value)
+{
+  servo_frame_type frame;
+  if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
+  {
+    return false;
+  }
+  smartServoEventHandle();
+  setMoveState(dev_id,MOVE_STATE_UNTRACKED);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_PWM_MOVE);
+  frameAddShort(&frame,pwm_value,false);
+  sendStreamFrame(dev_id,&frame);
+  return true;
+}
+
+/**
+ * \par Function
+ *   isDone
+ * \par Description
+ *   Processes received messages and checks if a transaction has finished (response received or timed out).
+ * \param[in]
+ *   handle - the handle returned when the request was sent.
+ * \par Output
+ *   None
+ * \return
+ *   true if the transaction is not pending any more.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::isDone(smartServoHandle handle)
+{
+  servo_transaction_type *trans;
+  if(handle < 0)
+  {
+    return true;
+  }
+  bool done;
+  smartServoEventHandle();
+  lock();
+  trans = &transactions[handle & 0xff];
+  done = (trans->generation != (uint8_t)(handle >> 8)) || (trans->state != TRANSACTION_PENDING);
+  unlock();
+  return done;
+}
+
+/**
+ * \par Function
+ *   waitFor
+ * \par Description
+ *   Waits until a transaction has finished.
+ * \param[in]
+ *   handle - the handle returned when the request was sent.
+ * \par Output
+ *   None
+ * \return
+ *   true if the response was received, false if the transaction timed out or the handle is invalid.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::waitFor(smartServoHandle handle)
+{
+  servo_transaction_type *trans;
+  if(handle < 0)
+  {
+    return false;
+  }
+  bool success;
+  while(isDone(handle) == false)
+  {
+    waitForResponse();
+    //wdt_reset();
+  }
+  lock();
+  trans = &transactions[handle & 0xff];
+  // If the slot was reused, the transaction must have finished long ago
+  success = (trans->generation != (uint8_t)(handle >> 8)) || (trans->state == TRANSACTION_DONE);
+  unlock();
+  return success;
+}
+
+/**
+ * \par Function
+ *   waitForAll
+ * \par Description
+ *   Waits until all given transactions have finished.
+ * \param[in]
+ *   *handles - the handles returned when the requests were sent.
+ * \param[in]
+ *   count - number of handles.
+ * \par Output
+ *   None
+ * \return
+ *   true if the responses of all transactions were received.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::waitForAll(const smartServoHandle *handles,uint8_t count)
+{
+  bool success = true;
+  uint8_t i;
+  for(i = 0; i < count; i++)
+  {
+    if(waitFor(handles[i]) == false)
+    {
+      success = false;
+    }
+  }
+  return success;
+}
+
+/**
+ * \par Function
+ *   pendingTransactions
+ * \par Description
+ *   Returns the number of transactions which are waiting for a response.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   Number of pending transactions.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::pendingTransactions(void)
+{
+  uint8_t i;
+  uint8_t count = 0;
+  lock();
+  for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+  {
+    if(transactions[i].state == TRANSACTION_PENDING)
+    {
+      count++;
+    }
+  }
+  unlock();
+  return count;
+}
+
+/**
+ * \par Function
+ *   getDeviceData
+ * \par Description
+ *   Returns the last values received from a smart servo without sending a request.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   Copy of the stored angle, speed, voltage, temperature and current of the servo.
+ * \par Others
+ *   None
+ */
+servo_device_type MakeblockSmartServoBase::getDeviceData(uint8_t devId)
+{
+  servo_device_type data = {};
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return data;
+  }
+  lock();
+  data.angleValue = devices[devId - 1].values.angleValue;
+  data.servoSpeed = devices[devId - 1].values.servoSpeed;
+  data.voltage = devices[devId - 1].values.voltage;
+  data.temperature = devices[devId - 1].values.temperature;
+  data.current = devices[devId - 1].values.current;
+  unlock();
+  return data;
+}
+
+/**
+ * \par Function
+ *   beginTransaction
+ * \par Description
+ *   Reserves a transaction slot before a frame is sent. If all slots are in use, it waits until the oldest
+ *   pending transaction finishes or times out.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   srv_id - the service id of the expected response.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \param[in]
+ *   callback - callback function when the transaction finishes.
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction.
+ * \par Others
+ *   None
+ */
+smartServoHandle MakeblockSmartServoBase::beginTransaction(uint8_t dev_id,uint8_t srv_id,uint8_t cmd,smartServoTransactionCb callback)
+{
+  uint8_t i;
+  uint8_t idx;
+  servo_transaction_type *trans;
+  // Drain responses of earlier requests first, so back-to-back requests do not overflow the receive buffer
+  smartServoEventHandle();
+  while(true)
+  {
+    lock();
+    // Use the slots round robin so finished transactions stay readable as long as possible
+    for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+    {
+      idx = (nextTransaction + i) % SMART_SERVO_MAX_PENDING;
+      if(transactions[idx].state != TRANSACTION_PENDING)
+      {
+        trans = &transactions[idx];
+        trans->dev_id = dev_id;
+        trans->srv_id = srv_id;
+        trans->cmd = cmd;
+        trans->generation = (trans->generation + 1) & 0x7f;
+        trans->order = transactionOrder++;
+        trans->retries = 0;
+        trans->frame.length = 0;
+        trans->startTime = millis();
+        trans->issueTime = trans->startTime;
+        trans->callback = callback;
+        trans->state = TRANSACTION_PENDING;
+        nextTransaction = (idx + 1) % SMART_SERVO_MAX_PENDING;
+        unlock();
+        return (smartServoHandle)((trans->generation << 8) | idx);
+      }
+    }
+    unlock();
+    // All slots are busy: process responses until one is free (pending transactions time out eventually)
+    smartServoEventHandle();
+    waitForResponse();
+  }
+}
+
+/**
+ * \par Function
+ *   finishTransaction
+ * \par Description
+ *   Marks the oldest pending transaction matching a received response as done.
+ * \param[in]
+ *   dev_id - the device id of the response.
+ * \param[in]
+ *   srv_id - the service id of the response.
+ * \param[in]
+ *   cmd - the secondary command of the response (ignored for CTL_ERROR_CODE).
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::finishTransaction(uint8_t dev_id,uint8_t srv_id,uint8_t cmd)
+{
+  uint8_t i;
+  servo_transaction_type *trans;
+  servo_transaction_type *oldest = NULL;
+  servo_device_state_type *device;
+  unsigned long timeout;
+  uint8_t bucket;
+  uint8_t idx;
+  for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+  {
+    trans = &transactions[i];
+    if((trans->state != TRANSACTION_PENDING) || (trans->srv_id != srv_id))
+    {
+      continue;
+    }
+    if((trans->dev_id != dev_id) && (trans->dev_id != ALL_DEVICE))
+    {
+      continue;
+    }
+    // The acknowledge of a command does not contain the command, so it belongs to the oldest command of the device
+    if((srv_id != CTL_ERROR_CODE) && (trans->cmd != cmd))
+    {
+      continue;
+    }
+    if((oldest == NULL) || ((int16_t)(trans->order - oldest->order) < 0))
+    {
+      oldest = trans;
+    }
+  }
+  // Acknowledges of streamed setpoints have no transaction. They arrive before the acknowledge of a command
+  // sent after the setpoints, e.g. the stop at the end of streaming, and not later than one timeout after them.
+  if((srv_id == CTL_ERROR_CODE) && (dev_id >= 1) && (dev_id <= maxDevices) && (devices[dev_id - 1].streamAcks > 0))
+  {
+    device = &devices[dev_id - 1];
+    timeout = (device->linkStats.timeout != 0) ? device->linkStats.timeout : SMART_SERVO_CMD_TIMEOUT;
+    if(millis() - device->streamTime > timeout)
+    {
+      // The acknowledges of the remaining setpoints were lost
+      device->streamAcks = 0;
+    }
+    else if((oldest == NULL) || ((int16_t)(oldest->order - device->streamOrder) >= 0))
+    {
+      device->streamAcks--;
+      device->linkStats.responses++;
+      busStats.streamAcks++;
+      return;
+    }
+  }
+  // Position reports arrive without request
+  if((oldest == NULL) && ((srv_id != SMART_SERVO) || (cmd != REPORT_WHEN_REACH_THE_SET_POSITION)))
+  {
+    busStats.unmatched++;
+  }
+  if(oldest != NULL)
+  {
+    oldest->state = TRANSACTION_DONE;
+    bucket = latencyBucket(millis() - oldest->issueTime);
+    if((dev_id >= 1) && (dev_id <= maxDevices))
+    {
+      devices[dev_id - 1].linkStats.responses++;
+      devices[dev_id - 1].linkStats.latency[bucket]++;
+    }
+    idx = serviceIndex(srv_id);
+    if(idx < SMART_SERVO_STAT_SERVICES)
+    {
+      serviceStats[idx].latency[bucket]++;
+    }
+    // Karn's algorithm: the response to a frame sent more than once can not be assigned to one of the sends
+    if(oldest->retries == 0)
+    {
+      updateRoundTripTime(dev_id,millis() - oldest->startTime);
+    }
+#ifdef ESP32
+    if(responseEvent != NULL)
+    {
+      xSemaphoreGive(responseEvent);
+    }
+#endif
+    if(oldest->callback != NULL)
+    {
+      oldest->callback(dev_id,oldest->cmd,true);
+    }
+  }
+}
+
+/**
+ * \par Function
+ *   checkTransactionTimeouts
+ * \par Description
+ *   Sends the frame of pending transactions without response in time again, or marks them as failed
+ *   after getMaxRetries() retries.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::checkTransactionTimeouts(void)
+{
+  uint8_t i;
+  servo_transaction_type *trans;
+  for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+  {
+    trans = &transactions[i];
+    if((trans->state == TRANSACTION_PENDING) && (millis() - trans->startTime > transactionTimeout(trans)))
+    {
+      if(retryTransaction(trans) == true)
+      {
+        continue;
+      }
+      countLinkEvent(trans->dev_id,LINK_EVENT_TIMEOUT);
+      failTransaction(trans);
+    }
+  }
+}
+
+/**
+ * \par Function
+ *   failTransaction
+ * \par Description
+ *   Marks a pending transaction as failed and notifies its callback.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   A failed GET_SERVO_STATUS request of a device with unknown support marks it SERVO_STATUS_UNSUPPORTED.
+ */
+void MakeblockSmartServoBase::failTransaction(servo_transaction_type *trans)
+{
+  trans->state = TRANSACTION_FAILED;
+  // A move which was not acknowledged will not be reported as reached
+  if((trans->cmd == SET_SERVO_ABSOLUTE_ANGLE_LONG) || (trans->cmd == SET_SERVO_RELATIVE_ANGLE_LONG))
+  {
+    setMoveState(trans->dev_id,MOVE_STATE_IDLE);
+  }
+  if((trans->srv_id == SMART_SERVO) && (trans->cmd == GET_SERVO_STATUS) && (trans->dev_id >= 1) && (trans->dev_id <= maxDevices) &&
+     (devices[trans->dev_id - 1].statusSupport == SERVO_STATUS_UNKNOWN))
+  {
+    devices[trans->dev_id - 1].statusSupport = SERVO_STATUS_UNSUPPORTED;
+  }
+#ifdef ESP32
+  if(responseEvent != NULL)
+  {
+    xSemaphoreGive(responseEvent);
+  }
+#endif
+  if(trans->callback != NULL)
+  {
+    trans->callback(trans->dev_id,trans->cmd,false);
+  }
+}
+
+/**
+ * \par Function
+ *   rejectStatusRequest
+ * \par Description
+ *   Fails the pending GET_SERVO_STATUS request of a device which answered with an error code.
+ * \param[in]
+ *   dev_id - the device id of servo which sent the error code.
+ * \par Output
+ *   None
+ * \return
+ *   true if the error code belongs to the status request.
+ * \par Others
+ *   The error code belongs to a command if one is pending for the device.
+ */
+bool MakeblockSmartServoBase::rejectStatusRequest(uint8_t dev_id)
+{
+  uint8_t i;
+  servo_transaction_type *trans;
+  servo_transaction_type *status = NULL;
+  for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+  {
+    trans = &transactions[i];
+    if((trans->state != TRANSACTION_PENDING) || (trans->dev_id != dev_id))
+    {
+      continue;
+    }
+    if(trans->srv_id == CTL_ERROR_CODE)
+    {
+      return false;
+    }
+    if((trans->cmd == GET_SERVO_STATUS) && ((status == NULL) || ((int16_t)(trans->order - status->order) < 0)))
+    {
+      status = trans;
+    }
+  }
+  if(status == NULL)
+  {
+    return false;
+  }
+  devices[dev_id - 1].linkStats.responses++;
+  failTransaction(status);
+  return true;
+}
+
+/**
+ * \par Function
+ *   sendRequestFrame
+ * \par Description
+ *   Writes a read request frame for the given secondary command.
+ * \param[in]
+ *   handle - the handle returned by beginTransaction().
+ * \param[in]
+ *   devId - the device id of servo that we want to read from.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::sendRequestFrame(smartServoHandle handle,uint8_t devId,uint8_t cmd)
+{
+  servo_frame_type frame;
+  beginFrame(&frame,devId,SMART_SERVO);
+  frameAddRaw(&frame,cmd);
+  frameAddRaw(&frame,0x00);
+  sendTransactionFrame(handle,&frame);
+}
+
+/**
+ * \par Function
+ *   beginFrame
+ * \par Description
+ *   Starts a new frame with START_SYSEX, device id and service id.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   srv_id - the service id of the frame.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::beginFrame(servo_frame_type *frame,uint8_t dev_id,uint8_t srv_id)
+{
+  frame->data[0] = START_SYSEX;
+  frame->data[1] = dev_id;
+  frame->data[2] = srv_id;
+  frame->length = 3;
+  frame->checksum = dev_id + srv_id;
+}
+
+/**
+ * \par Function
+ *   frameAddRaw
+ * \par Description
+ *   Appends a byte which is already 7bit (command, mode, ...) to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the byte to append.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::frameAddRaw(servo_frame_type *frame,uint8_t val)
+{
+  frame->data[frame->length++] = val;
+  frame->checksum += val;
+}
+
+/**
+ * \par Function
+ *   frameAddByte
+ * \par Description
+ *   Appends (1byte 8bit) data as 2byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the byte data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::frameAddByte(servo_frame_type *frame,uint8_t val)
+{
+  frame->checksum += encode7bit<uint8_t>(val,&frame->data[frame->length]);
+  frame->length += 2;
+}
+
+/**
+ * \par Function
+ *   frameAddShort
+ * \par Description
+ *   Appends (2byte short) data as 2byte or 3byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the short data to be converted.
+ * \param[in]
+ *   ignore_high - is there have third byte high-level data.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::frameAddShort(servo_frame_type *frame,int16_t val,bool ignore_high)
+{
+  uint8_t count = (ignore_high == false) ? 3 : 2;
+  frame->checksum += encode7bit<int16_t>(val,&frame->data[frame->length],count);
+  frame->length += count;
+}
+
+/**
+ * \par Function
+ *   frameAddFloat
+ * \par Description
+ *   Appends (4byte float) data as 5byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the float data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::frameAddFloat(servo_frame_type *frame,float val)
+{
+  frame->checksum += encode7bit<float>(val,&frame->data[frame->length]);
+  frame->length += 5;
+}
+
+/**
+ * \par Function
+ *   frameAddLong
+ * \par Description
+ *   Appends (4byte long) data as 5byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the long data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::frameAddLong(servo_frame_type *frame,long val)
+{
+  frame->checksum += encode7bit<int32_t>(val,&frame->data[frame->length]);
+  frame->length += 5;
+}
+
+/**
+ * \par Function
+ *   sendTransactionFrame
+ * \par Description
+ *   Sends the frame of a transaction and keeps a copy of it for retries.
+ * \param[in]
+ *   handle - the handle returned by beginTransaction().
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::sendTransactionFrame(smartServoHandle handle,servo_frame_type *frame)
+{
+  servo_transaction_type *trans;
+  finishFrame(frame);
+  lock();
+  trans = &transactions[handle & 0xff];
+  if((handle >= 0) && (trans->generation == (uint8_t)(handle >> 8)))
+  {
+    trans->frame = *frame;
+    trans->retries = 0;
+    // The round trip time starts when the frame is written, not when the slot was reserved
+    trans->issueTime = millis();
+    trans->startTime = trans->issueTime;
+    countLinkEvent(trans->dev_id,LINK_EVENT_SENT);
+  }
+  unlock();
+  writeFrame(frame);
+}
+
+/**
+ * \par Function
+ *   finishFrame
+ * \par Description
+ *   Appends checksum and END_SYSEX to a frame.
+ * \param[in]
+ *   *frame - the frame to be finished.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::finishFrame(servo_frame_type *frame)
+{
+  frame->data[frame->length++] = frame->checksum & 0x7f;
+  frame->data[frame->length++] = END_SYSEX;
+}
+
+/**
+ * \par Function
+ *   countLinkEvent
+ * \par Description
+ *   Counts a sent frame, a retry or a failed transaction for the device it belongs to (every device for ALL_DEVICE).
+ * \param[in]
+ *   dev_id - the device id the frame was sent to.
+ * \param[in]
+ *   event - LINK_EVENT_SENT, LINK_EVENT_RETRY or LINK_EVENT_TIMEOUT.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::countLinkEvent(uint8_t dev_id,uint8_t event)
+{
+  uint8_t i;
+  uint8_t first = dev_id;
+  uint8_t last = dev_id;
+  if(dev_id == ALL_DEVICE)
+  {
+    first = 1;
+    last = (servo_num_max < maxDevices) ? servo_num_max : maxDevices;
+  }
+  for(i = first; (i >= 1) && (i <= last) && (i <= maxDevices); i++)
+  {
+    switch(event)
+    {
+      case LINK_EVENT_SENT:
+        devices[i - 1].linkStats.sent++;
+        break;
+      case LINK_EVENT_RETRY:
+        devices[i - 1].linkStats.retries++;
+        break;
+      case LINK_EVENT_TIMEOUT:
+        devices[i - 1].linkStats.timeouts++;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \par Function
+ *   updateRoundTripTime
+ * \par Description
+ *   Adds a round trip time sample to the smoothed round trip time and its deviation and
+ *   sets the timeout of the device to srtt + 4 * rttvar.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   rtt - time in ms between sending the frame and receiving the response.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Same estimator as TCP (RFC 6298), srtt is stored in 1/8 ms and rttvar in 1/4 ms.
+ */
+void MakeblockSmartServoBase::updateRoundTripTime(uint8_t devId,unsigned long rtt)
+{
+  long delta;
+  long timeout;
+  uint8_t idx;
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return;
+  }
+  idx = devId - 1;
+  if(rtt > SMART_SERVO_CMD_TIMEOUT)
+  {
+    rtt = SMART_SERVO_CMD_TIMEOUT;
+  }
+  if(devices[idx].linkStats.timeout == 0)
+  {
+    // First sample: srtt = rtt, rttvar = rtt / 2
+    devices[idx].rttAvg8 = rtt << 3;
+    devices[idx].rttVar4 = rtt << 1;
+  }
+  else
+  {
+    // srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4
+    delta = (long)rtt - (devices[idx].rttAvg8 >> 3);
+    devices[idx].rttAvg8 += delta;
+    if(delta < 0)
+    {
+      delta = -delta;
+    }
+    devices[idx].rttVar4 += delta - (devices[idx].rttVar4 >> 2);
+  }
+  timeout = (devices[idx].rttAvg8 >> 3) + devices[idx].rttVar4;
+  if(timeout < SMART_SERVO_MIN_TIMEOUT)
+  {
+    timeout = SMART_SERVO_MIN_TIMEOUT;
+  }
+  if(timeout > SMART_SERVO_CMD_TIMEOUT)
+  {
+    timeout = SMART_SERVO_CMD_TIMEOUT;
+  }
+  devices[idx].linkStats.srtt = devices[idx].rttAvg8 >> 3;
+  devices[idx].linkStats.rttvar = devices[idx].rttVar4 >> 2;
+  devices[idx].linkStats.timeout = timeout;
+}
+
+/**
+ * \par Function
+ *   transactionTimeout
+ * \par Description
+ *   Returns the time a transaction waits for its response before the frame is sent again.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   timeout in ms, doubled for every retry and limited to SMART_SERVO_CMD_TIMEOUT.
+ * \par Others
+ *   ALL_DEVICE transactions use the longest timeout of all devices.
+ */
+unsigned long MakeblockSmartServoBase::transactionTimeout(const servo_transaction_type *trans)
+{
+  uint8_t i;
+  unsigned long timeout = 0;
+  if((trans->dev_id >= 1) && (trans->dev_id <= maxDevices))
+  {
+    timeout = devices[trans->dev_id - 1].linkStats.timeout;
+  }
+  else if((trans->dev_id == ALL_DEVICE) && (servo_num_max > 0))
+  {
+    for(i = 0; (i < servo_num_max) && (i < maxDevices); i++)
+    {
+      if(devices[i].linkStats.timeout == 0)
+      {
+        timeout = 0;
+        break;
+      }
+      if(devices[i].linkStats.timeout > timeout)
+      {
+        timeout = devices[i].linkStats.timeout;
+      }
+    }
+  }
+  // No round trip time measured yet
+  if(timeout == 0)
+  {
+    return SMART_SERVO_CMD_TIMEOUT;
+  }
+  timeout <<= trans->retries;
+  return (timeout > SMART_SERVO_CMD_TIMEOUT) ? SMART_SERVO_CMD_TIMEOUT : timeout;
+}
+
+/**
+ * \par Function
+ *   writeFrame
+ * \par Description
+ *   Counts a finished frame and writes it to the port with one write call.
+ * \param[in]
+ *   *frame - the frame to be written.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::writeFrame(const servo_frame_type *frame)
+{
+  uint8_t idx = serviceIndex(frame->data[2]);
+  lock();
+  busStats.framesSent++;
+  if(idx < SMART_SERVO_STAT_SERVICES)
+  {
+    serviceStats[idx].sent++;
+  }
+  unlock();
+  captureBytes(frame->data,frame->length,SERVO_CAPTURE_TX);
+  // One call instead of one per byte: the UART driver is locked and the TX FIFO filled only once per frame
+  port->write(frame->data,frame->length);
+}
+
+/**
+ * \par Function
+ *   serviceIndex
+ * \par Description
+ *   Returns the index of a service id in the service statistics.
+ * \param[in]
+ *   srv_id - the service id.
+ * \par Output
+ *   None
+ * \return
+ *   index, SMART_SERVO_STAT_SERVICES for a service id without statistics.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::serviceIndex(uint8_t srv_id)
+{
+  if((srv_id >= CTL_ASSIGN_DEV_ID) && (srv_id <= CTL_ERROR_CODE))
+  {
+    return srv_id - CTL_ASSIGN_DEV_ID;
+  }
+  if(srv_id == SMART_SERVO)
+  {
+    return SMART_SERVO_STAT_SERVICES - 1;
+  }
+  return SMART_SERVO_STAT_SERVICES;
+}
+
+/**
+ * \par Function
+ *   latencyBucket
+ * \par Description
+ *   Returns the histogram bucket of a latency.
+ * \param[in]
+ *   latency - time in ms.
+ * \par Output
+ *   None
+ * \return
+ *   index of the bucket.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::latencyBucket(unsigned long latency)
+{
+  uint8_t i;
+  for(i = 0; i < SMART_SERVO_LATENCY_BUCKETS - 1; i++)
+  {
+    if(latency <= getLatencyBucketLimit(i))
+    {
+      break;
+    }
+  }
+  return i;
+}
+
+/**
+ * \par Function
+ *   printHistogram
+ * \par Description
+ *   Prints the counts of a latency histogram separated by '/'.
+ * \param[in]
+ *   out - where the text is printed to.
+ * \param[in]
+ *   *latency - the histogram.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::printHistogram(Print &out,const uint32_t *latency)
+{
+  uint8_t i;
+  for(i = 0; i < SMART_SERVO_LATENCY_BUCKETS; i++)
+  {
+    if(i > 0)
+    {
+      out.print('/');
+    }
+    out.print(latency[i]);
+  }
+}
+
+/**
+ * \par Function
+ *   sendFrame
+ * \par Description
+ *   Appends checksum and END_SYSEX and writes the whole frame to the port with one write call.
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::sendFrame(servo_frame_type *frame)
+{
+  finishFrame(frame);
+  writeFrame(frame);
+}
+
+/**
+ * \par Function
+ *   sendStreamFrame
+ * \par Description
+ *   Writes a frame without transaction and counts the acknowledge it will cause.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::sendStreamFrame(uint8_t dev_id,servo_frame_type *frame)
+{
+  uint8_t i;
+  uint8_t first = dev_id;
+  uint8_t last = dev_id;
+  if(dev_id == ALL_DEVICE)
+  {
+    first = 1;
+    last = (servo_num_max < maxDevices) ? servo_num_max : maxDevices;
+  }
+  finishFrame(frame);
+  lock();
+  busStats.streamFrames++;
+  countLinkEvent(dev_id,LINK_EVENT_SENT);
+  for(i = first; (i >= 1) && (i <= last) && (i <= maxDevices); i++)
+  {
+    // Bounded, so acknowledges which never arrive do not hide unmatched responses for long
+    if(devices[i - 1].streamAcks < SMART_SERVO_MAX_PENDING)
+    {
+      devices[i - 1].streamAcks++;
+    }
+    devices[i - 1].streamOrder = transactionOrder;
+    devices[i - 1].streamTime = millis();
+  }
+  unlock();
+  writeFrame(frame);
+}
+
+
+/**
+ * \par Function
+ *   getResponseSeq
+ * \par Description
+ *   Returns a counter which is incremented every time a value of the given field is received from a device.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   Sequence number of the last received value, 0 if nothing was received yet.
+ * \par Others
+ *   None
+ */
+uint16_t MakeblockSmartServoBase::getResponseSeq(uint8_t devId,uint8_t field)
+{
+  if((devId < 1) || (devId > maxDevices) || (field >= SERVO_FIELD_COUNT))
+  {
+    return 0;
+  }
+  return devices[devId - 1].responseSeq[field];
+}
+
+/**
+ * \par Function
+ *   processReceivedBytes
+ * \par Description
+ *   Reads all available bytes from the port and processes complete sysex messages.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Has to be called with the lock held.
+ */
+void MakeblockSmartServoBase::processReceivedBytes(void)
+{
+  while (port->available())
+  {
+    // get the new byte:
+    uint8_t inputData = port->read();
+    captureBytes(&inputData,1,SERVO_CAPTURE_RX);
+    if(inputData == START_SYSEX)
+    {
+      // The end of the previous message got lost, resync on this one instead of reading it as payload
+      if(parsingSysex)
+      {
+        dropSysexMessage(false);
+      }
+      parsingSysex = true;
+      sysexBytesRead = 0;
+    }
+    else if(parsingSysex)
+    {
+      if (inputData == END_SYSEX)
+      {
+        //stop sysex byte
+        parsingSysex = false;
+        //fire off handler function if the message is intact
+        if(isSysexMessageValid() == true)
+        {
+          processSysexMessage();
+        }
+        else
+        {
+          dropSysexMessage(true);
+        }
+      }
+      else if((inputData & 0x80) && ((sysexBytesRead > 0) || (inputData != ALL_DEVICE)))
+      {
+        // Apart from START_SYSEX, END_SYSEX and the ALL_DEVICE id everything is 7bit
+        dropSysexMessage(false);
+        parsingSysex = false;
+      }
+      else
+      {
+        //normal data byte - add to buffer
+        sysex.storedInputData[sysexBytesRead] = inputData;
+        sysexBytesRead++;
+        if(sysexBytesRead > DEFAULT_UART_BUF_SIZE-1)
+        {
+          busStats.overflows++;
+          parsingSysex = false;
+          sysexBytesRead = 0;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * \par Function
+ *   isSysexMessageValid
+ * \par Description
+ *   Checks the length and the 7bit checksum of the received sysex message.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   true if the checksum matches the sum of device id, service id and payload.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::isSysexMessageValid(void)
+{
+  uint8_t checksum = 0;
+  int16_t i;
+  // device id, service id and checksum at least
+  if(sysexBytesRead < 3)
+  {
+    return false;
+  }
+  for(i = 0; i < sysexBytesRead - 1; i++)
+  {
+    checksum += sysex.storedInputData[i];
+  }
+  return ((checksum & 0x7f) == sysex.storedInputData[sysexBytesRead - 1]);
+}
+
+/**
+ * \par Function
+ *   dropSysexMessage
+ * \par Description
+ *   Counts a dropped sysex message and sends the oldest pending request of the device it came from again,
+ *   instead of waiting for its timeout.
+ * \param[in]
+ *   checksumError - true for a checksum error, false for a broken frame (start byte or invalid byte inside the frame).
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   The device id of a broken frame is only a guess, a wrong guess costs one duplicate request.
+ *   Has to be called with the lock held.
+ */
+void MakeblockSmartServoBase::dropSysexMessage(bool checksumError)
+{
+  uint8_t i;
+  uint8_t devId = sysex.val.dev_id;
+  servo_transaction_type *oldest = NULL;
+  if(checksumError == true)
+  {
+    busStats.checksumErrors++;
+  }
+  else
+  {
+    busStats.framingErrors++;
+  }
+  if((sysexBytesRead < 1) || (devId < 1) || (devId > maxDevices))
+  {
+    return;
+  }
+  for(i = 0; i < SMART_SERVO_MAX_PENDING; i++)
+  {
+    if((transactions[i].state != TRANSACTION_PENDING) || (transactions[i].dev_id != devId))
+    {
+      continue;
+    }
+    if((oldest == NULL) || ((int16_t)(transactions[i].order - oldest->order) < 0))
+    {
+      oldest = &transactions[i];
+    }
+  }
+  if(oldest != NULL)
+  {
+    retryTransaction(oldest);
+  }
+}
+
+/**
+ * \par Function
+ *   retryTransaction
+ * \par Description
+ *   Sends the frame of a pending transaction again if it has retries left.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent again.
+ * \par Others
+ *   Relative moves are never sent again.
+ */
+bool MakeblockSmartServoBase::retryTransaction(servo_transaction_type *trans)
+{
+  // A relative move is not repeated, the servo might have executed it and only the acknowledge got lost
+  if((trans->retries >= maxRetries) || (trans->frame.length == 0) || (trans->cmd == SET_SERVO_RELATIVE_ANGLE_LONG))
+  {
+    return false;
+  }
+  trans->retries++;
+  trans->startTime = millis();
+  countLinkEvent(trans->dev_id,LINK_EVENT_RETRY);
+  countLinkEvent(trans->dev_id,LINK_EVENT_SENT);
+  writeFrame(&trans->frame);
+  return true;
+}
+
+/**
+ * \par Function
+ *   waitForResponse
+ * \par Description
+ *   Called by waiting loops. Blocks until the receive task processed a response (at most one tick),
+ *   does nothing if there is no receive task.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::waitForResponse(void)
+{
+#ifdef ESP32
+  if((rxTaskHandle != NULL) && (xTaskGetCurrentTaskHandle() != rxTaskHandle))
+  {
+    xSemaphoreTake(responseEvent,1);
+  }
+#endif
+}
+
+/**
+ * \par Function
+ *   lock
+ * \par Description
+ *   Locks the receive state and the transaction table against the receive task. Recursive.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::lock(void)
+{
+#ifdef ESP32
+  if(busLock != NULL)
+  {
+    xSemaphoreTakeRecursive(busLock,portMAX_DELAY);
+  }
+#endif
+}
+
+/**
+ * \par Function
+ *   unlock
+ * \par Description
+ *   Releases the lock taken with lock().
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::unlock(void)
+{
+#ifdef ESP32
+  if(busLock != NULL)
+  {
+    xSemaphoreGiveRecursive(busLock);
+  }
+#endif
+}
+
+/**
+ * \par Function
+ *   setBaudRate
+ * \par Description
+ *   Tells a smart servo to switch its bus to another baud rate.
+ * \param[in]
+ *   dev_id - the device id of servo (ALL_DEVICE for all servos).
+ * \param[in]
+ *   baudRate - the new baud rate.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Returns after the frame has been sent completely.
+ */
+void MakeblockSmartServoBase::setBaudRate(uint8_t dev_id,long baudRate)
+{
+  servo_frame_type frame;
+  beginFrame(&frame,dev_id,CTL_SET_BAUD_RATE);
+  frameAddLong(&frame,baudRate);
+  sendFrame(&frame);
+  // The servo switches right after the frame, so it must be out before the port is switched
+  port->flush();
+}
+
+/**
+ * \par Function
+ *   getNumDevices
+ * \par Description
+ *   Returns the highest device id enumerated by assignDevIdRequest(), including devices which are not
+ *   joints of the robot (e.g. the smart servo of a gripper).
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of devices on the bus.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::getNumDevices(void)
+{
+  return servo_num_max;
+}
+
+/**
+ * \par Function
+ *   setCacheTTL
+ * \par Description
+ *   Sets how long a received value of a field is used by the get*Request functions before a new request is sent.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \param[in]
+ *   ttl - time in ms a value stays fresh, 0 requests the value on every call.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::setCacheTTL(uint8_t field,uint16_t ttl)
+{
+  if(field < SERVO_FIELD_COUNT)
+  {
+    cacheTTL[field] = ttl;
+  }
+}
+
+/**
+ * \par Function
+ *   getCacheTTL
+ * \par Description
+ *   Returns how long a received value of a field is used before a new request is sent.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   time in ms a value stays fresh.
+ * \par Others
+ *   None
+ */
+uint16_t MakeblockSmartServoBase::getCacheTTL(uint8_t field)
+{
+  if(field >= SERVO_FIELD_COUNT)
+  {
+    return 0;
+  }
+  return cacheTTL[field];
+}
+
+/**
+ * \par Function
+ *   isCacheFresh
+ * \par Description
+ *   Checks if the stored value of a field was received within its cache time.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   true if the value can be used without a new request.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::isCacheFresh(uint8_t devId,uint8_t field)
+{
+  if((devId < 1) || (devId > maxDevices) || (field >= SERVO_FIELD_COUNT))
+  {
+    return false;
+  }
+  if((cacheTTL[field] == 0) || (devices[devId - 1].responseSeq[field] == 0))
+  {
+    return false;
+  }
+  return (millis() - devices[devId - 1].responseTime[field] < cacheTTL[field]);
+}
+
+/**
+ * \par Function
+ *   setMaxRetries
+ * \par Description
+ *   Sets how often a frame without response is sent again before its transaction fails.
+ * \param[in]
+ *   retries - number of retries, 0 gives a transaction up after the first timeout.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Relative moves are never sent again, the servo might have executed the lost frame already.
+ */
+void MakeblockSmartServoBase::setMaxRetries(uint8_t retries)
+{
+  maxRetries = retries;
+}
+
+/**
+ * \par Function
+ *   getMaxRetries
+ * \par Description
+ *   Returns how often a frame without response is sent again before its transaction fails.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of retries.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::getMaxRetries(void)
+{
+  return maxRetries;
+}
+
+/**
+ * \par Function
+ *   getLinkStats
+ * \par Description
+ *   Returns the frame counters and the measured round trip time of a device.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   counters, smoothed round trip time, its deviation and the current timeout in ms.
+ * \par Others
+ *   The timeout is SMART_SERVO_CMD_TIMEOUT until the first response of the device was received.
+ */
+servo_link_stats_type MakeblockSmartServoBase::getLinkStats(uint8_t devId)
+{
+  servo_link_stats_type stats = {};
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return stats;
+  }
+  lock();
+  stats = devices[devId - 1].linkStats;
+  unlock();
+  if(stats.timeout == 0)
+  {
+    stats.timeout = SMART_SERVO_CMD_TIMEOUT;
+  }
+  return stats;
+}
+
+/**
+ * \par Function
+ *   resetLinkStats
+ * \par Description
+ *   Clears the frame counters and the measured round trip time of a device.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::resetLinkStats(uint8_t devId)
+{
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return;
+  }
+  lock();
+  memset(&devices[devId - 1].linkStats,0,sizeof(servo_link_stats_type));
+  devices[devId - 1].rttAvg8 = 0;
+  devices[devId - 1].rttVar4 = 0;
+  unlock();
+}
+
+/**
+ * \par Function
+ *   getBusStats
+ * \par Description
+ *   Returns the counters of the whole bus.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   frames sent and received, dropped frames and responses without a pending transaction.
+ * \par Others
+ *   None
+ */
+servo_bus_stats_type MakeblockSmartServoBase::getBusStats(void)
+{
+  servo_bus_stats_type stats;
+  lock();
+  stats = busStats;
+  unlock();
+  return stats;
+}
+
+/**
+ * \par Function
+ *   getServiceStats
+ * \par Description
+ *   Returns the frame counters and the latency histogram of a service id.
+ * \param[in]
+ *   srv_id - the service id, e.g. SMART_SERVO or CTL_ERROR_CODE.
+ * \par Output
+ *   None
+ * \return
+ *   counters of the service, all zero for an unknown service id.
+ * \par Others
+ *   Latencies are counted for the service the response arrives with: SMART_SERVO for read requests,
+ *   CTL_ERROR_CODE for the acknowledges of commands.
+ */
+servo_service_stats_type MakeblockSmartServoBase::getServiceStats(uint8_t srv_id)
+{
+  servo_service_stats_type stats = {};
+  uint8_t idx = serviceIndex(srv_id);
+  if(idx < SMART_SERVO_STAT_SERVICES)
+  {
+    lock();
+    stats = serviceStats[idx];
+    unlock();
+  }
+  return stats;
+}
+
+/**
+ * \par Function
+ *   resetBusStats
+ * \par Description
+ *   Clears the bus, service and link statistics of all devices.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::resetBusStats(void)
+{
+  uint8_t i;
+  lock();
+  memset(&busStats,0,sizeof(busStats));
+  memset(serviceStats,0,sizeof(serviceStats));
+  for(i = 1; i <= maxDevices; i++)
+  {
+    resetLinkStats(i);
+  }
+  unlock();
+}
+
+/**
+ * \par Function
+ *   getLatencyBucketLimit
+ * \par Description
+ *   Returns the upper limit of a bucket of the latency histograms.
+ * \param[in]
+ *   bucket - index of the bucket, 0 to SMART_SERVO_LATENCY_BUCKETS - 1.
+ * \par Output
+ *   None
+ * \return
+ *   latency in ms counted up to this bucket, 0xFFFF for the last bucket.
+ * \par Others
+ *   None
+ */
+uint16_t MakeblockSmartServoBase::getLatencyBucketLimit(uint8_t bucket)
+{
+  static const uint16_t limits[SMART_SERVO_LATENCY_BUCKETS] = {1, 2, 5, 10, 20, 50, 200, 0xFFFF};
+  if(bucket >= SMART_SERVO_LATENCY_BUCKETS)
+  {
+    return 0xFFFF;
+  }
+  return limits[bucket];
+}
+
+/**
+ * \par Function
+ *   printBusStats
+ * \par Description
+ *   Prints the bus counters, the link statistics of every device and the statistics of every used service.
+ * \param[in]
+ *   out - where the text is printed to, e.g. Serial.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   One line per device and service, the latency histogram is printed as counts per bucket separated by '/'.
+ */
+void MakeblockSmartServoBase::printBusStats(Print &out)
+{
+  static const uint8_t services[SMART_SERVO_STAT_SERVICES] = {CTL_ASSIGN_DEV_ID, CTL_SYSTEM_RESET, CTL_READ_DEV_VERSION,
+    CTL_SET_BAUD_RATE, CTL_CMD_TEST, CTL_ERROR_CODE, SMART_SERVO};
+  servo_bus_stats_type bus = getBusStats();
+  servo_link_stats_type link;
+  servo_service_stats_type service;
+  uint8_t i;
+  out.print(F("bus: sent "));
+  out.print(bus.framesSent);
+  out.print(F(" received "));
+  out.print(bus.framesReceived);
+  out.print(F(" overflows "));
+  out.print(bus.overflows);
+  out.print(F(" checksum errors "));
+  out.print(bus.checksumErrors);
+  out.print(F(" framing errors "));
+  out.print(bus.framingErrors);
+  out.print(F(" unmatched "));
+  out.print(bus.unmatched);
+  out.print(F(" streamed "));
+  out.print(bus.streamFrames);
+  out.print(F(" acknowledged "));
+  out.println(bus.streamAcks);
+  out.print(F("latency buckets [ms]:"));
+  for(i = 0; i < SMART_SERVO_LATENCY_BUCKETS - 1; i++)
+  {
+    out.print(F(" <="));
+    out.print(getLatencyBucketLimit(i));
+  }
+  out.print(F(" >"));
+  out.println(getLatencyBucketLimit(SMART_SERVO_LATENCY_BUCKETS - 2));
+  for(i = 1; (i <= servo_num_max) && (i <= maxDevices); i++)
+  {
+    link = getLinkStats(i);
+    out.print(F("dev "));
+    out.print(i);
+    out.print(F(": sent "));
+    out.print(link.sent);
+    out.print(F(" responses "));
+    out.print(link.responses);
+    out.print(F(" retries "));
+    out.print(link.retries);
+    out.print(F(" timeouts "));
+    out.print(link.timeouts);
+    out.print(F(" srtt "));
+    out.print(link.srtt);
+    out.print(F(" rttvar "));
+    out.print(link.rttvar);
+    out.print(F(" timeout "));
+    out.print(link.timeout);
+    out.print(F(" latency "));
+    printHistogram(out,link.latency);
+    out.println();
+  }
+  for(i = 0; i < SMART_SERVO_STAT_SERVICES; i++)
+  {
+    service = getServiceStats(services[i]);
+    if((service.sent == 0) && (service.received == 0))
+    {
+      continue;
+    }
+    out.print(F("srv 0x"));
+    out.print(services[i],HEX);
+    out.print(F(": sent "));
+    out.print(service.sent);
+    out.print(F(" received "));
+    out.print(service.received);
+    out.print(F(" latency "));
+    printHistogram(out,service.latency);
+    out.println();
+  }
+}
+
+/**
+ * \par Function
+ *   getMoveState
+ * \par Description
+ *   Returns if a device is moving.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   MOVE_STATE_IDLE, MOVE_STATE_MOVING or MOVE_STATE_UNTRACKED.
+ * \par Others
+ *   None
+ */
+uint8_t MakeblockSmartServoBase::getMoveState(uint8_t devId)
+{
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return MOVE_STATE_IDLE;
+  }
+  return devices[devId - 1].moveState;
+}
+
+/**
+ * \par Function
+ *   reportsPositionReached
+ * \par Description
+ *   Returns if the firmware of a device sends REPORT_WHEN_REACH_THE_SET_POSITION messages.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if at least one report was received from the device.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::reportsPositionReached(uint8_t devId)
+{
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return false;
+  }
+  return devices[devId - 1].positionReports;
+}
+
+/**
+ * \par Function
+ *   setPositionReached
+ * \par Description
+ *   Marks the move of a device as finished, e.g. after polling found that the servo does not move any more.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::setPositionReached(uint8_t devId)
+{
+  setMoveState(devId,MOVE_STATE_IDLE);
+}
+
+/**
+ * \par Function
+ *   waitForPositionReached
+ * \par Description
+ *   Waits until none of the given devices is in MOVE_STATE_MOVING any more.
+ * \param[in]
+ *   *devIds - the device ids of the servos.
+ * \param[in]
+ *   count - number of device ids.
+ * \param[in]
+ *   timeout - maximum time to wait in ms.
+ * \par Output
+ *   None
+ * \return
+ *   true if all devices reported that they reached their position, false on timeout.
+ * \par Others
+ *   Devices in MOVE_STATE_UNTRACKED are not waited for.
+ */
+bool MakeblockSmartServoBase::waitForPositionReached(const uint8_t *devIds,uint8_t count,unsigned long timeout)
+{
+  uint8_t i;
+  bool moving;
+  unsigned long startTime = millis();
+  while(true)
+  {
+    smartServoEventHandle();
+    moving = false;
+    for(i = 0; i < count; i++)
+    {
+      // A lost arrival report does not keep the move running until the timeout
+      if((isReportOverdue(devIds[i]) == true) && (pollPositionReached(devIds[i]) == true))
+      {
+        continue;
+      }
+      if(getMoveState(devIds[i]) == MOVE_STATE_MOVING)
+      {
+        moving = true;
+      }
+    }
+    if(moving == false)
+    {
+      return true;
+    }
+    if(millis() - startTime > timeout)
+    {
+      return false;
+    }
+    waitForResponse();
+  }
+}
+
+/**
+ * \par Function
+ *   isReportOverdue
+ * \par Description
+ *   Returns if the arrival report of the current move of a device should have arrived already.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if the device is in MOVE_STATE_MOVING after its report deadline.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::isReportOverdue(uint8_t devId)
+{
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return false;
+  }
+  if(devices[devId - 1].moveState != MOVE_STATE_MOVING)
+  {
+    return false;
+  }
+  return (long)(millis() - devices[devId - 1].reportDeadline) >= 0;
+}
+
+/**
+ * \par Function
+ *   pollPositionReached
+ * \par Description
+ *   Checks a move whose arrival report is overdue by comparing two angle readings.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if the device is not in MOVE_STATE_MOVING any more.
+ * \par Others
+ *   Until the next reading is due the angle is not read again.
+ */
+bool MakeblockSmartServoBase::pollPositionReached(uint8_t devId)
+{
+  smartServoHandle handle;
+  servo_device_state_type *device;
+  long angle;
+  if(isReportOverdue(devId) == false)
+  {
+    return getMoveState(devId) != MOVE_STATE_MOVING;
+  }
+  device = &devices[devId - 1];
+  handle = requestAsync(devId,GET_SERVO_CUR_ANGLE);
+  if((handle == SMART_SERVO_INVALID_HANDLE) || (waitFor(handle) == false))
+  {
+    device->reportPollValid = false;
+    device->reportDeadline = millis() + SMART_SERVO_REPORT_POLL;
+    return false;
+  }
+  angle = device->values.angleValue;
+  // The report may have arrived while the angle was read
+  if(device->moveState != MOVE_STATE_MOVING)
+  {
+    return true;
+  }
+  if((device->reportPollValid == true) && (angle == device->reportPollAngle))
+  {
+    device->moveState = MOVE_STATE_IDLE;
+    device->reportPollValid = false;
+    return true;
+  }
+  device->reportPollAngle = angle;
+  device->reportPollValid = true;
+  device->reportDeadline = millis() + SMART_SERVO_REPORT_POLL;
+  return false;
+}
+
+/**
+ * \par Function
+ *   setMoveState
+ * \par Description
+ *   Sets the move state of a device (or of all devices for ALL_DEVICE) before a move command is sent.
+ * \param[in]
+ *   dev_id - the device id of servo.
+ * \param[in]
+ *   state - MOVE_STATE_IDLE, MOVE_STATE_MOVING or MOVE_STATE_UNTRACKED.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::setMoveState(uint8_t dev_id,uint8_t state)
+{
+  uint8_t i;
+  if(dev_id == ALL_DEVICE)
+  {
+    for(i = 0; i < maxDevices; i++)
+    {
+      devices[i].moveState = state;
+    }
+  }
+  else if((dev_id >= 1) && (dev_id <= maxDevices))
+  {
+    devices[dev_id - 1].moveState = state;
+  }
+}
+
+/**
+ * \par Function
+ *   setReportDeadline
+ * \par Description
+ *   Sets the time by which the arrival report of an angle move is expected.
+ * \param[in]
+ *   dev_id - the device id of servo, ALL_DEVICE for all devices.
+ * \param[in]
+ *   angle_value - the angle of the move.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   absolute - true if angle_value is an absolute angle, false if it is relative.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::setReportDeadline(uint8_t dev_id,long angle_value,float speed,bool absolute)
+{
+  uint8_t i;
+  long travel;
+  unsigned long timeout;
+  if(speed < 1)
+  {
+    speed = 1;
+  }
+  for(i = 0; i < maxDevices; i++)
+  {
+    if((dev_id != ALL_DEVICE) && (dev_id != i + 1))
+    {
+      continue;
+    }
+    travel = angle_value;
+    if(absolute == true)
+    {
+      travel = (devices[i].responseSeq[SERVO_FIELD_ANGLE] != 0) ? angle_value - devices[i].values.angleValue : SMART_SERVO_UNKNOWN_TRAVEL;
+    }
+    if(travel < 0)
+    {
+      travel = -travel;
+    }
+    timeout = (devices[i].linkStats.timeout != 0) ? devices[i].linkStats.timeout : SMART_SERVO_CMD_TIMEOUT;
+    // speed in rpm is 6 * speed degree per second
+    devices[i].reportDeadline = millis() + (unsigned long)(travel * 1000 / (6 * speed)) + timeout + SMART_SERVO_REPORT_SLACK;
+    devices[i].reportPollValid = false;
+  }
+}
+
+/**
+ * \par Function
+ *   setPid
+ * \par Description
+ *   set the gains of the position controller of smart servo.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to set.
+ * \param[in]
+ *   p - proportional gain.
+ * \param[in]
+ *   i - integral gain.
+ * \param[in]
+ *   d - derivative gain.
+ * \par Output
+ *   None
+ * \return
+ *   If the assignment is successful, return true.
+ * \par Others
+ *   The gains are sent as three floats in the order P, I, D, like GET_SERVO_PID reports them.
+ */
+bool MakeblockSmartServoBase::setPid(uint8_t dev_id,float p,float i,float d)
+{
+  servo_frame_type frame;
+  smartServoHandle handle;
+  if((dev_id > servo_num_max) && (dev_id != ALL_DEVICE))
+  {
+    return false;
+  }
+  handle = beginTransaction(dev_id,CTL_ERROR_CODE,SET_SERVO_PID,NULL);
+  beginFrame(&frame,dev_id,SMART_SERVO);
+  frameAddRaw(&frame,SET_SERVO_PID);
+  frameAddFloat(&frame,p);
+  frameAddFloat(&frame,i);
+  frameAddFloat(&frame,d);
+  sendTransactionFrame(handle,&frame);
+  return waitFor(handle);
+}
+
+/**
+ * \par Function
+ *   getPidRequest
+ * \par Description
+ *   This function used to get the gains of the position controller of smart servo.
+ * \param[in]
+ *   devId - the device id of servo that we want to read its gains.
+ * \param[in]
+ *   *pid - the gains are written to it if the servo answered.
+ * \par Output
+ *   None
+ * \return
+ *   true if the servo answered.
+ * \par Others
+ *   None
+ */
+bool MakeblockSmartServoBase::getPidRequest(uint8_t devId,servo_pid_type *pid)
+{
+  if((devId < 1) || (devId > maxDevices) || (devId > servo_num_max))
+  {
+    return false;
+  }
+  if(waitFor(requestAsync(devId,GET_SERVO_PID)) == false)
+  {
+    return false;
+  }
+  lock();
+  *pid = devices[devId - 1].pid;
+  unlock();
+  return true;
+}
+
+/**
+ * \par Function
+ *   measureStepResponse
+ * \par Description
+ *   Moves the servo to an angle and samples its angle until it settled, to measure how fast
+ *   and how well damped the position controller reaches the goal.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angle_value - the absolute angle value we want move to.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   *response - the rise time, settle time and overshoot are written to it.
+ * \par Output
+ *   None
+ * \return
+ *   STEP_RESPONSE_SETTLED if the angle settled within SMART_SERVO_TUNE_TIMEOUT, STEP_RESPONSE_UNSETTLED if not,
+ *   STEP_RESPONSE_BUS_ERROR if the start angle could not be read, the move was not acknowledged or
+ *   SMART_SERVO_TUNE_MAX_FAILS angle readings in a row failed.
+ * \par Others
+ *   Blocks until the servo settled. The angle is polled as fast as the bus allows, so the resolution of the
+ *   times is one round trip. The servo has to stand still before.
+ */
+uint8_t MakeblockSmartServoBase::measureStepResponse(uint8_t devId,long angle_value,float speed,servo_step_response_type *response)
+{
+  long startAngle;
+  long step;
+  long angle;
+  long beyond;
+  unsigned long startTime;
+  unsigned long now;
+  unsigned long bandEntry = 0;
+  bool inBand = false;
+  uint8_t fails = 0;
+  response->riseTime = 0;
+  response->settleTime = SMART_SERVO_TUNE_TIMEOUT;
+  response->overshoot = 0;
+  response->settled = false;
+  if((devId < 1) || (devId > maxDevices) || (devId > servo_num_max))
+  {
+    return STEP_RESPONSE_BUS_ERROR;
+  }
+  if(waitFor(requestAsync(devId,GET_SERVO_CUR_ANGLE)) == false)
+  {
+    return STEP_RESPONSE_BUS_ERROR;
+  }
+  startAngle = getDeviceData(devId).angleValue;
+  step = angle_value - startAngle;
+  startTime = millis();
+  if(waitFor(moveToAsync(devId,angle_value,speed)) == false)
+  {
+    return STEP_RESPONSE_BUS_ERROR;
+  }
+  while((now = millis() - startTime) < SMART_SERVO_TUNE_TIMEOUT)
+  {
+    if(waitFor(requestAsync(devId,GET_SERVO_CUR_ANGLE)) == false)
+    {
+      if(++fails >= SMART_SERVO_TUNE_MAX_FAILS)
+      {
+        return STEP_RESPONSE_BUS_ERROR;
+      }
+      continue;
+    }
+    fails = 0;
+    angle = getDeviceData(devId).angleValue;
+    if((response->riseTime == 0) && (labs(angle - startAngle) * 10 >= labs(step) * 9))
+    {
+      response->riseTime = now;
+    }
+    beyond = (step >= 0) ? (angle - angle_value) : (angle_value - angle);
+    if(beyond > response->overshoot)
+    {
+      response->overshoot = beyond;
+    }
+    if(labs(angle - angle_value) > SMART_SERVO_TUNE_TOLERANCE)
+    {
+      inBand = false;
+      continue;
+    }
+    if(inBand == false)
+    {
+      inBand = true;
+      bandEntry = now;
+    }
+    // Servos which report the end of their move are settled once they did, the others once the angle stayed in the band
+    if((now - bandEntry >= SMART_SERVO_TUNE_HOLD) &&
+       ((reportsPositionReached(devId) == false) || (getMoveState(devId) != MOVE_STATE_MOVING)))
+    {
+      response->settleTime = bandEntry;
+      response->settled = true;
+      break;
+    }
+  }
+  if(response->riseTime == 0)
+  {
+    response->riseTime = response->settleTime;
+  }
+  return (response->settled == true) ? STEP_RESPONSE_SETTLED : STEP_RESPONSE_UNSETTLED;
+}
+
+/**
+ * \par Function
+ *   tunePid
+ * \par Description
+ *   Searches the gains of the position controller with the shortest settle time without overshoot.
+ *   The servo is stepped between two angles; every gain is made larger and smaller in turn and a change is
+ *   kept if the worse step of both directions improves. The change is halved every round
+ *   (SMART_SERVO_TUNE_ROUNDS).
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angleA - first angle of the test steps, the servo is moved there first.
+ * \param[in]
+ *   angleB - second angle of the test steps.
+ * \param[in]
+ *   speed - move speed value of the test steps(The unit is rpm).
+ * \param[in]
+ *   *result - the initial and found gains and their step responses are written to it(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if the servo answered all requests, the found gains are written to the servo.
+ * \par Others
+ *   Takes some seconds per trial. The servo has to move freely between both angles with the load it carries
+ *   in operation. If a request or a step response fails with a bus error, the initial gains are written back.
+ */
+bool MakeblockSmartServoBase::tunePid(uint8_t devId,long angleA,long angleB,float speed,servo_pid_tune_type *result)
+{
+  servo_pid_tune_type tune;
+  servo_pid_type trial;
+  servo_step_response_type response;
+  unsigned long bestCost;
+  unsigned long cost;
+  float factor = SMART_SERVO_TUNE_STEP;
+  float *gain;
+  uint8_t round;
+  uint8_t k;
+  int8_t dir;
+  if(getPidRequest(devId,&tune.initial) == false)
+  {
+    return false;
+  }
+  tune.pid = tune.initial;
+  tune.trials = 1;
+  if((measureStepResponse(devId,angleA,speed,&response) == STEP_RESPONSE_BUS_ERROR) ||
+     (measureTuneCost(devId,angleA,angleB,speed,&tune.before,&bestCost) == false))
+  {
+    return false;
+  }
+  tune.after = tune.before;
+  for(round = 0; round < SMART_SERVO_TUNE_ROUNDS; round++)
+  {
+    for(k = 0; k < 3; k++)
+    {
+      for(dir = 1; dir >= -1; dir -= 2)
+      {
+        trial = tune.pid;
+        gain = (k == 0) ? &trial.p : ((k == 1) ? &trial.i : &trial.d);
+        if(*gain <= 0)
+        {
+          // A gain which is off can only be switched on, in relation to the proportional gain
+          if(dir < 0)
+          {
+            continue;
+          }
+          *gain = factor * trial.p;
+        }
+        else
+        {
+          *gain *= 1 + dir * factor;
+        }
+        if(setPid(devId,trial.p,trial.i,trial.d) == false)
+        {
+          setPid(devId,tune.initial.p,tune.initial.i,tune.initial.d);
+          return false;
+        }
+        if(measureTuneCost(devId,angleA,angleB,speed,&response,&cost) == false)
+        {
+          setPid(devId,tune.initial.p,tune.initial.i,tune.initial.d);
+          return false;
+        }
+        tune.trials++;
+        if(cost < bestCost)
+        {
+          bestCost = cost;
+          tune.pid = trial;
+          tune.after = response;
+          break;
+        }
+      }
+    }
+    factor /= 2;
+  }
+  if(result != NULL)
+  {
+    *result = tune;
+  }
+  return setPid(devId,tune.pid.p,tune.pid.i,tune.pid.d);
+}
+
+/**
+ * \par Function
+ *   measureTuneCost
+ * \par Description
+ *   Measures the step responses of the current gains in both directions for tunePid().
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angleA - first angle, the servo stands there.
+ * \param[in]
+ *   angleB - second angle.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   *response - the worse step response of both directions is written to it.
+ * \param[in]
+ *   *cost - cost of the gains is written to it: settle time plus SMART_SERVO_TUNE_OVERSHOOT_COST per degree overshoot.
+ * \par Output
+ *   None
+ * \return
+ *   false if one of both step responses failed with a bus error.
+ * \par Others
+ *   The servo stands at angleA again afterwards.
+ */
+bool MakeblockSmartServoBase::measureTuneCost(uint8_t devId,long angleA,long angleB,float speed,servo_step_response_type *response,unsigned long *cost)
+{
+  servo_step_response_type back;
+  if((measureStepResponse(devId,angleB,speed,response) == STEP_RESPONSE_BUS_ERROR) ||
+     (measureStepResponse(devId,angleA,speed,&back) == STEP_RESPONSE_BUS_ERROR))
+  {
+    return false;
+  }
+  if(stepResponseCost(&back) > stepResponseCost(response))
+  {
+    *response = back;
+  }
+  *cost = stepResponseCost(response);
+  return true;
+}
+
+/**
+ * \par Function
+ *   stepResponseCost
+ * \par Description
+ *   Rates a step response for tunePid().
+ * \param[in]
+ *   *response - the measured step response.
+ * \par Output
+ *   None
+ * \return
+ *   settle time (SMART_SERVO_TUNE_TIMEOUT if not settled) plus SMART_SERVO_TUNE_OVERSHOOT_COST per degree overshoot.
+ * \par Others
+ *   None
+ */
+unsigned long MakeblockSmartServoBase::stepResponseCost(const servo_step_response_type *response)
+{
+  return response->settleTime + (unsigned long)response->overshoot * SMART_SERVO_TUNE_OVERSHOOT_COST;
+}
+
+/**
+ * \par Function
+ *   getStatusRequest
+ * \par Description
+ *   Refreshes angle, speed, voltage, temperature and current of smart servo with one GET_SERVO_STATUS
+ *   round trip. Devices which do not support it are asked with the five single requests instead.
+ * \param[in]
+ *   devId - the device id of servo that we want to read.
+ * \param[in]
+ *   forceRefresh - send requests even if all stored values are fresh(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if all values were received, read them with getDeviceData().
+ * \par Others
+ *   The first call per device finds out if GET_SERVO_STATUS is supported (see getStatusSupport()).
+ */
+bool MakeblockSmartServoBase::getStatusRequest(uint8_t devId,bool forceRefresh)
+{
+  static const uint8_t cmds[SERVO_FIELD_COUNT] = {GET_SERVO_CUR_ANGLE, GET_SERVO_SPEED, GET_SERVO_VOLTAGE, GET_SERVO_TEMPERATURE, GET_SERVO_ELECTRIC_CURRENT};
+  smartServoHandle handles[SERVO_FIELD_COUNT];
+  uint8_t count = 0;
+  uint8_t field;
+  if((devId < 1) || (devId > maxDevices) || (devId > servo_num_max))
+  {
+    return false;
+  }
+  if(forceRefresh == false)
+  {
+    for(field = 0; (field < SERVO_FIELD_COUNT) && (isCacheFresh(devId,field) == true); field++)
+    {
+    }
+    if(field == SERVO_FIELD_COUNT)
+    {
+      return true;
+    }
+  }
+  if(devices[devId - 1].statusSupport != SERVO_STATUS_UNSUPPORTED)
+  {
+    if((waitFor(requestAsync(devId,GET_SERVO_STATUS)) == true) && (devices[devId - 1].statusSupport == SERVO_STATUS_SUPPORTED))
+    {
+      return true;
+    }
+    // A supporting device whose reply got lost is not asked again with the single requests
+    if(devices[devId - 1].statusSupport != SERVO_STATUS_UNSUPPORTED)
+    {
+      return false;
+    }
+  }
+  for(field = 0; field < SERVO_FIELD_COUNT; field++)
+  {
+    if((forceRefresh == true) || (isCacheFresh(devId,field) == false))
+    {
+      handles[count++] = requestAsync(devId,cmds[field]);
+    }
+  }
+  return waitForAll(handles,count);
+}
+
+/**
+ * \par Function
+ *   getStatusSupport
+ * \par Description
+ *   Returns if a device answers GET_SERVO_STATUS with the complete status.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   SERVO_STATUS_UNKNOWN, SERVO_STATUS_SUPPORTED or SERVO_STATUS_UNSUPPORTED.
+ * \par Others
+ *   Use requestAsync(devId,GET_SERVO_STATUS) for devices which are not SERVO_STATUS_UNSUPPORTED.
+ */
+uint8_t MakeblockSmartServoBase::getStatusSupport(uint8_t devId)
+{
+  if((devId < 1) || (devId > maxDevices))
+  {
+    return SERVO_STATUS_UNSUPPORTED;
+  }
+  return devices[devId - 1].statusSupport;
+}
+
+/**
+ * \par Function
+ *   beginCapture
+ * \par Description
+ *   Starts recording every byte written to and read from the servos with a timestamp in us into a ring
+ *   buffer. When the buffer is full, the oldest bytes are overwritten.
+ * \param[in]
+ *   *buffer - memory for the recorded bytes, e.g. a static array.
+ * \param[in]
+ *   size - number of entries of buffer.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Frames are recorded when they are handed to the port, received bytes when the driver reads them, so the
+ *   times include the latency of the UART driver. Print the recording with printCapture().
+ */
+void MakeblockSmartServoBase::beginCapture(servo_capture_type *buffer,uint16_t size)
+{
+  lock();
+  capture = buffer;
+  captureSize = size;
+  captureHead = 0;
+  captureCount = 0;
+  captureLost = 0;
+  capturing = (buffer != NULL) && (size > 0);
+  unlock();
+}
+
+/**
+ * \par Function
+ *   endCapture
+ * \par Description
+ *   Stops recording, the recorded bytes are kept for printCapture().
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::endCapture(void)
+{
+  lock();
+  capturing = false;
+  unlock();
+}
+
+/**
+ * \par Function
+ *   getCaptureCount
+ * \par Description
+ *   Returns the number of bytes in the capture buffer.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of recorded bytes, at most the size of the buffer.
+ * \par Others
+ *   None
+ */
+uint16_t MakeblockSmartServoBase::getCaptureCount(void)
+{
+  return captureCount;
+}
+
+/**
+ * \par Function
+ *   printCapture
+ * \par Description
+ *   Prints the recorded bytes, the oldest first, one per line as time in us, T (to the servos) or R (from
+ *   the servos) and the byte in hex. The lines can be decoded with extras/host/decode_capture.
+ * \param[in]
+ *   out - where to print, e.g. Serial.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Stop the recording with endCapture() before, otherwise printing the capture adds to it.
+ */
+void MakeblockSmartServoBase::printCapture(Print &out)
+{
+  servo_capture_type entry;
+  uint16_t count = captureCount;
+  uint16_t idx;
+  uint16_t i;
+  char line[20];
+  out.print(F("# smart servo capture: "));
+  out.print(count);
+  out.print(F(" bytes, "));
+  out.print(captureLost);
+  out.println(F(" overwritten"));
+  for(i = 0; i < count; i++)
+  {
+    lock();
+    idx = (uint16_t)((captureHead + captureSize - count + i) % captureSize);
+    entry = capture[idx];
+    unlock();
+    snprintf(line,sizeof(line),"%lu %c %02x",(unsigned long)entry.time,(entry.dir == SERVO_CAPTURE_TX) ? 'T' : 'R',entry.val);
+    out.println(line);
+  }
+}
+
+/**
+ * \par Function
+ *   captureBytes
+ * \par Description
+ *   Adds bytes to the capture buffer if a capture runs.
+ * \param[in]
+ *   *data - the bytes.
+ * \param[in]
+ *   length - number of bytes.
+ * \param[in]
+ *   dir - SERVO_CAPTURE_TX or SERVO_CAPTURE_RX.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::captureBytes(const uint8_t *data,uint16_t length,uint8_t dir)
+{
+  uint32_t now;
+  uint16_t i;
+  if(capturing == false)
+  {
+    return;
+  }
+  now = micros();
+  lock();
+  for(i = 0; i < length; i++)
+  {
+    capture[captureHead].time = now;
+    capture[captureHead].val = data[i];
+    capture[captureHead].dir = dir;
+    captureHead = (captureHead + 1) % captureSize;
+    if(captureCount < captureSize)
+    {
+      captureCount++;
+    }
+    else
+    {
+      captureLost++;
+    }
+  }
+  unlock();
+}
+
+#ifdef ESP32
+/**
+ * \par Function
+ *   beginReceiveTask
+ * \par Description
+ *   Starts a FreeRTOS task which reads and processes all responses of the servos in the background.
+ * \param[in]
+ *   *uart - the hardware serial of the port, used to wake the task on received data(Optional parameters).
+ * \param[in]
+ *   priority - priority of the task(Optional parameters).
+ * \param[in]
+ *   core - the core the task runs on, tskNO_AFFINITY for any(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if the task is running.
+ * \par Others
+ *   Transaction callbacks are called from the receive task once it runs.
+ */
+bool MakeblockSmartServoBase::beginReceiveTask(HardwareSerial *uart,UBaseType_t priority,BaseType_t core)
+{
+  if(rxTaskHandle != NULL)
+  {
+    return true;
+  }
+  if(busLock == NULL)
+  {
+    busLock = xSemaphoreCreateRecursiveMutex();
+    responseEvent = xSemaphoreCreateBinary();
+  }
+  if((busLock == NULL) || (responseEvent == NULL))
+  {
+    return false;
+  }
+  if(xTaskCreatePinnedToCore(receiveTask,"servoRx",SMART_SERVO_RX_TASK_STACK,this,priority,&rxTaskHandle,core) != pdPASS)
+  {
+    rxTaskHandle = NULL;
+    return false;
+  }
+#if defined(ESP_ARDUINO_VERSION) && (ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(2, 0, 3))
+  if(uart != NULL)
+  {
+    // Wake the task as soon as the UART driver reports received data instead of waiting for the next poll
+    TaskHandle_t task = rxTaskHandle;
+    uart->onReceive([task]() { xTaskNotifyGive(task); });
+  }
+#endif
+  return true;
+}
+
+/**
+ * \par Function
+ *   receiveTask
+ * \par Description
+ *   Body of the receive task started by beginReceiveTask().
+ * \param[in]
+ *   *arg - the MakeblockSmartServoBase object.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+void MakeblockSmartServoBase::receiveTask(void *arg)
+{
+  MakeblockSmartServoBase *servo = (MakeblockSmartServoBase*)arg;
+  TickType_t pollTicks = pdMS_TO_TICKS(SMART_SERVO_RX_POLL_MS);
+  if(pollTicks == 0)
+  {
+    pollTicks = 1;
+  }
+  while(true)
+  {
+    ulTaskNotifyTake(pdTRUE,pollTicks);
+    servo->lock();
+    servo->processReceivedBytes();
+    servo->checkTransactionTimeouts();
+    servo->unlock();
+  }
 }
+#endif // ESP32
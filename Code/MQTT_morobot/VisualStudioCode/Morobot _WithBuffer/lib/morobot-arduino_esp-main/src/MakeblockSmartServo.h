@@ -9,33 +9,76 @@
  * 
  * \par Method List:
  *	  0. void beginSerial(Stream* servoPort);
- *    1. uint8_t MakeblockSmartServo::readByte(uint8_t *argv,int16_t idx);
- *    2. short MakeblockSmartServo::readShort(uint8_t *argv,int16_t idx,bool ignore_high);
- *    3. float MakeblockSmartServo::readFloat(uint8_t *argv,int16_t idx);
- *    4. long MakeblockSmartServo::readLong(uint8_t *argv,int idx);
- *    5. uint8_t MakeblockSmartServo::sendByte(uint8_t val);
- *    6. uint8_t MakeblockSmartServo::sendShort(int16_t val,bool ignore_high);
- *    7. uint8_t MakeblockSmartServo::sendFloat(float val);
- *    8. uint8_t MakeblockSmartServo::sendLong(long val);
- *    9. bool MakeblockSmartServo::assignDevIdRequest(void);
- *    10. bool MakeblockSmartServo::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
- *    11. bool MakeblockSmartServo::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
- *    12. bool MakeblockSmartServo::setZero(uint8_t dev_id);
- *    13. bool MakeblockSmartServo::setBreak(uint8_t dev_id, uint8_t breakStatus);
- *    14. bool MakeblockSmartServo::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value);
- *    15. bool MakeblockSmartServo::handSharke(uint8_t dev_id);
- *    16. bool MakeblockSmartServo::setPwmMove(uint8_t dev_id, int16_t pwm_value);
- *    17. bool MakeblockSmartServo::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed);
- *    18. long MakeblockSmartServo::getAngleRequest(uint8_t devId);
- *    19. float MakeblockSmartServo::getSpeedRequest(uint8_t devId);
- *    20. float MakeblockSmartServo::getVoltageRequest(uint8_t devId);
- *    21. float MakeblockSmartServo::getTempRequest(uint8_t devId);
- *    22. float MakeblockSmartServo::getCurrentRequest(uint8_t devId);
- *    23. void MakeblockSmartServo::assignDevIdResponse(void *arg);
- *    24. void MakeblockSmartServo::processSysexMessage(void);
- *    25. void MakeblockSmartServo::smartServoEventHandle(void);
- *    26. void MakeblockSmartServo::errorCodeCheckResponse(void *arg);
- *    27. void MakeblockSmartServo::smartServoCmdResponse(void *arg);
+ *    1. uint8_t MakeblockSmartServoBase::readByte(uint8_t *argv,int16_t idx);
+ *    2. short MakeblockSmartServoBase::readShort(uint8_t *argv,int16_t idx,bool ignore_high);
+ *    3. float MakeblockSmartServoBase::readFloat(uint8_t *argv,int16_t idx);
+ *    4. long MakeblockSmartServoBase::readLong(uint8_t *argv,int idx);
+ *    5. uint8_t MakeblockSmartServoBase::sendByte(uint8_t val);
+ *    6. uint8_t MakeblockSmartServoBase::sendShort(int16_t val,bool ignore_high);
+ *    7. uint8_t MakeblockSmartServoBase::sendFloat(float val);
+ *    8. uint8_t MakeblockSmartServoBase::sendLong(long val);
+ *    9. bool MakeblockSmartServoBase::assignDevIdRequest(void);
+ *    10. bool MakeblockSmartServoBase::moveTo(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
+ *    11. bool MakeblockSmartServoBase::move(uint8_t dev_id,long angle_value,float speed,smartServoCb callback);
+ *    12. bool MakeblockSmartServoBase::setZero(uint8_t dev_id);
+ *    13. bool MakeblockSmartServoBase::setBreak(uint8_t dev_id, uint8_t breakStatus);
+ *    14. bool MakeblockSmartServoBase::setRGBLed(uint8_t dev_id, uint8_t r_value, uint8_t g_value, uint8_t b_value);
+ *    15. bool MakeblockSmartServoBase::handSharke(uint8_t dev_id);
+ *    16. bool MakeblockSmartServoBase::setPwmMove(uint8_t dev_id, int16_t pwm_value);
+ *    17. bool MakeblockSmartServoBase::setInitAngle(uint8_t dev_id,uint8_t mode,int16_t speed);
+ *    18. long MakeblockSmartServoBase::getAngleRequest(uint8_t devId,bool forceRefresh);
+ *    19. float MakeblockSmartServoBase::getSpeedRequest(uint8_t devId,bool forceRefresh);
+ *    20. float MakeblockSmartServoBase::getVoltageRequest(uint8_t devId,bool forceRefresh);
+ *    21. float MakeblockSmartServoBase::getTempRequest(uint8_t devId,bool forceRefresh);
+ *    22. float MakeblockSmartServoBase::getCurrentRequest(uint8_t devId,bool forceRefresh);
+ *    23. void MakeblockSmartServoBase::assignDevIdResponse(void *arg);
+ *    24. void MakeblockSmartServoBase::processSysexMessage(void);
+ *    25. void MakeblockSmartServoBase::smartServoEventHandle(void);
+ *    26. void MakeblockSmartServoBase::errorCodeCheckResponse(void *arg);
+ *    27. void MakeblockSmartServoBase::smartServoCmdResponse(void *arg);
+ *    28. smartServoHandle MakeblockSmartServoBase::requestAsync(uint8_t devId,uint8_t cmd,smartServoTransactionCb callback);
+ *    29. smartServoHandle MakeblockSmartServoBase::moveToAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback);
+ *    30. smartServoHandle MakeblockSmartServoBase::moveAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback);
+ *    31. bool MakeblockSmartServoBase::isDone(smartServoHandle handle);
+ *    32. bool MakeblockSmartServoBase::waitFor(smartServoHandle handle);
+ *    33. bool MakeblockSmartServoBase::waitForAll(const smartServoHandle *handles,uint8_t count);
+ *    34. uint8_t MakeblockSmartServoBase::pendingTransactions(void);
+ *    35. servo_device_type MakeblockSmartServoBase::getDeviceData(uint8_t devId);
+ *    36. bool MakeblockSmartServoBase::beginReceiveTask(HardwareSerial *uart,UBaseType_t priority,BaseType_t core);
+ *    37. uint16_t MakeblockSmartServoBase::getResponseSeq(uint8_t devId,uint8_t field);
+ *    38. uint8_t MakeblockSmartServoBase::getMoveState(uint8_t devId);
+ *    39. bool MakeblockSmartServoBase::reportsPositionReached(uint8_t devId);
+ *    40. void MakeblockSmartServoBase::setPositionReached(uint8_t devId);
+ *    41. bool MakeblockSmartServoBase::waitForPositionReached(const uint8_t *devIds,uint8_t count,unsigned long timeout);
+ *    42. bool MakeblockSmartServoBase::isReportOverdue(uint8_t devId);
+ *    43. bool MakeblockSmartServoBase::pollPositionReached(uint8_t devId);
+ *    44. void MakeblockSmartServoBase::setBaudRate(uint8_t dev_id,long baudRate);
+ *    45. uint8_t MakeblockSmartServoBase::getNumDevices(void);
+ *    46. void MakeblockSmartServoBase::setCacheTTL(uint8_t field,uint16_t ttl);
+ *    47. uint16_t MakeblockSmartServoBase::getCacheTTL(uint8_t field);
+ *    48. bool MakeblockSmartServoBase::isCacheFresh(uint8_t devId,uint8_t field);
+ *    49. void MakeblockSmartServoBase::setMaxRetries(uint8_t retries);
+ *    50. uint8_t MakeblockSmartServoBase::getMaxRetries(void);
+ *    51. servo_link_stats_type MakeblockSmartServoBase::getLinkStats(uint8_t devId);
+ *    52. void MakeblockSmartServoBase::resetLinkStats(uint8_t devId);
+ *    53. servo_bus_stats_type MakeblockSmartServoBase::getBusStats(void);
+ *    54. servo_service_stats_type MakeblockSmartServoBase::getServiceStats(uint8_t srv_id);
+ *    55. void MakeblockSmartServoBase::resetBusStats(void);
+ *    56. uint16_t MakeblockSmartServoBase::getLatencyBucketLimit(uint8_t bucket);
+ *    57. void MakeblockSmartServoBase::printBusStats(Print &out);
+ *    58. servo_device_type MakeblockSmartServo<N>::getDeviceData<DEV_ID>(void);
+ *    59. bool MakeblockSmartServoBase::streamMoveTo(uint8_t dev_id,long angle_value,float speed);
+ *    60. bool MakeblockSmartServoBase::streamPwmMove(uint8_t dev_id,int16_t pwm_value);
+ *    61. bool MakeblockSmartServoBase::setPid(uint8_t dev_id,float p,float i,float d);
+ *    62. bool MakeblockSmartServoBase::getPidRequest(uint8_t devId,servo_pid_type *pid);
+ *    63. uint8_t MakeblockSmartServoBase::measureStepResponse(uint8_t devId,long angle_value,float speed,servo_step_response_type *response);
+ *    64. bool MakeblockSmartServoBase::tunePid(uint8_t devId,long angleA,long angleB,float speed,servo_pid_tune_type *result);
+ *    65. bool MakeblockSmartServoBase::getStatusRequest(uint8_t devId,bool forceRefresh);
+ *    66. uint8_t MakeblockSmartServoBase::getStatusSupport(uint8_t devId);
+ *    67. void MakeblockSmartServoBase::beginCapture(servo_capture_type *buffer,uint16_t size);
+ *    68. void MakeblockSmartServoBase::endCapture(void);
+ *    69. uint16_t MakeblockSmartServoBase::getCaptureCount(void);
+ *    70. void MakeblockSmartServoBase::printCapture(Print &out);
  *
  * \par History:
  * <pre>
@@ -52,8 +95,14 @@
 #define MakeblockSmartServo_H
 
 #include <stdint.h>
+#include <string.h>
 #include <stdbool.h>
 #include <Arduino.h>
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#endif
 
 
 #define ALL_DEVICE              0xff    // Broadcast command identifies
@@ -111,6 +160,79 @@
 
 #define DEFAULT_UART_BUF_SIZE      64
 
+#define SMART_SERVO_DEFAULT_BAUD_RATE 115200  // Baud rate of the servos after power up
+
+#define SMART_SERVO_CMD_TIMEOUT    1200   // Longest time in ms a request waits for its response, used until a round trip time was measured
+#define SMART_SERVO_MIN_TIMEOUT    50     // Shortest timeout in ms, covers a response queued behind SMART_SERVO_MAX_PENDING requests
+#define SMART_SERVO_DEFAULT_RETRIES 2     // Number of times a frame without response is sent again before the transaction fails
+#define SMART_SERVO_LATENCY_BUCKETS 8     // Number of buckets of the latency histograms (limits see getLatencyBucketLimit())
+#define SMART_SERVO_STAT_SERVICES  7      // Number of service ids with statistics (CTL_ASSIGN_DEV_ID to CTL_ERROR_CODE and SMART_SERVO)
+#define SMART_SERVO_MAX_PENDING    16     // Maximum number of requests which can be in flight at the same time
+#define SMART_SERVO_INVALID_HANDLE -1     // Returned if a request could not be sent
+#define SMART_SERVO_MAX_FRAME_SIZE 24     // Largest frame the encoder builds (header, 7bit payload, checksum, END_SYSEX)
+#define SMART_SERVO_MAX_DEVICES    8      // Default number of devices values are stored for (template argument of MakeblockSmartServo)
+#define SMART_SERVO_RX_TASK_STACK  3072   // Stack size of the receive task (ESP32)
+#define SMART_SERVO_RX_POLL_MS     2      // The receive task checks the port at least this often if no UART event arrives
+
+/* fields of a device with a response sequence number */
+#define SERVO_FIELD_ANGLE       0x00
+#define SERVO_FIELD_SPEED       0x01
+#define SERVO_FIELD_VOLTAGE     0x02
+#define SERVO_FIELD_TEMPERATURE 0x03
+#define SERVO_FIELD_CURRENT     0x04
+#define SERVO_FIELD_COUNT       5
+
+/* GET_SERVO_STATUS reply after the command byte: angle (long), speed, voltage, temperature, current (float) */
+#define SMART_SERVO_STATUS_SIZE 25
+
+/* plausible ranges of a GET_SERVO_STATUS reply, a reply outside of them has another layout than assumed */
+#define SMART_SERVO_STATUS_MIN_VOLTAGE      0.0f    // V
+#define SMART_SERVO_STATUS_MAX_VOLTAGE      30.0f   // V, the servos are supplied with 6 to 12 V
+#define SMART_SERVO_STATUS_MIN_TEMPERATURE  -40.0f  // degree Celsius
+#define SMART_SERVO_STATUS_MAX_TEMPERATURE  150.0f  // degree Celsius
+
+/* support of GET_SERVO_STATUS by a device */
+#define SERVO_STATUS_UNKNOWN     0x00   // not asked yet
+#define SERVO_STATUS_SUPPORTED   0x01   // the device answered with the complete status
+#define SERVO_STATUS_UNSUPPORTED 0x02   // the device rejected the request, did not answer or answered with another or implausible layout
+
+/* direction of a captured byte */
+#define SERVO_CAPTURE_TX        0x00    // written to the servos
+#define SERVO_CAPTURE_RX        0x01    // read from the servos
+
+#define SMART_SERVO_SLOW_FIELD_TTL 2000   // Default cache time in ms of values which change slowly (voltage, temperature)
+#define SMART_SERVO_TUNE_TOLERANCE 1      // Deviation in degree from the goal a step response counts as settled with
+#define SMART_SERVO_TUNE_HOLD      150    // Time in ms the angle has to stay within the tolerance to count as settled
+#define SMART_SERVO_TUNE_TIMEOUT   3000   // Longest time in ms a step response is measured
+#define SMART_SERVO_TUNE_ROUNDS    3      // Rounds of the gain search of tunePid(), the change of a gain is halved every round
+#define SMART_SERVO_TUNE_STEP      0.5f   // Relative change of a gain in the first round of tunePid()
+#define SMART_SERVO_TUNE_OVERSHOOT_COST 1000  // Cost of one degree overshoot in ms settle time
+#define SMART_SERVO_TUNE_MAX_FAILS 3      // Failed angle readings in a row after which a step response is given up as bus error
+#define SMART_SERVO_REPORT_SLACK   300    // Time in ms added to the expected travel time of a move (ramps, delay of the report) before a missing report is polled for
+#define SMART_SERVO_REPORT_POLL    150    // Time in ms between two angle readings of a move whose arrival report is overdue
+#define SMART_SERVO_UNKNOWN_TRAVEL 360    // Travel in degree assumed for an absolute move of a device whose angle was never read
+
+/* move states of a device */
+#define MOVE_STATE_IDLE         0x00    // no move commanded or the servo reported that it reached the position
+#define MOVE_STATE_MOVING       0x01    // moved with an angle command, the servo reports when it reaches the position
+#define MOVE_STATE_UNTRACKED    0x02    // moved with a command without arrival report (init angle, pwm)
+
+/* results of a step response measurement */
+#define STEP_RESPONSE_SETTLED   0x00    // the angle settled within the timeout
+#define STEP_RESPONSE_UNSETTLED 0x01    // the servo answered, but the angle did not settle within the timeout
+#define STEP_RESPONSE_BUS_ERROR 0x02    // the move was not acknowledged or the angle could not be read
+
+/* transaction states */
+#define TRANSACTION_FREE        0x00
+#define TRANSACTION_PENDING     0x01
+#define TRANSACTION_DONE        0x02
+#define TRANSACTION_FAILED      0x03
+
+/* events counted in the link statistics of a device */
+#define LINK_EVENT_SENT         0x00
+#define LINK_EVENT_RETRY        0x01
+#define LINK_EVENT_TIMEOUT      0x02
+
 typedef struct{
   uint8_t dev_id;
   uint8_t srv_id;
@@ -128,27 +250,6 @@ union sysex_message{
   sysex_message_type val;
 };
 
-union{
-  uint8_t byteVal[8];
-  double doubleVal;
-}val8byte;
-
-union{
-  uint8_t byteVal[4];
-  float floatVal;
-  long longVal;
-}val4byte;
-
-union{
-  uint8_t byteVal[2];
-  short shortVal;
-}val2byte;
-
-union{
-  uint8_t byteVal[1];
-  uint8_t charVal;
-}val1byte;
-
 typedef struct
 {
   long angleValue;
@@ -158,28 +259,215 @@ typedef struct
   float current;
 }servo_device_type;
 
+typedef struct
+{
+  float p;
+  float i;
+  float d;
+}servo_pid_type;
+
+typedef struct
+{
+  uint32_t time;                      // micros() when the byte was handed to the port or read from it
+  uint8_t val;
+  uint8_t dir;                        // SERVO_CAPTURE_TX or SERVO_CAPTURE_RX
+}servo_capture_type;
+
+typedef struct
+{
+  unsigned long riseTime;             // time in ms from the command until 90 % of the step is reached
+  unsigned long settleTime;           // time in ms from the command until the angle stays within SMART_SERVO_TUNE_TOLERANCE
+  long overshoot;                     // largest deviation in degree beyond the goal
+  bool settled;                       // false if the angle did not settle within SMART_SERVO_TUNE_TIMEOUT
+}servo_step_response_type;
+
+typedef struct
+{
+  servo_pid_type initial;             // gains before the tuning
+  servo_pid_type pid;                 // gains found and written to the servo
+  servo_step_response_type before;    // worse step response of both directions with the initial gains
+  servo_step_response_type after;     // worse step response of both directions with the tuned gains
+  uint8_t trials;                     // number of gain sets which were measured
+}servo_pid_tune_type;
+
 typedef void (*smartServoCb)(uint8_t); 
 
+typedef int16_t smartServoHandle;
+typedef void (*smartServoTransactionCb)(uint8_t dev_id, uint8_t cmd, bool success);
+
+typedef struct
+{
+  uint8_t data[SMART_SERVO_MAX_FRAME_SIZE];  // encoded frame, written to the port with a single write call
+  uint8_t length;                            // number of bytes in data
+  uint8_t checksum;                          // running sum of dev_id, srv_id and payload
+}servo_frame_type;
+
+typedef struct
+{
+  uint8_t dev_id;                     // device the request was sent to (ALL_DEVICE matches every device)
+  uint8_t srv_id;                     // service id the response arrives with (SMART_SERVO or CTL_ERROR_CODE)
+  uint8_t cmd;                        // secondary command of the request
+  uint8_t state;                      // TRANSACTION_FREE, _PENDING, _DONE or _FAILED
+  uint8_t generation;                 // incremented every time the slot is reused, makes old handles detectable
+  uint16_t order;                     // issue order, responses are matched to the oldest request first
+  uint8_t retries;                    // number of times the frame was sent again
+  unsigned long issueTime;            // time the frame was sent first, for the latency histograms
+  unsigned long startTime;            // time the frame was sent last
+  smartServoTransactionCb callback;
+  servo_frame_type frame;             // copy of the sent frame for retries
+}servo_transaction_type;
+
+typedef struct
+{
+  uint32_t sent;                      // frames sent to the device, including retries
+  uint32_t responses;                 // responses matched to a transaction
+  uint32_t retries;                   // frames sent again because no response arrived in time
+  uint32_t timeouts;                  // transactions which failed after all retries
+  uint16_t srtt;                      // smoothed round trip time in ms
+  uint16_t rttvar;                    // mean deviation of the round trip time in ms
+  uint16_t timeout;                   // time in ms a frame waits for its response before it is sent again
+  uint32_t latency[SMART_SERVO_LATENCY_BUCKETS];  // responses per latency bucket, measured from the first send
+}servo_link_stats_type;
+
+typedef struct
+{
+  volatile servo_device_type values;                          // last values reported by the device
+  volatile uint16_t responseSeq[SERVO_FIELD_COUNT];           // incremented with every response per field
+  volatile unsigned long responseTime[SERVO_FIELD_COUNT];     // time of the last response per field
+  volatile uint8_t moveState;                                 // MOVE_STATE_IDLE, _MOVING or _UNTRACKED
+  volatile bool positionReports;                              // true once the device reported a reached position
+  unsigned long reportDeadline;                               // time the arrival report of the current move is expected by, afterwards the angle is polled
+  long reportPollAngle;                                       // angle read by the previous poll of an overdue move
+  bool reportPollValid;                                       // true if reportPollAngle belongs to the current move
+  volatile uint8_t streamAcks;                                // acknowledges expected for frames sent by streamMoveTo() and streamPwmMove()
+  uint16_t streamOrder;                                       // transaction order at the last streamed frame, earlier transactions are acknowledged before it
+  unsigned long streamTime;                                   // time the last streamed frame was sent
+  servo_pid_type pid;                                         // last gains reported by the device, written under lock()
+  volatile uint8_t statusSupport;                             // SERVO_STATUS_UNKNOWN, _SUPPORTED or _UNSUPPORTED
+  servo_link_stats_type linkStats;
+  uint16_t rttAvg8;                                           // smoothed round trip time in 1/8 ms
+  uint16_t rttVar4;                                           // mean deviation of the round trip time in 1/4 ms
+}servo_device_state_type;
+
+typedef struct
+{
+  uint32_t framesSent;                // frames written to the port, including retries
+  uint32_t framesReceived;            // complete frames received
+  uint32_t overflows;                 // received frames longer than the sysex buffer, dropped
+  uint32_t checksumErrors;            // received frames with a wrong checksum, dropped
+  uint32_t framingErrors;             // received frames cut off by a start byte or containing an invalid byte, dropped
+  uint32_t unmatched;                 // responses without a pending transaction
+  uint32_t streamFrames;              // setpoints sent without transaction by streamMoveTo() and streamPwmMove()
+  uint32_t streamAcks;                // acknowledges received for those setpoints
+}servo_bus_stats_type;
+
+typedef struct
+{
+  uint32_t sent;                      // frames sent with this service id
+  uint32_t received;                  // frames received with this service id
+  uint32_t latency[SMART_SERVO_LATENCY_BUCKETS];  // responses arriving with this service id per latency bucket
+}servo_service_stats_type;
+
 /**
- * Class: MakeblockSmartServo
+ * \par Function
+ *   encode7bit
+ * \par Description
+ *   change a value of type T (sizeof(T) bytes) to sizeof(T)+1 bytes 7bit data.
+ *   Uses no shared state, so several robots can be driven from different tasks at the same time.
+ * \param[in]
+ *   val - the data to be converted.\n
+ * \param[in]
+ *   *buf - buffer for the encoded bytes.\n
+ * \param[in]
+ *   count - number of 7bit bytes to write, less than sizeof(T)+1 drops the high bits (e.g. short speed values).\n
+ * \par Output
+ *   None
+ * \return
+ *   the checksum of the encoded bytes.
+ * \par Others
+ *   The protocol uses little endian byte order like AVR and ESP32.
+ */
+template<typename T>
+inline uint8_t encode7bit(T val,uint8_t *buf,uint8_t count = sizeof(T) + 1)
+{
+  static_assert(sizeof(T) <= sizeof(uint32_t), "encode7bit: at most 4 byte values");
+  uint32_t bits = 0;
+  uint8_t checksum = 0;
+  uint8_t i;
+  // 7 bits per byte from a register instead of shifting byte pairs, see extras/host/fuzz_codec.cpp
+  memcpy(&bits,&val,sizeof(T));
+  for(i = 0; i < count; i++)
+  {
+    buf[i] = (bits >> (7 * i)) & 0x7f;
+    checksum += buf[i];
+  }
+  return checksum & 0x7f;
+}
+
+/**
+ * \par Function
+ *   decode7bit
+ * \par Description
+ *   change sizeof(T)+1 bytes 7bit data to a value of type T.
+ *   Uses no shared state, so several robots can be driven from different tasks at the same time.
+ * \param[in]
+ *   *buf - the encoded bytes.\n
+ * \param[in]
+ *   count - number of 7bit bytes to read, missing high bits are zero if less than sizeof(T)+1.\n
+ * \par Output
+ *   None
+ * \return
+ *   the converted data.
+ * \par Others
+ *   The protocol uses little endian byte order like AVR and ESP32.
+ */
+template<typename T>
+inline T decode7bit(const uint8_t *buf,uint8_t count = sizeof(T) + 1)
+{
+  static_assert(sizeof(T) <= sizeof(uint32_t), "decode7bit: at most 4 byte values");
+  uint32_t bits = 0;
+  uint8_t i;
+  T val;
+  for(i = 0; i < count; i++)
+  {
+    bits |= (uint32_t)(buf[i] & 0x7f) << (7 * i);
+  }
+  memcpy(&val,&bits,sizeof(T));
+  return val;
+}
+
+/**
+ * Class: MakeblockSmartServoBase
  * \par Description
- * Declaration of Class MakeblockSmartServo.
+ * Declaration of Class MakeblockSmartServoBase. Implements the protocol for any number of devices,
+ * the values of the devices are stored by MakeblockSmartServo<N>.
  */
 #ifndef ME_PORT_DEFINED
-class MakeblockSmartServo
+class MakeblockSmartServoBase
 #else /* !ME_PORT_DEFINED */
-class MakeblockSmartServo : public MeSerial
+class MakeblockSmartServoBase : public MeSerial
 #endif /* !ME_PORT_DEFINED */
 {
-public:
-#ifdef ME_PORT_DEFINED
+protected:
+#ifndef ME_PORT_DEFINED
+/**
+ * Constructor which uses the device storage of the derived MakeblockSmartServo<N>.
+ * \param[in]
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates, devices with a higher id are driven but their values are not stored.
+ */
+  MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices);
+#else // ME_PORT_DEFINED
 /**
  * Alternate Constructor which can call your own function to map the Me Smart Servo to arduino port,
  * no pins are used or initialized here.
  * \param[in]
- *   None
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates.
  */
-  MakeblockSmartServo();
+  MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices);
 
 /**
  * Alternate Constructor which can call your own function to map the Me Smart Servo to arduino port,
@@ -193,15 +481,22 @@ public:
  * Alternate Constructor which can call your own function to map the Me Smart Servo to arduino port,
  * If the hardware serial was selected, it will used the hardware serial.
  * \param[in]
+ *   *deviceStates - array with the values of maxDevices devices.
+ * \param[in]
+ *   maxDevices - number of devices in deviceStates.
+ * \param[in]
  *   receivePin - the rx pin of serial(arduino port)
  * \param[in]
  *   transmitPin - the tx pin of serial(arduino port)
  * \param[in]
  *   inverse_logic - Whether the Serial level need inv.
  */
-  MakeblockSmartServo(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic);
+  MakeblockSmartServoBase(servo_device_state_type *deviceStates, uint8_t maxDevices,
+                          uint8_t receivePin, uint8_t transmitPin, bool inverse_logic);
 #endif // ME_PORT_DEFINED
 
+public:
+
 
 
 /**
@@ -537,6 +832,8 @@ void beginSerial(Stream* servoPort);
  *   This function used to get the smart servo's angle.
  * \param[in]
  *   devId - the device id of servo that we want to read its angle.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -544,7 +841,7 @@ void beginSerial(Stream* servoPort);
  * \par Others
  *   None
  */
-  long getAngleRequest(uint8_t devId);
+  long getAngleRequest(uint8_t devId,bool forceRefresh = false);
 
 /**
  * \par Function
@@ -553,6 +850,8 @@ void beginSerial(Stream* servoPort);
  *   This function used to get the smart servo's speed.
  * \param[in]
  *   devId - the device id of servo that we want to read its speed.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -560,7 +859,7 @@ void beginSerial(Stream* servoPort);
  * \par Others
  *   None
  */
-  float getSpeedRequest(uint8_t devId);
+  float getSpeedRequest(uint8_t devId,bool forceRefresh = false);
 
 /**
  * \par Function
@@ -569,6 +868,8 @@ void beginSerial(Stream* servoPort);
  *   This function used to get the smart servo's voltage.
  * \param[in]
  *   devId - the device id of servo that we want to read its voltage.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -576,7 +877,7 @@ void beginSerial(Stream* servoPort);
  * \par Others
  *   None
  */
-  float getVoltageRequest(uint8_t devId);
+  float getVoltageRequest(uint8_t devId,bool forceRefresh = false);
 
 /**
  * \par Function
@@ -585,6 +886,8 @@ void beginSerial(Stream* servoPort);
  *   This function used to get the smart servo's temperature.
  * \param[in]
  *   devId - the device id of servo that we want to read its temperature.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -592,7 +895,7 @@ void beginSerial(Stream* servoPort);
  * \par Others
  *   None
  */
-  float getTempRequest(uint8_t devId);
+  float getTempRequest(uint8_t devId,bool forceRefresh = false);
 
 /**
  * \par Function
@@ -601,6 +904,8 @@ void beginSerial(Stream* servoPort);
  *   This function used to get the smart servo's current.
  * \param[in]
  *   devId - the device id of servo that we want to read its current.
+ * \param[in]
+ *   forceRefresh - send a request even if the stored value is fresh(Optional parameters).
  * \par Output
  *   None
  * \return
@@ -608,7 +913,7 @@ void beginSerial(Stream* servoPort);
  * \par Others
  *   None
  */
-  float getCurrentRequest(uint8_t devId);
+  float getCurrentRequest(uint8_t devId,bool forceRefresh = false);
 
 /**
  * \par Function
@@ -690,15 +995,1501 @@ void beginSerial(Stream* servoPort);
  */
   void smartServoEventHandle(void);
 
-private:
-  union sysex_message sysex;
-  volatile int16_t sysexBytesRead;
-  volatile uint8_t servo_num_max;
-  volatile uint16_t resFlag;
-  volatile servo_device_type servo_dev_list[8];
-  volatile long cmdTimeOutValue;
-  volatile bool parsingSysex;
-  smartServoCb _callback;
-  Stream* port;
-};
+/**
+ * \par Function
+ *   requestAsync
+ * \par Description
+ *   Sends a read request (GET_SERVO_CUR_ANGLE, GET_SERVO_SPEED, GET_SERVO_VOLTAGE, GET_SERVO_TEMPERATURE
+ *   or GET_SERVO_ELECTRIC_CURRENT) without waiting for the response. Several requests to different devices
+ *   and services can be in flight at the same time, the responses are matched by device and service id.
+ *   The received value is stored and can be read with the get*Request functions after the transaction is done.
+ * \param[in]
+ *   devId - the device id of servo that we want to read from.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \param[in]
+ *   callback - callback function when the response arrived or the request timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the request could not be sent.
+ * \par Others
+ *   None
+ */
+  smartServoHandle requestAsync(uint8_t devId,uint8_t cmd,smartServoTransactionCb callback = NULL);
+
+/**
+ * \par Function
+ *   moveToAsync
+ * \par Description
+ *   smart servo moves to the absolute angle. Does not wait for the acknowledge of the servo.
+ * \param[in]
+ *    dev_id - the device id of servo that we want to move.
+ * \param[in]
+ *    angle_value - the absolute angle value we want move to.
+ * \param[in]
+ *    speed - move speed value(The unit is rpm).
+ * \param[in]
+ *    callback - callback function when the command was acknowledged or timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the command could not be sent.
+ * \par Others
+ *   None
+ */
+  smartServoHandle moveToAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback = NULL);
+
+/**
+ * \par Function
+ *   moveAsync
+ * \par Description
+ *   smart servo moves to the relative angle. Does not wait for the acknowledge of the servo.
+ * \param[in]
+ *    dev_id - the device id of servo that we want to move.
+ * \param[in]
+ *    angle_value - the relative angle value we want move to.
+ * \param[in]
+ *    speed - move speed value(The unit is rpm).
+ * \param[in]
+ *    callback - callback function when the command was acknowledged or timed out(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction or SMART_SERVO_INVALID_HANDLE if the command could not be sent.
+ * \par Others
+ *   None
+ */
+  smartServoHandle moveAsync(uint8_t dev_id,long angle_value,float speed,smartServoTransactionCb callback = NULL);
+
+/**
+ * \par Function
+ *   streamMoveTo
+ * \par Description
+ *   smart servo moves to the absolute angle. For setpoints which are sent periodically: no transaction is
+ *   started, the frame is not sent again and the acknowledge of the servo is not waited for.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to move.\n
+ * \param[in]
+ *   angle_value - the absolute angle value we want move to.\n
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).\n
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent.
+ * \par Others
+ *   A lost setpoint is replaced by the next one. The acknowledges are counted in the bus statistics
+ *   (streamAcks) instead of as unmatched responses.
+ */
+  bool streamMoveTo(uint8_t dev_id,long angle_value,float speed);
+
+/**
+ * \par Function
+ *   streamPwmMove
+ * \par Description
+ *   set the pwm motion of smart servo. For setpoints which are sent periodically: no transaction is
+ *   started, the frame is not sent again and the acknowledge of the servo is not waited for.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to set.\n
+ * \param[in]
+ *   pwm_value - the pwm value we wan't set the servo motor.\n
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent.
+ * \par Others
+ *   See streamMoveTo().
+ */
+  bool streamPwmMove(uint8_t dev_id,int16_t pwm_value);
+
+/**
+ * \par Function
+ *   isDone
+ * \par Description
+ *   Processes received messages and checks if a transaction has finished (response received or timed out).
+ * \param[in]
+ *   handle - the handle returned when the request was sent.
+ * \par Output
+ *   None
+ * \return
+ *   true if the transaction is not pending any more.
+ * \par Others
+ *   A handle stays valid until SMART_SERVO_MAX_PENDING newer transactions were started.
+ */
+  bool isDone(smartServoHandle handle);
+
+/**
+ * \par Function
+ *   waitFor
+ * \par Description
+ *   Waits until a transaction has finished.
+ * \param[in]
+ *   handle - the handle returned when the request was sent.
+ * \par Output
+ *   None
+ * \return
+ *   true if the response was received, false if the transaction timed out or the handle is invalid.
+ * \par Others
+ *   None
+ */
+  bool waitFor(smartServoHandle handle);
+
+/**
+ * \par Function
+ *   waitForAll
+ * \par Description
+ *   Waits until all given transactions have finished.
+ * \param[in]
+ *   *handles - the handles returned when the requests were sent.
+ * \param[in]
+ *   count - number of handles.
+ * \par Output
+ *   None
+ * \return
+ *   true if the responses of all transactions were received.
+ * \par Others
+ *   None
+ */
+  bool waitForAll(const smartServoHandle *handles,uint8_t count);
+
+/**
+ * \par Function
+ *   pendingTransactions
+ * \par Description
+ *   Returns the number of transactions which are waiting for a response.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   Number of pending transactions.
+ * \par Others
+ *   None
+ */
+  uint8_t pendingTransactions(void);
+
+/**
+ * \par Function
+ *   getDeviceData
+ * \par Description
+ *   Returns the last values received from a smart servo without sending a request.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   Copy of the stored angle, speed, voltage, temperature and current of the servo.
+ * \par Others
+ *   None
+ */
+  servo_device_type getDeviceData(uint8_t devId);
+
+/**
+ * \par Function
+ *   getResponseSeq
+ * \par Description
+ *   Returns a counter which is incremented every time a value of the given field is received from a device.
+ *   Compare it with an earlier value to find out if getDeviceData() returns new data.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   Sequence number of the last received value, 0 if nothing was received yet.
+ * \par Others
+ *   None
+ */
+  uint16_t getResponseSeq(uint8_t devId,uint8_t field);
+
+/**
+ * \par Function
+ *   setBaudRate
+ * \par Description
+ *   Tells a smart servo to switch its bus to another baud rate. The servo does not acknowledge the
+ *   command, so the port has to be switched to the new rate afterwards and the servo has to be checked
+ *   with handSharke().
+ * \param[in]
+ *   dev_id - the device id of servo (ALL_DEVICE for all servos).
+ * \param[in]
+ *   baudRate - the new baud rate.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Returns after the frame has been sent completely.
+ */
+  void setBaudRate(uint8_t dev_id,long baudRate);
+
+/**
+ * \par Function
+ *   getNumDevices
+ * \par Description
+ *   Returns the highest device id enumerated by assignDevIdRequest(), including devices which are not
+ *   joints of the robot (e.g. the smart servo of a gripper).
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of devices on the bus.
+ * \par Others
+ *   None
+ */
+  uint8_t getNumDevices(void);
+
+/**
+ * \par Function
+ *   setCacheTTL
+ * \par Description
+ *   Sets how long a received value of a field is used by the get*Request functions before a new request is sent.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \param[in]
+ *   ttl - time in ms a value stays fresh, 0 requests the value on every call.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   By default voltage and temperature are cached for SMART_SERVO_SLOW_FIELD_TTL, all other fields are not cached.
+ */
+  void setCacheTTL(uint8_t field,uint16_t ttl);
+
+/**
+ * \par Function
+ *   getCacheTTL
+ * \par Description
+ *   Returns how long a received value of a field is used before a new request is sent.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   time in ms a value stays fresh.
+ * \par Others
+ *   None
+ */
+  uint16_t getCacheTTL(uint8_t field);
+
+/**
+ * \par Function
+ *   isCacheFresh
+ * \par Description
+ *   Checks if the stored value of a field was received within its cache time.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   field - SERVO_FIELD_ANGLE, _SPEED, _VOLTAGE, _TEMPERATURE or _CURRENT.
+ * \par Output
+ *   None
+ * \return
+ *   true if the value can be used without a new request.
+ * \par Others
+ *   None
+ */
+  bool isCacheFresh(uint8_t devId,uint8_t field);
+
+/**
+ * \par Function
+ *   setMaxRetries
+ * \par Description
+ *   Sets how often a frame without response is sent again before its transaction fails.
+ * \param[in]
+ *   retries - number of retries, 0 gives a transaction up after the first timeout.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Relative moves are never sent again, the servo might have executed the lost frame already.
+ */
+  void setMaxRetries(uint8_t retries);
+
+/**
+ * \par Function
+ *   getMaxRetries
+ * \par Description
+ *   Returns how often a frame without response is sent again before its transaction fails.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of retries.
+ * \par Others
+ *   None
+ */
+  uint8_t getMaxRetries(void);
+
+/**
+ * \par Function
+ *   getLinkStats
+ * \par Description
+ *   Returns the frame counters and the measured round trip time of a device.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   counters, smoothed round trip time, its deviation and the current timeout in ms.
+ * \par Others
+ *   The timeout is SMART_SERVO_CMD_TIMEOUT until the first response of the device was received.
+ */
+  servo_link_stats_type getLinkStats(uint8_t devId);
+
+/**
+ * \par Function
+ *   resetLinkStats
+ * \par Description
+ *   Clears the frame counters and the measured round trip time of a device.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void resetLinkStats(uint8_t devId);
+
+/**
+ * \par Function
+ *   getBusStats
+ * \par Description
+ *   Returns the counters of the whole bus.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   frames sent and received, dropped frames and responses without a pending transaction.
+ * \par Others
+ *   None
+ */
+  servo_bus_stats_type getBusStats(void);
+
+/**
+ * \par Function
+ *   getServiceStats
+ * \par Description
+ *   Returns the frame counters and the latency histogram of a service id.
+ * \param[in]
+ *   srv_id - the service id, e.g. SMART_SERVO or CTL_ERROR_CODE.
+ * \par Output
+ *   None
+ * \return
+ *   counters of the service, all zero for an unknown service id.
+ * \par Others
+ *   Latencies are counted for the service the response arrives with: SMART_SERVO for read requests,
+ *   CTL_ERROR_CODE for the acknowledges of commands.
+ */
+  servo_service_stats_type getServiceStats(uint8_t srv_id);
+
+/**
+ * \par Function
+ *   resetBusStats
+ * \par Description
+ *   Clears the bus, service and link statistics of all devices.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void resetBusStats(void);
+
+/**
+ * \par Function
+ *   getLatencyBucketLimit
+ * \par Description
+ *   Returns the upper limit of a bucket of the latency histograms.
+ * \param[in]
+ *   bucket - index of the bucket, 0 to SMART_SERVO_LATENCY_BUCKETS - 1.
+ * \par Output
+ *   None
+ * \return
+ *   latency in ms counted up to this bucket, 0xFFFF for the last bucket.
+ * \par Others
+ *   None
+ */
+  static uint16_t getLatencyBucketLimit(uint8_t bucket);
+
+/**
+ * \par Function
+ *   printBusStats
+ * \par Description
+ *   Prints the bus counters, the link statistics of every device and the statistics of every used service.
+ * \param[in]
+ *   out - where the text is printed to, e.g. Serial.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   One line per device and service, the latency histogram is printed as counts per bucket separated by '/'.
+ */
+  void printBusStats(Print &out);
+
+/**
+ * \par Function
+ *   getMoveState
+ * \par Description
+ *   Returns if a device is moving. Angle moves are finished by the REPORT_WHEN_REACH_THE_SET_POSITION
+ *   message of the servo, so no angle has to be polled.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   MOVE_STATE_IDLE, MOVE_STATE_MOVING or MOVE_STATE_UNTRACKED.
+ * \par Others
+ *   Received messages are only processed by the receive task or other calls of this class.
+ */
+  uint8_t getMoveState(uint8_t devId);
+
+/**
+ * \par Function
+ *   reportsPositionReached
+ * \par Description
+ *   Returns if the firmware of a device sends REPORT_WHEN_REACH_THE_SET_POSITION messages.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if at least one report was received from the device. Until then its moves have to be checked by polling.
+ * \par Others
+ *   None
+ */
+  bool reportsPositionReached(uint8_t devId);
+
+/**
+ * \par Function
+ *   setPositionReached
+ * \par Description
+ *   Marks the move of a device as finished, e.g. after polling found that the servo does not move any more.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void setPositionReached(uint8_t devId);
+
+/**
+ * \par Function
+ *   waitForPositionReached
+ * \par Description
+ *   Waits until none of the given devices is in MOVE_STATE_MOVING any more.
+ * \param[in]
+ *   *devIds - the device ids of the servos.
+ * \param[in]
+ *   count - number of device ids.
+ * \param[in]
+ *   timeout - maximum time to wait in ms.
+ * \par Output
+ *   None
+ * \return
+ *   true if all devices reported that they reached their position, false on timeout.
+ * \par Others
+ *   Devices in MOVE_STATE_UNTRACKED are not waited for.
+ */
+  bool waitForPositionReached(const uint8_t *devIds,uint8_t count,unsigned long timeout);
+
+/**
+ * \par Function
+ *   isReportOverdue
+ * \par Description
+ *   Returns if a device is still in MOVE_STATE_MOVING although its arrival report should have arrived:
+ *   the expected travel time of the move, one retransmission timeout and SMART_SERVO_REPORT_SLACK have passed.
+ *   A lost or corrupted report would otherwise keep the move running until the timeout of the caller.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if the move should be checked with pollPositionReached().
+ * \par Others
+ *   None
+ */
+  bool isReportOverdue(uint8_t devId);
+
+/**
+ * \par Function
+ *   pollPositionReached
+ * \par Description
+ *   Checks a move whose arrival report is overdue by reading the angle of the device. The move is finished
+ *   when two readings SMART_SERVO_REPORT_POLL ms apart are equal. Reads at most one angle per call.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   true if the device is not in MOVE_STATE_MOVING any more.
+ * \par Others
+ *   Waits for the response of the angle request.
+ */
+  bool pollPositionReached(uint8_t devId);
+
+/**
+ * \par Function
+ *   setPid
+ * \par Description
+ *   set the gains of the position controller of smart servo.
+ * \param[in]
+ *   dev_id - the device id of servo that we want to set.
+ * \param[in]
+ *   p - proportional gain.
+ * \param[in]
+ *   i - integral gain.
+ * \param[in]
+ *   d - derivative gain.
+ * \par Output
+ *   None
+ * \return
+ *   If the assignment is successful, return true.
+ * \par Others
+ *   The gains are sent as three floats in the order P, I, D, like GET_SERVO_PID reports them.
+ */
+  bool setPid(uint8_t dev_id,float p,float i,float d);
+
+/**
+ * \par Function
+ *   getPidRequest
+ * \par Description
+ *   This function used to get the gains of the position controller of smart servo.
+ * \param[in]
+ *   devId - the device id of servo that we want to read its gains.
+ * \param[in]
+ *   *pid - the gains are written to it if the servo answered.
+ * \par Output
+ *   None
+ * \return
+ *   true if the servo answered.
+ * \par Others
+ *   None
+ */
+  bool getPidRequest(uint8_t devId,servo_pid_type *pid);
+
+/**
+ * \par Function
+ *   measureStepResponse
+ * \par Description
+ *   Moves the servo to an angle and samples its angle until it settled, to measure how fast
+ *   and how well damped the position controller reaches the goal.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angle_value - the absolute angle value we want move to.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   *response - the rise time, settle time and overshoot are written to it.
+ * \par Output
+ *   None
+ * \return
+ *   STEP_RESPONSE_SETTLED if the angle settled within SMART_SERVO_TUNE_TIMEOUT, STEP_RESPONSE_UNSETTLED if not,
+ *   STEP_RESPONSE_BUS_ERROR if the start angle could not be read, the move was not acknowledged or
+ *   SMART_SERVO_TUNE_MAX_FAILS angle readings in a row failed.
+ * \par Others
+ *   Blocks until the servo settled. The angle is polled as fast as the bus allows, so the resolution of the
+ *   times is one round trip. The servo has to stand still before.
+ */
+  uint8_t measureStepResponse(uint8_t devId,long angle_value,float speed,servo_step_response_type *response);
+
+/**
+ * \par Function
+ *   tunePid
+ * \par Description
+ *   Searches the gains of the position controller with the shortest settle time without overshoot.
+ *   The servo is stepped between two angles; every gain is made larger and smaller in turn and a change is
+ *   kept if the worse step of both directions improves. The change is halved every round
+ *   (SMART_SERVO_TUNE_ROUNDS).
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angleA - first angle of the test steps, the servo is moved there first.
+ * \param[in]
+ *   angleB - second angle of the test steps.
+ * \param[in]
+ *   speed - move speed value of the test steps(The unit is rpm).
+ * \param[in]
+ *   *result - the initial and found gains and their step responses are written to it(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if the servo answered all requests, the found gains are written to the servo.
+ * \par Others
+ *   Takes some seconds per trial. The servo has to move freely between both angles with the load it carries
+ *   in operation. If a request or a step response fails with a bus error, the initial gains are written back.
+ */
+  bool tunePid(uint8_t devId,long angleA,long angleB,float speed,servo_pid_tune_type *result = NULL);
+
+/**
+ * \par Function
+ *   getStatusRequest
+ * \par Description
+ *   Refreshes angle, speed, voltage, temperature and current of smart servo with one GET_SERVO_STATUS
+ *   round trip. Devices which do not support it are asked with the five single requests instead.
+ * \param[in]
+ *   devId - the device id of servo that we want to read.
+ * \param[in]
+ *   forceRefresh - send requests even if all stored values are fresh(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if all values were received, read them with getDeviceData().
+ * \par Others
+ *   The first call per device finds out if GET_SERVO_STATUS is supported (see getStatusSupport()).
+ */
+  bool getStatusRequest(uint8_t devId,bool forceRefresh = false);
+
+/**
+ * \par Function
+ *   getStatusSupport
+ * \par Description
+ *   Returns if a device answers GET_SERVO_STATUS with the complete status.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \par Output
+ *   None
+ * \return
+ *   SERVO_STATUS_UNKNOWN, SERVO_STATUS_SUPPORTED or SERVO_STATUS_UNSUPPORTED.
+ * \par Others
+ *   Use requestAsync(devId,GET_SERVO_STATUS) for devices which are not SERVO_STATUS_UNSUPPORTED.
+ */
+  uint8_t getStatusSupport(uint8_t devId);
+
+/**
+ * \par Function
+ *   beginCapture
+ * \par Description
+ *   Starts recording every byte written to and read from the servos with a timestamp in us into a ring
+ *   buffer. When the buffer is full, the oldest bytes are overwritten.
+ * \param[in]
+ *   *buffer - memory for the recorded bytes, e.g. a static array.
+ * \param[in]
+ *   size - number of entries of buffer.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Frames are recorded when they are handed to the port, received bytes when the driver reads them, so the
+ *   times include the latency of the UART driver. Print the recording with printCapture().
+ */
+  void beginCapture(servo_capture_type *buffer,uint16_t size);
+
+/**
+ * \par Function
+ *   endCapture
+ * \par Description
+ *   Stops recording, the recorded bytes are kept for printCapture().
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void endCapture(void);
+
+/**
+ * \par Function
+ *   getCaptureCount
+ * \par Description
+ *   Returns the number of bytes in the capture buffer.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   number of recorded bytes, at most the size of the buffer.
+ * \par Others
+ *   None
+ */
+  uint16_t getCaptureCount(void);
+
+/**
+ * \par Function
+ *   printCapture
+ * \par Description
+ *   Prints the recorded bytes, the oldest first, one per line as time in us, T (to the servos) or R (from
+ *   the servos) and the byte in hex. The lines can be decoded with extras/host/decode_capture.
+ * \param[in]
+ *   out - where to print, e.g. Serial.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Stop the recording with endCapture() before, otherwise printing the capture adds to it.
+ */
+  void printCapture(Print &out);
+
+#ifdef ESP32
+/**
+ * \par Function
+ *   beginReceiveTask
+ * \par Description
+ *   Starts a FreeRTOS task which reads and processes all responses of the servos in the background.
+ *   Received values are stored and transactions are finished without a caller polling the port,
+ *   waiting functions block on the task instead of busy waiting.
+ * \param[in]
+ *   *uart - the hardware serial of the port. If given, the task is woken by its receive event
+ *   (arduino-esp32 2.0.3 or newer), otherwise it checks the port every SMART_SERVO_RX_POLL_MS(Optional parameters).
+ * \param[in]
+ *   priority - priority of the task(Optional parameters).
+ * \param[in]
+ *   core - the core the task runs on, tskNO_AFFINITY for any(Optional parameters).
+ * \par Output
+ *   None
+ * \return
+ *   true if the task is running.
+ * \par Others
+ *   Transaction callbacks are called from the receive task once it runs.
+ */
+  bool beginReceiveTask(HardwareSerial *uart = NULL,UBaseType_t priority = 5,BaseType_t core = tskNO_AFFINITY);
+#endif
+
+private:
+/**
+ * \par Function
+ *   measureTuneCost
+ * \par Description
+ *   Measures the step responses of the current gains in both directions for tunePid().
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   angleA - first angle, the servo stands there.
+ * \param[in]
+ *   angleB - second angle.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   *response - the worse step response of both directions is written to it.
+ * \param[in]
+ *   *cost - cost of the gains is written to it: settle time plus SMART_SERVO_TUNE_OVERSHOOT_COST per degree overshoot.
+ * \par Output
+ *   None
+ * \return
+ *   false if one of both step responses failed with a bus error.
+ * \par Others
+ *   The servo stands at angleA again afterwards.
+ */
+  bool measureTuneCost(uint8_t devId,long angleA,long angleB,float speed,servo_step_response_type *response,unsigned long *cost);
+
+/**
+ * \par Function
+ *   stepResponseCost
+ * \par Description
+ *   Rates a step response for tunePid().
+ * \param[in]
+ *   *response - the measured step response.
+ * \par Output
+ *   None
+ * \return
+ *   settle time (SMART_SERVO_TUNE_TIMEOUT if not settled) plus SMART_SERVO_TUNE_OVERSHOOT_COST per degree overshoot.
+ * \par Others
+ *   None
+ */
+  static unsigned long stepResponseCost(const servo_step_response_type *response);
+
+/**
+ * \par Function
+ *   beginTransaction
+ * \par Description
+ *   Reserves a transaction slot before a frame is sent. If all slots are in use, it waits until the oldest
+ *   pending transaction finishes or times out.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   srv_id - the service id of the expected response.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \param[in]
+ *   callback - callback function when the transaction finishes.
+ * \par Output
+ *   None
+ * \return
+ *   Handle of the transaction.
+ * \par Others
+ *   None
+ */
+  smartServoHandle beginTransaction(uint8_t dev_id,uint8_t srv_id,uint8_t cmd,smartServoTransactionCb callback);
+
+/**
+ * \par Function
+ *   finishTransaction
+ * \par Description
+ *   Marks the oldest pending transaction matching a received response as done.
+ * \param[in]
+ *   dev_id - the device id of the response.
+ * \param[in]
+ *   srv_id - the service id of the response.
+ * \param[in]
+ *   cmd - the secondary command of the response (ignored for CTL_ERROR_CODE).
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void finishTransaction(uint8_t dev_id,uint8_t srv_id,uint8_t cmd);
+
+/**
+ * \par Function
+ *   checkTransactionTimeouts
+ * \par Description
+ *   Sends the frame of pending transactions without response in time again, or marks them as failed
+ *   after getMaxRetries() retries.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void checkTransactionTimeouts(void);
+
+/**
+ * \par Function
+ *   failTransaction
+ * \par Description
+ *   Marks a pending transaction as failed and notifies its callback.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   A failed GET_SERVO_STATUS request of a device with unknown support marks it SERVO_STATUS_UNSUPPORTED.
+ */
+  void failTransaction(servo_transaction_type *trans);
+
+/**
+ * \par Function
+ *   rejectStatusRequest
+ * \par Description
+ *   Fails the pending GET_SERVO_STATUS request of a device which answered with an error code.
+ * \param[in]
+ *   dev_id - the device id of servo which sent the error code.
+ * \par Output
+ *   None
+ * \return
+ *   true if the error code belongs to the status request.
+ * \par Others
+ *   The error code belongs to a command if one is pending for the device.
+ */
+  bool rejectStatusRequest(uint8_t dev_id);
+
+/**
+ * \par Function
+ *   captureBytes
+ * \par Description
+ *   Adds bytes to the capture buffer if a capture runs.
+ * \param[in]
+ *   *data - the bytes.
+ * \param[in]
+ *   length - number of bytes.
+ * \param[in]
+ *   dir - SERVO_CAPTURE_TX or SERVO_CAPTURE_RX.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void captureBytes(const uint8_t *data,uint16_t length,uint8_t dir);
+
+/**
+ * \par Function
+ *   sendRequestFrame
+ * \par Description
+ *   Writes a read request frame for the given secondary command.
+ * \param[in]
+ *   handle - the handle returned by beginTransaction().
+ * \param[in]
+ *   devId - the device id of servo that we want to read from.
+ * \param[in]
+ *   cmd - the secondary command of the request.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void sendRequestFrame(smartServoHandle handle,uint8_t devId,uint8_t cmd);
+
+/**
+ * \par Function
+ *   beginFrame
+ * \par Description
+ *   Starts a new frame with START_SYSEX, device id and service id.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   srv_id - the service id of the frame.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void beginFrame(servo_frame_type *frame,uint8_t dev_id,uint8_t srv_id);
+
+/**
+ * \par Function
+ *   frameAddRaw
+ * \par Description
+ *   Appends a byte which is already 7bit (command, mode, ...) to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the byte to append.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void frameAddRaw(servo_frame_type *frame,uint8_t val);
+
+/**
+ * \par Function
+ *   frameAddByte
+ * \par Description
+ *   Appends (1byte 8bit) data as 2byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the byte data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void frameAddByte(servo_frame_type *frame,uint8_t val);
+
+/**
+ * \par Function
+ *   frameAddShort
+ * \par Description
+ *   Appends (2byte short) data as 2byte or 3byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the short data to be converted.
+ * \param[in]
+ *   ignore_high - is there have third byte high-level data.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void frameAddShort(servo_frame_type *frame,int16_t val,bool ignore_high);
+
+/**
+ * \par Function
+ *   frameAddFloat
+ * \par Description
+ *   Appends (4byte float) data as 5byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the float data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void frameAddFloat(servo_frame_type *frame,float val);
+
+/**
+ * \par Function
+ *   frameAddLong
+ * \par Description
+ *   Appends (4byte long) data as 5byte 7bit data to the frame.
+ * \param[in]
+ *   *frame - the frame to be built.
+ * \param[in]
+ *   val - the long data to be converted.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void frameAddLong(servo_frame_type *frame,long val);
+
+/**
+ * \par Function
+ *   sendTransactionFrame
+ * \par Description
+ *   Sends the frame of a transaction and keeps a copy of it for retries.
+ * \param[in]
+ *   handle - the handle returned by beginTransaction().
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void sendTransactionFrame(smartServoHandle handle,servo_frame_type *frame);
+
+/**
+ * \par Function
+ *   finishFrame
+ * \par Description
+ *   Appends checksum and END_SYSEX to a frame.
+ * \param[in]
+ *   *frame - the frame to be finished.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void finishFrame(servo_frame_type *frame);
+
+/**
+ * \par Function
+ *   countLinkEvent
+ * \par Description
+ *   Counts a sent frame, a retry or a failed transaction for the device it belongs to (every device for ALL_DEVICE).
+ * \param[in]
+ *   dev_id - the device id the frame was sent to.
+ * \param[in]
+ *   event - LINK_EVENT_SENT, LINK_EVENT_RETRY or LINK_EVENT_TIMEOUT.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void countLinkEvent(uint8_t dev_id,uint8_t event);
+
+/**
+ * \par Function
+ *   updateRoundTripTime
+ * \par Description
+ *   Adds a round trip time sample to the smoothed round trip time and its deviation and
+ *   sets the timeout of the device to srtt + 4 * rttvar.
+ * \param[in]
+ *   devId - the device id of the servo.
+ * \param[in]
+ *   rtt - time in ms between sending the frame and receiving the response.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Same estimator as TCP (RFC 6298), srtt is stored in 1/8 ms and rttvar in 1/4 ms.
+ */
+  void updateRoundTripTime(uint8_t devId,unsigned long rtt);
+
+/**
+ * \par Function
+ *   transactionTimeout
+ * \par Description
+ *   Returns the time a transaction waits for its response before the frame is sent again.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   timeout in ms, doubled for every retry and limited to SMART_SERVO_CMD_TIMEOUT.
+ * \par Others
+ *   ALL_DEVICE transactions use the longest timeout of all devices.
+ */
+  unsigned long transactionTimeout(const servo_transaction_type *trans);
+
+/**
+ * \par Function
+ *   writeFrame
+ * \par Description
+ *   Counts a finished frame and writes it to the port with one write call.
+ * \param[in]
+ *   *frame - the frame to be written.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void writeFrame(const servo_frame_type *frame);
+
+/**
+ * \par Function
+ *   serviceIndex
+ * \par Description
+ *   Returns the index of a service id in the service statistics.
+ * \param[in]
+ *   srv_id - the service id.
+ * \par Output
+ *   None
+ * \return
+ *   index, SMART_SERVO_STAT_SERVICES for a service id without statistics.
+ * \par Others
+ *   None
+ */
+  uint8_t serviceIndex(uint8_t srv_id);
+
+/**
+ * \par Function
+ *   latencyBucket
+ * \par Description
+ *   Returns the histogram bucket of a latency.
+ * \param[in]
+ *   latency - time in ms.
+ * \par Output
+ *   None
+ * \return
+ *   index of the bucket.
+ * \par Others
+ *   None
+ */
+  uint8_t latencyBucket(unsigned long latency);
+
+/**
+ * \par Function
+ *   printHistogram
+ * \par Description
+ *   Prints the counts of a latency histogram separated by '/'.
+ * \param[in]
+ *   out - where the text is printed to.
+ * \param[in]
+ *   *latency - the histogram.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void printHistogram(Print &out,const uint32_t *latency);
+
+/**
+ * \par Function
+ *   sendFrame
+ * \par Description
+ *   Appends checksum and END_SYSEX and writes the whole frame to the port with one write call.
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void sendFrame(servo_frame_type *frame);
+
+/**
+ * \par Function
+ *   sendStreamFrame
+ * \par Description
+ *   Writes a frame without transaction and counts the acknowledge it will cause.
+ * \param[in]
+ *   dev_id - the device id the frame is sent to.
+ * \param[in]
+ *   *frame - the frame to be sent.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void sendStreamFrame(uint8_t dev_id,servo_frame_type *frame);
+
+/**
+ * \par Function
+ *   isSysexMessageValid
+ * \par Description
+ *   Checks the length and the 7bit checksum of the received sysex message.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   true if the checksum matches the sum of device id, service id and payload.
+ * \par Others
+ *   None
+ */
+  bool isSysexMessageValid(void);
+
+/**
+ * \par Function
+ *   dropSysexMessage
+ * \par Description
+ *   Counts a dropped sysex message and sends the oldest pending request of the device it came from again,
+ *   instead of waiting for its timeout.
+ * \param[in]
+ *   checksumError - true for a checksum error, false for a broken frame (start byte or invalid byte inside the frame).
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   The device id of a broken frame is only a guess, a wrong guess costs one duplicate request.
+ *   Has to be called with the lock held.
+ */
+  void dropSysexMessage(bool checksumError);
+
+/**
+ * \par Function
+ *   retryTransaction
+ * \par Description
+ *   Sends the frame of a pending transaction again if it has retries left.
+ * \param[in]
+ *   *trans - the transaction.
+ * \par Output
+ *   None
+ * \return
+ *   true if the frame was sent again.
+ * \par Others
+ *   Relative moves are never sent again.
+ */
+  bool retryTransaction(servo_transaction_type *trans);
+
+/**
+ * \par Function
+ *   processReceivedBytes
+ * \par Description
+ *   Reads all available bytes from the port and processes complete sysex messages.
+ *   Messages with a wrong checksum are dropped, a start byte always begins a new message.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   Has to be called with the lock held.
+ */
+  void processReceivedBytes(void);
+
+/**
+ * \par Function
+ *   waitForResponse
+ * \par Description
+ *   Called by waiting loops. Blocks until the receive task processed a response (at most one tick),
+ *   does nothing if there is no receive task.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void waitForResponse(void);
+
+/**
+ * \par Function
+ *   lock
+ * \par Description
+ *   Locks the receive state and the transaction table against the receive task. Recursive.
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void lock(void);
+
+/**
+ * \par Function
+ *   unlock
+ * \par Description
+ *   Releases the lock taken with lock().
+ * \param[in]
+ *   None
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void unlock(void);
+
+/**
+ * \par Function
+ *   setMoveState
+ * \par Description
+ *   Sets the move state of a device (or of all devices for ALL_DEVICE) before a move command is sent.
+ * \param[in]
+ *   dev_id - the device id of servo.
+ * \param[in]
+ *   state - MOVE_STATE_IDLE, MOVE_STATE_MOVING or MOVE_STATE_UNTRACKED.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  void setMoveState(uint8_t dev_id,uint8_t state);
+
+/**
+ * \par Function
+ *   setReportDeadline
+ * \par Description
+ *   Sets the time by which the arrival report of an angle move is expected, see isReportOverdue().
+ * \param[in]
+ *   dev_id - the device id of servo, ALL_DEVICE for all devices.
+ * \param[in]
+ *   angle_value - the angle of the move.
+ * \param[in]
+ *   speed - move speed value(The unit is rpm).
+ * \param[in]
+ *   absolute - true if angle_value is an absolute angle, false if it is relative.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   The travel of an absolute move is estimated from the last angle read from the device.
+ */
+  void setReportDeadline(uint8_t dev_id,long angle_value,float speed,bool absolute);
+
+#ifdef ESP32
+/**
+ * \par Function
+ *   receiveTask
+ * \par Description
+ *   Body of the receive task started by beginReceiveTask().
+ * \param[in]
+ *   *arg - the MakeblockSmartServoBase object.
+ * \par Output
+ *   None
+ * \return
+ *   None
+ * \par Others
+ *   None
+ */
+  static void receiveTask(void *arg);
+
+  TaskHandle_t rxTaskHandle = NULL;
+  SemaphoreHandle_t busLock = NULL;
+  SemaphoreHandle_t responseEvent = NULL;
+#endif
+
+  union sysex_message sysex;
+  volatile int16_t sysexBytesRead;
+  volatile uint8_t servo_num_max;
+  volatile uint16_t resFlag;
+  servo_device_state_type *devices;   // values of the devices 1 to maxDevices, stored by MakeblockSmartServo<N>
+  uint8_t maxDevices;
+  uint16_t cacheTTL[SERVO_FIELD_COUNT] = {0, 0, SMART_SERVO_SLOW_FIELD_TTL, SMART_SERVO_SLOW_FIELD_TTL, 0};
+  volatile long cmdTimeOutValue;
+  volatile bool parsingSysex;
+  servo_transaction_type transactions[SMART_SERVO_MAX_PENDING] = {};
+  uint8_t nextTransaction = 0;
+  uint16_t transactionOrder = 0;
+  uint8_t maxRetries = SMART_SERVO_DEFAULT_RETRIES;
+  servo_bus_stats_type busStats = {};
+  servo_service_stats_type serviceStats[SMART_SERVO_STAT_SERVICES] = {};
+  smartServoCb _callback;
+  Stream* port;
+  servo_capture_type *capture = NULL;  // ring buffer of beginCapture(), NULL if no capture runs
+  uint16_t captureSize = 0;
+  uint16_t captureHead = 0;            // index the next byte is recorded at
+  uint16_t captureCount = 0;
+  uint32_t captureLost = 0;            // bytes overwritten since beginCapture()
+  bool capturing = false;
+};
+
+/**
+ * Class: MakeblockSmartServo
+ * \par Description
+ * Smart servo bus which stores the values of the devices 1 to N.
+ * The storage is sized at compile time, so a robot only pays for the servos it has.
+ * Devices with a higher id can still be moved but their values are not stored.
+ */
+template<uint8_t N = SMART_SERVO_MAX_DEVICES>
+class MakeblockSmartServo : public MakeblockSmartServoBase
+{
+  static_assert((N >= 1) && (N < 0x80), "MakeblockSmartServo: number of devices has to be 1 to 127");
+
+public:
+#ifndef ME_PORT_DEFINED
+  MakeblockSmartServo() : MakeblockSmartServoBase(deviceStates, N), deviceStates() {}
+#else // ME_PORT_DEFINED
+  MakeblockSmartServo() : MakeblockSmartServoBase(deviceStates, N), deviceStates() {}
+  MakeblockSmartServo(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic)
+    : MakeblockSmartServoBase(deviceStates, N, receivePin, transmitPin, inverse_logic), deviceStates() {}
+#endif // ME_PORT_DEFINED
+
+  static const uint8_t deviceCount = N;    //!< number of devices values are stored for
+
+  using MakeblockSmartServoBase::getDeviceData;
+
+/**
+ * \par Function
+ *   getDeviceData
+ * \par Description
+ *   Get a consistent copy of the stored values of device DEV_ID, the id is checked at compile time.
+ * \par Output
+ *   None
+ * \return
+ *   the values of the device.
+ * \par Others
+ *   Use getDeviceData(devId) if the id is only known at run time.
+ */
+  template<uint8_t DEV_ID>
+  servo_device_type getDeviceData(void)
+  {
+    static_assert((DEV_ID >= 1) && (DEV_ID <= N), "MakeblockSmartServo: device id out of range");
+    return MakeblockSmartServoBase::getDeviceData(DEV_ID);
+  }
+
+private:
+  servo_device_state_type deviceStates[N];
+};
+
+template<uint8_t N>
+const uint8_t MakeblockSmartServo<N>::deviceCount;
 #endif
@@ -19,13 +19,13 @@
 
 #include "morobot.h"
 
-class morobot_2d:public morobotClass {
+class morobot_2d:private morobotStorage<2>, public morobotClass {
 	public:
 		/**
 		 *  \brief Constructor of morobot_2d class
-		 *  \details The value in brakets defines that the robot consists of two smartservos
+		 *  \details The values in brakets and of morobotStorage<> define that the robot consists of two smartservos
 		 */
-		morobot_2d() : morobotClass(2){memcpy(_robotJointLimits, _jointLimits, 3*2*sizeof(long)); memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
+		morobot_2d() : morobotStorage<2>(_defaultJointLimits), morobotClass(getStorage()){memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
 		
 		/**
 		 *  \brief Set the position of the TCP (tool center point) with respect to the center of the flange of the last robot axis.
@@ -38,7 +38,7 @@ class morobot_2d:public morobotClass {
 		
 		/**
 		 *  \brief Checks if a given angle can be reached by the joint. Each joint has a specific limit to protect the robot's mechanics.
-		 *  		The joint limits are predefined in the private variable _jointLimits
+		 *  		The joint limits are predefined in the private variable _defaultJointLimits
 		 *  \param [in] servoId Number of motor to move (first motor has ID 0)
 		 *  \param [in] angle Angle to move the robot to in degrees
 		 *  \return Returns true if the position is reachable; false if it is not.
@@ -73,7 +73,7 @@ class morobot_2d:public morobotClass {
 
 	private:
 		float _tcpOffset[3];	//!< Position of the TCP (tool center point) with respect to the center of the flange of the last robot axis
-		long _jointLimits[3][2] = {{-110, 135}, {-72, 24}, {0, 0}};		//!< Limits for all joints
+		static constexpr long _defaultJointLimits[2][2] = {{-110, 135}, {-72, 24}};		//!< Limits for all joints, copied into morobotStorage
 		uint8_t _axisLimits[3][2] = {{-20, 280}, {74.24, 74.24}, {110, 240}};	//!< Limits of x, y, z axis
 		
 		float x_def_offset = 40.96;			//!< Default offset from side of robot to first motor
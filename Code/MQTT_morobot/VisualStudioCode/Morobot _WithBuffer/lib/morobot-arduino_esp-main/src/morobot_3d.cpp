@@ -16,6 +16,8 @@
  
 #include "morobot_3d.h"
 
+constexpr long morobot_3d::_defaultJointLimits[3][2];
+
 void morobot_3d::setTCPoffset(float xOffset, float yOffset, float zOffset){
 	// Add given tcp-offset and default offsets
 	_tcpOffset[0] = xOffset;
@@ -106,9 +108,11 @@ void morobot_3d::updateTCPpose(bool output){
 	waitUntilIsReady();
 	
 	// Recalculate angles because of motor mounting orientations
-	float theta1 = getActAngle(0);
-	float theta2 = getActAngle(1);
-	float theta3 = getActAngle(2);
+	long actAngles[NUM_MAX_SERVOS];
+	if (getActAngles(actAngles) == false) return;
+	float theta1 = actAngles[0];
+	float theta2 = actAngles[1];
+	float theta3 = actAngles[2];
 	theta1 = convertToRad(theta1);
 	theta2 = convertToRad(theta2);
 	theta3 = convertToRad(theta3);
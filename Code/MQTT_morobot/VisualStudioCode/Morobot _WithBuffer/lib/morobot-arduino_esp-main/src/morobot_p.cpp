@@ -17,6 +17,8 @@
  
 #include "morobot_p.h"
 
+constexpr long morobot_p::_defaultJointLimits[3][2];
+
 void morobot_p::setTCPoffset(float xOffset, float yOffset, float zOffset){
 	// Instead of using the tcp-offset in x-direction, make the last link longer (but store the offset just to be sure)
 	_tcpOffset[0] = xOffset;
@@ -122,9 +124,11 @@ void morobot_p::updateTCPpose(bool output){
 	waitUntilIsReady();
 	
 	// Get motor angles
-	float theta1 = getActAngle(0);
-	float theta2 = getActAngle(1);
-	float theta3 = -getActAngle(2);
+	long actAngles[NUM_MAX_SERVOS];
+	if (getActAngles(actAngles) == false) return;
+	float theta1 = actAngles[0];
+	float theta2 = actAngles[1];
+	float theta3 = -actAngles[2];
 	
 	// Recalculate angles and convert to radians
     theta3 = theta3 - 90 - theta2;
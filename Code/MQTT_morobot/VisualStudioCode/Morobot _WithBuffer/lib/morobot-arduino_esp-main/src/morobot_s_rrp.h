@@ -6,7 +6,7 @@
  *  @date	2020/11/27
  *  \par Method List:
  *  	public:
- *  		morobot_s_rrp() : morobotClass(3){};
+ *  		morobot_s_rrp() : morobotStorage<3>(_defaultJointLimits), morobotClass(getStorage()){};
 			virtual void setTCPoffset(float xOffset, float yOffset, float zOffset);
 			virtual bool checkIfAngleValid(uint8_t servoId, float angle);
 			bool checkIfAnglesValid(float phi1, float phi2, float phi3);
@@ -21,13 +21,13 @@
 
 #include "morobot.h"
 
-class morobot_s_rrp:public morobotClass {
+class morobot_s_rrp:private morobotStorage<3>, public morobotClass {
 	public:
 		/**
 		 *  \brief Constructor of morobot_s_rrp class
-		 *  \details The value in brakets defines that the robot consists of three smartservos
+		 *  \details The values in brakets and of morobotStorage<> define that the robot consists of three smartservos
 		 */
-		morobot_s_rrp() : morobotClass(3){memcpy(_robotJointLimits, _jointLimits, 3*2*sizeof(long)); memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
+		morobot_s_rrp() : morobotStorage<3>(_defaultJointLimits), morobotClass(getStorage()){memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
 		
 		/**
 		 *  \brief Set the position of the TCP (tool center point) with respect to the center of the flange of the last robot axis.
@@ -42,7 +42,7 @@ class morobot_s_rrp:public morobotClass {
 		
 		/**
 		 *  \brief Checks if a given angle can be reached by the joint. Each joint has a specific limit to protect the robot's mechanics.
-		 *  		The joint limits are predefined in the private variable _jointLimits
+		 *  		The joint limits are predefined in the private variable _defaultJointLimits
 		 *  \param [in] servoId Number of motor to move (first motor has ID 0)
 		 *  \param [in] angle Angle to move the robot to in degrees
 		 *  \return Returns true if the position is reachable; false if it is not.
@@ -94,7 +94,7 @@ class morobot_s_rrp:public morobotClass {
 
 	private:
 		float _tcpOffset[3];	//!< Position of the TCP (tool center point) with respect to the center of the flange of the last robot axis
-		long _jointLimits[3][2] = {{-100, 100}, {-100, 100}, {0, 780}};		//!< Limits for all joints
+		static constexpr long _defaultJointLimits[3][2] = {{-100, 100}, {-100, 100}, {0, 780}};		//!< Limits for all joints, copied into morobotStorage
 		uint8_t _axisLimits[3][2] = {{-35, 210}, {-165, 165}, {-40, 0}};	//!< Limits of x, y, z axis
 	
 		float a = 47.0;				//!< Length from mounting to first axis
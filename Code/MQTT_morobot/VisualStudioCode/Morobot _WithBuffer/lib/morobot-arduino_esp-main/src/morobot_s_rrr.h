@@ -20,13 +20,13 @@
 
 #include "morobot.h"
 
-class morobot_s_rrr:public morobotClass {
+class morobot_s_rrr:private morobotStorage<3>, public morobotClass {
 	public:
 		/**
 		 *  \brief Constructor of morobot_s_rrr class
-		 *  \details The value in brakets defines that the robot consists of three smartservos
+		 *  \details The values in brakets and of morobotStorage<> define that the robot consists of three smartservos
 		 */
-		morobot_s_rrr() : morobotClass(3){memcpy(_robotJointLimits, _jointLimits, 3*2*sizeof(long)); memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
+		morobot_s_rrr() : morobotStorage<3>(_defaultJointLimits), morobotClass(getStorage()){memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};
 		
 		/**
 		 *  \brief Set the position of the TCP (tool center point) with respect to the center of the flange of the last robot axis.
@@ -41,7 +41,7 @@ class morobot_s_rrr:public morobotClass {
 		
 		/**
 		 *  \brief Checks if a given angle can be reached by the joint. Each joint has a specific limit to protect the robot's mechanics.
-		 *  		The joint limits are predefined in the private variable _jointLimits
+		 *  		The joint limits are predefined in the private variable _defaultJointLimits
 		 *  \param [in] servoId Number of motor to move (first motor has ID 0)
 		 *  \param [in] angle Angle to move the robot to in degrees
 		 *  \return Returns true if the position is reachable; false if it is not.
@@ -86,7 +86,7 @@ class morobot_s_rrr:public morobotClass {
 
 	private:
 		float _tcpOffset[3];		//!< Position of the TCP (tool center point) with respect to the center of the flange of the last robot axis
-		long _jointLimits[3][2] = {{-100, 100}, {-100, 100}, {-180, 180}};		//!< Limits for all joints
+		static constexpr long _defaultJointLimits[3][2] = {{-100, 100}, {-100, 100}, {-180, 180}};		//!< Limits for all joints, copied into morobotStorage
 		uint8_t _axisLimits[3][2] = {{-100, 100}, {-100, 100}, {-50, 50}};		//!< Limits of x, y, z axis
 		
 		float a = 47.0;				//!< Length from mounting to first axis
@@ -19,13 +19,13 @@
 
 #include <morobot.h>
 
-class newRobotClass_Template:public morobotClass {
+class newRobotClass_Template:private morobotStorage<3>, public morobotClass {
 	public:
 		/**
 		 *  \brief Constructor of newRobotClass_Template class
-		 *  \details The value in brakets defines the number of smart servo motors
+		 *  \details The values in brakets and of morobotStorage<> define the number of smart servo motors
 		 */
-		newRobotClass_Template() : morobotClass(3){memcpy(_robotJointLimits, _jointLimits, 3*2*sizeof(long)); memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};	// TODO: PUT THE NUMBER OF SERVOS HERE
+		newRobotClass_Template() : morobotStorage<3>(_defaultJointLimits), morobotClass(getStorage()){memcpy(_robotAxisLimits, _axisLimits, 3*2*sizeof(uint8_t));};	// TODO: PUT THE NUMBER OF SERVOS HERE AND IN morobotStorage<>
 		
 		/**
 		 *  \brief Set the position of the TCP (tool center point) with respect to the center of the flange of the last robot axis.
@@ -40,7 +40,7 @@ class newRobotClass_Template:public morobotClass {
 		
 		/**
 		 *  \brief Checks if a given angle can be reached by the joint. Each joint has a specific limit to protect the robot's mechanics.
-		 *  		The joint limits are predefined in the private variable _jointLimits
+		 *  		The joint limits are predefined in the private variable _defaultJointLimits
 		 *  \param [in] servoId Number of motor to move (first motor has ID 0)
 		 *  \param [in] angle Angle to move the robot to in degrees
 		 *  \return Returns true if the position is reachable; false if it is not.
@@ -75,7 +75,7 @@ class newRobotClass_Template:public morobotClass {
 
 	private:
 		float _tcpOffset[3];	//!< Position of the TCP (tool center point) with respect to the center of the flange of the last robot axis
-		long _jointLimits[3][2] = {{-100, 100}, {-100, 100}, {0, 780}};		//!< Limits for all joints
+		static constexpr long _defaultJointLimits[3][2] = {{-100, 100}, {-100, 100}, {0, 780}};		//!< Limits for all joints, copied into morobotStorage
 		uint8_t _axisLimits[3][2] = {{-100, 100}, {-100, 100}, {-50, 50}};	//!< Limits of x, y, z axis
 				// TODO: CHANGE THE NUMBER OF SERVOS AND THE LIMITS HERE
 		
@@ -0,0 +1,23 @@
+/**
+ * @file    Servo.h
+ * @brief   Servo library of the host Arduino API (see Arduino.h in this folder), for the grippers in eef.h.
+ *
+ * The grippers driven by a hobby servo only remember the last angle, there is no pin on the host.
+ */
+#ifndef HOST_SERVO_H
+#define HOST_SERVO_H
+
+#include <stdint.h>
+
+class Servo
+{
+public:
+  Servo() : angle(0) {}
+  uint8_t attach(int pin) { (void)pin; return 1; }
+  void write(int value) { angle = value; }
+  int read(void) { return angle; }
+private:
+  int angle;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file    bench_cycle_time.cpp
+ * @brief   Host benchmark: cycle time and bus utilisation of the smart servo driver against the emulator.
+ *
+ * One cycle is a typical sorting move of a 3 joint robot: all joints are sent to a goal with one burst of
+ * SET_SERVO_ABSOLUTE_ANGLE_LONG commands, the program waits for the arrival reports, reads the telemetry of all
+ * joints and moves back. The time of the cycle is split into the time spent waiting for the motion and the time
+ * spent on the bus, so the overhead of the driver and the protocol can be compared between baud rates and
+ * between reading the telemetry with five single requests or one GET_SERVO_STATUS request per joint.
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -I. -I../../src bench_cycle_time.cpp smart_servo_emulator.cpp arduino_host.cpp ../../src/MakeblockSmartServo.cpp -o bench_cycle_time
+ *   ./bench_cycle_time [cycles] [baud rate] [response loss 0..1] [status 0/1] [capture file]
+ *
+ * With a capture file, the traffic of the last cycles is recorded with beginCapture() and written to the file
+ * for decode_capture.
+ */
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include "smart_servo_emulator.h"
+#include <stdio.h>
+
+#define BENCH_JOINTS 3
+#define BENCH_SPEED  50    // rpm
+#define BENCH_CAPTURE_SIZE 16384  // entries of the capture ring, one per byte on the bus
+
+class StdoutPrint : public Print
+{
+public:
+  size_t write(uint8_t val) { return (putchar(val) == EOF) ? 0 : 1; }
+};
+
+class FilePrint : public Print
+{
+public:
+  explicit FilePrint(FILE *file) : file(file) {}
+  size_t write(uint8_t val) { return (fputc(val, file) == EOF) ? 0 : 1; }
+private:
+  FILE *file;
+};
+
+static servo_capture_type capture[BENCH_CAPTURE_SIZE];
+
+static const uint8_t joints[BENCH_JOINTS] = {1, 2, 3};
+static const long goals[2][BENCH_JOINTS] = {{30, -20, 15}, {0, 0, 0}};
+
+// Sends all joints to their goals and waits for the acknowledges, returns false if one is missing
+static bool moveJoints(MakeblockSmartServo<BENCH_JOINTS> &servos, const long *angles)
+{
+  smartServoHandle handles[BENCH_JOINTS];
+  uint8_t i;
+  for(i = 0; i < BENCH_JOINTS; i++)
+  {
+    handles[i] = servos.moveToAsync(joints[i], angles[i], BENCH_SPEED);
+  }
+  return servos.waitForAll(handles, BENCH_JOINTS);
+}
+
+// Reads all telemetry fields of all joints with one burst of requests
+static bool readTelemetry(MakeblockSmartServo<BENCH_JOINTS> &servos, bool status)
+{
+  static const uint8_t cmds[] = {GET_SERVO_CUR_ANGLE, GET_SERVO_SPEED, GET_SERVO_VOLTAGE, GET_SERVO_TEMPERATURE, GET_SERVO_ELECTRIC_CURRENT};
+  smartServoHandle handles[BENCH_JOINTS * sizeof(cmds)];
+  uint8_t count = 0;
+  uint8_t i;
+  uint8_t j;
+  for(i = 0; i < BENCH_JOINTS; i++)
+  {
+    if((status == true) && (servos.getStatusSupport(joints[i]) != SERVO_STATUS_UNSUPPORTED))
+    {
+      handles[count++] = servos.requestAsync(joints[i], GET_SERVO_STATUS);
+      continue;
+    }
+    for(j = 0; j < sizeof(cmds); j++)
+    {
+      handles[count++] = servos.requestAsync(joints[i], cmds[j]);
+    }
+  }
+  return servos.waitForAll(handles, count);
+}
+
+int main(int argc, char **argv)
+{
+  long cycles = (argc > 1) ? atol(argv[1]) : 10;
+  long baudRate = (argc > 2) ? atol(argv[2]) : SMART_SERVO_DEFAULT_BAUD_RATE;
+  float loss = (argc > 3) ? atof(argv[3]) : 0;
+  bool status = (argc > 4) ? (atoi(argv[4]) != 0) : false;
+  const char *captureFile = (argc > 5) ? argv[5] : NULL;
+  SmartServoEmulator bus(BENCH_JOINTS, baudRate);
+  MakeblockSmartServo<BENCH_JOINTS> servos;
+  StdoutPrint out;
+  unsigned long start;
+  unsigned long busTime = 0;
+  unsigned long motionTime = 0;
+  unsigned long t;
+  long failures = 0;
+  long i;
+  uint8_t k;
+  emulator_stats_type stats;
+
+  printf("%ld cycles, %ld baud, %.0f %% response loss, telemetry with %s\n", cycles, baudRate, loss * 100,
+         status ? "GET_SERVO_STATUS" : "single requests");
+  servos.beginSerial(&bus);
+  if(servos.assignDevIdRequest() == false)
+  {
+    printf("no servos found\n");
+    return 1;
+  }
+  bus.setResponseLoss(loss);
+  servos.resetBusStats();
+  bus.resetStats();
+  if(captureFile != NULL)
+  {
+    servos.beginCapture(capture, BENCH_CAPTURE_SIZE);
+  }
+  start = micros();
+  for(i = 0; i < cycles; i++)
+  {
+    for(k = 0; k < 2; k++)
+    {
+      t = micros();
+      if(moveJoints(servos, goals[k]) == false)
+      {
+        failures++;
+      }
+      busTime += micros() - t;
+      t = micros();
+      if(servos.waitForPositionReached(joints, BENCH_JOINTS, 5000) == false)
+      {
+        failures++;
+      }
+      motionTime += micros() - t;
+      t = micros();
+      if(readTelemetry(servos, status) == false)
+      {
+        failures++;
+      }
+      busTime += micros() - t;
+    }
+  }
+  t = micros() - start;
+  stats = bus.getStats();
+
+  printf("cycle time      %9.2f ms\n", t / 1000.0 / cycles);
+  printf("  motion        %9.2f ms\n", motionTime / 1000.0 / cycles);
+  printf("  bus           %9.2f ms (commands, acknowledges and telemetry)\n", busTime / 1000.0 / cycles);
+  printf("failed steps    %9ld\n", failures);
+  printf("utilisation     %9.1f %% to the servos, %.1f %% from the servos\n", bus.getTxUtilisation() * 100, bus.getRxUtilisation() * 100);
+  printf("emulator        %9u frames received, %u dropped, %u sent, %u lost\n",
+         stats.framesReceived, stats.framesDropped, stats.framesSent, stats.responsesLost);
+  servos.printBusStats(out);
+  if(captureFile != NULL)
+  {
+    FILE *file = fopen(captureFile, "w");
+    servos.endCapture();
+    if(file == NULL)
+    {
+      perror(captureFile);
+      return 1;
+    }
+    FilePrint filePrint(file);
+    servos.printCapture(filePrint);
+    fclose(file);
+  }
+  return (failures == 0) ? 0 : 1;
+}
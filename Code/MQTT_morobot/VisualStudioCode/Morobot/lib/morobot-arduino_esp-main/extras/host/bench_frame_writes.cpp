@@ -0,0 +1,187 @@
+/**
+ * @file    bench_frame_writes.cpp
+ * @brief   Host benchmark: UART driver calls and CPU time per smart servo command.
+ *
+ * Compares the old per-byte sending of a SET_SERVO_ABSOLUTE_ANGLE_LONG frame (one Stream::write per byte,
+ * copied from the driver before the frame builder was added) with MakeblockSmartServo::moveTo(), which
+ * builds the frame in a buffer and sends it with one write call.
+ * The port answers every frame with an acknowledge and burns a fixed time per write call to model the
+ * driver overhead of HardwareSerial on the ESP32 (mutex, ring buffer, TX FIFO handling).
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -I. -I../../src bench_frame_writes.cpp arduino_host.cpp ../../src/MakeblockSmartServo.cpp -o bench_frame_writes
+ *   ./bench_frame_writes [iterations] [driver overhead per write call in ns]
+ */
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock benchClock;
+
+class BenchPort : public Stream
+{
+public:
+  explicit BenchPort(long overheadNs) : writeCalls(0), bytesWritten(0), overhead(overheadNs) {}
+
+  size_t write(uint8_t val)
+  {
+    driverCall();
+    receive(val);
+    return 1;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t i;
+    driverCall();
+    for(i = 0; i < size; i++)
+    {
+      receive(buffer[i]);
+    }
+    return size;
+  }
+
+  int available(void) { return rx.size(); }
+  int read(void)
+  {
+    int val;
+    if(rx.empty())
+    {
+      return -1;
+    }
+    val = rx.front();
+    rx.pop_front();
+    return val;
+  }
+  int peek(void) { return rx.empty() ? -1 : rx.front(); }
+
+  unsigned long writeCalls;
+  unsigned long bytesWritten;
+
+private:
+  void driverCall(void)
+  {
+    benchClock::time_point end = benchClock::now() + std::chrono::nanoseconds(overhead);
+    writeCalls++;
+    while(benchClock::now() < end)
+    {
+    }
+  }
+
+  // Collects the frames sent by the driver and answers them like a chain of 3 servos would
+  void receive(uint8_t val)
+  {
+    bytesWritten++;
+    if(val == START_SYSEX)
+    {
+      frame.clear();
+    }
+    frame.push_back(val);
+    if(val != END_SYSEX || frame.size() < 4)
+    {
+      return;
+    }
+    if(frame[2] == CTL_ASSIGN_DEV_ID)
+    {
+      for(uint8_t dev = 1; dev <= 3; dev++)
+      {
+        answer(dev, CTL_ASSIGN_DEV_ID, 0x00);
+      }
+    }
+    else
+    {
+      answer(frame[1], CTL_ERROR_CODE, PROCESS_SUC);
+    }
+  }
+
+  void answer(uint8_t dev, uint8_t srv, uint8_t value)
+  {
+    rx.push_back(START_SYSEX);
+    rx.push_back(dev);
+    rx.push_back(srv);
+    rx.push_back(value);
+    rx.push_back((dev + srv + value) & 0x7f);
+    rx.push_back(END_SYSEX);
+  }
+
+  long overhead;
+  std::vector<uint8_t> frame;
+  std::deque<uint8_t> rx;
+};
+
+// moveTo as it was sent before the frame builder: every byte is a separate driver call
+static void legacyMoveTo(Stream *port, uint8_t dev_id, long angle_value, float speed)
+{
+  union{ uint8_t byteVal[4]; long longVal; } val4;
+  union{ uint8_t byteVal[2]; short shortVal; } val2;
+  uint8_t checksum;
+  uint8_t b;
+  port->write(START_SYSEX);
+  port->write(dev_id);
+  port->write(SMART_SERVO);
+  port->write(SET_SERVO_ABSOLUTE_ANGLE_LONG);
+  checksum = (dev_id + SMART_SERVO + SET_SERVO_ABSOLUTE_ANGLE_LONG);
+  val4.longVal = angle_value;
+  b = val4.byteVal[0] & 0x7f; port->write(b); checksum += b;
+  b = ((val4.byteVal[1] << 1) | (val4.byteVal[0] >> 7)) & 0x7f; port->write(b); checksum += b;
+  b = ((val4.byteVal[2] << 2) | (val4.byteVal[1] >> 6)) & 0x7f; port->write(b); checksum += b;
+  b = ((val4.byteVal[3] << 3) | (val4.byteVal[2] >> 5)) & 0x7f; port->write(b); checksum += b;
+  b = (val4.byteVal[3] >> 4) & 0x7f; port->write(b); checksum += b;
+  val2.shortVal = (int)speed;
+  b = val2.byteVal[0] & 0x7f; port->write(b); checksum += b;
+  b = ((val2.byteVal[1] << 1) | (val2.byteVal[0] >> 7)) & 0x7f; port->write(b); checksum += b;
+  port->write(checksum & 0x7f);
+  port->write(END_SYSEX);
+}
+
+static void report(const char *name, BenchPort &port, double seconds, long iterations)
+{
+  printf("%-22s %8.2f write calls/cmd %6.2f bytes/cmd %9.3f us/cmd\n", name,
+         (double)port.writeCalls / iterations, (double)port.bytesWritten / iterations,
+         seconds * 1e6 / iterations);
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = (argc > 1) ? atol(argv[1]) : 20000;
+  long overheadNs = (argc > 2) ? atol(argv[2]) : 1000;
+  long i;
+  double seconds;
+  benchClock::time_point start;
+
+  printf("%ld commands, %ld ns driver overhead per write call\n", iterations, overheadNs);
+
+  BenchPort legacyPort(overheadNs);
+  MakeblockSmartServo<3> legacyServo;
+  legacyServo.beginSerial(&legacyPort);
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++)
+  {
+    legacyMoveTo(&legacyPort, 1 + (i % 3), i, 20);
+    legacyServo.smartServoEventHandle();
+  }
+  seconds = std::chrono::duration<double>(benchClock::now() - start).count();
+  report("per byte (before)", legacyPort, seconds, iterations);
+
+  BenchPort framePort(overheadNs);
+  MakeblockSmartServo<3> frameServo;
+  frameServo.beginSerial(&framePort);
+  frameServo.assignDevIdRequest();
+  framePort.writeCalls = 0;
+  framePort.bytesWritten = 0;
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++)
+  {
+    if(frameServo.moveTo(1 + (i % 3), i, 20) == false)
+    {
+      printf("moveTo failed at command %ld\n", i);
+      return 1;
+    }
+  }
+  seconds = std::chrono::duration<double>(benchClock::now() - start).count();
+  report("frame builder (after)", framePort, seconds, iterations);
+  return 0;
+}
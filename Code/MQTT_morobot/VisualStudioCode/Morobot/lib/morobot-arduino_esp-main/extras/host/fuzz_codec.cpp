@@ -0,0 +1,386 @@
+/**
+ * @file    fuzz_codec.cpp
+ * @brief   Host check and benchmark of the 7bit codec and the receive parser of the smart servo driver.
+ *
+ * 1. Round trips random values (and edge cases) of every type through send*()/read*() and compares the encoded
+ *    bytes and checksums with the union based codec of the original Makeblock driver, copied below as reference.
+ * 2. Feeds smartServoEventHandle() random byte streams and mutated frames. After every chunk a valid response is
+ *    sent, which must be decoded correctly: the parser has to resynchronise on START_SYSEX whatever came before.
+ * 3. Measures ns per operation of the encoders and decoders against the reference.
+ *
+ * Any new codec implementation has to pass 1 and 2 before its numbers in 3 mean anything.
+ * Build with -fsanitize=address,undefined to catch out of bounds accesses of the parser.
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -I. -I../../src fuzz_codec.cpp arduino_host.cpp ../../src/MakeblockSmartServo.cpp -o fuzz_codec
+ *   ./fuzz_codec [iterations] [seed]
+ */
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock benchClock;
+
+class CapturePort : public Stream
+{
+public:
+  size_t write(uint8_t val) { tx.push_back(val); return 1; }
+  size_t write(const uint8_t *buffer, size_t size) { tx.insert(tx.end(), buffer, buffer + size); return size; }
+  int available(void) { return rx.size(); }
+  int read(void)
+  {
+    int val;
+    if(rx.empty())
+    {
+      return -1;
+    }
+    val = rx.front();
+    rx.pop_front();
+    return val;
+  }
+  int peek(void) { return rx.empty() ? -1 : rx.front(); }
+
+  std::vector<uint8_t> tx;
+  std::deque<uint8_t> rx;
+};
+
+static uint32_t randomState = 1;
+
+static uint32_t random32(void)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static long failures = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)) { if(failures++ < 20) { printf(__VA_ARGS__); printf("\n"); } } } while(0)
+
+/*
+ * Reference codec of the original driver (one union per size, 4 byte long like on the microcontrollers).
+ */
+namespace reference
+{
+  union { uint8_t byteVal[1]; uint8_t charVal; } val1byte;
+  union { uint8_t byteVal[2]; int16_t shortVal; } val2byte;
+  union { uint8_t byteVal[4]; float floatVal; int32_t longVal; } val4byte;
+
+  uint8_t sendByte(uint8_t val, uint8_t *out)
+  {
+    val1byte.charVal = val;
+    out[0] = val1byte.byteVal[0] & 0x7f;
+    out[1] = (val1byte.byteVal[0] >> 7) & 0x7f;
+    return (out[0] + out[1]) & 0x7f;
+  }
+
+  uint8_t sendShort(int16_t val, bool ignore_high, uint8_t *out)
+  {
+    uint8_t checksum;
+    val2byte.shortVal = val;
+    out[0] = val2byte.byteVal[0] & 0x7f;
+    out[1] = ((val2byte.byteVal[1] << 1) | (val2byte.byteVal[0] >> 7)) & 0x7f;
+    checksum = out[0] + out[1];
+    if(ignore_high == false)
+    {
+      out[2] = (val2byte.byteVal[1] >> 6) & 0x7f;
+      checksum += out[2];
+    }
+    return checksum & 0x7f;
+  }
+
+  uint8_t send4(uint8_t *out)
+  {
+    out[0] = val4byte.byteVal[0] & 0x7f;
+    out[1] = ((val4byte.byteVal[1] << 1) | (val4byte.byteVal[0] >> 7)) & 0x7f;
+    out[2] = ((val4byte.byteVal[2] << 2) | (val4byte.byteVal[1] >> 6)) & 0x7f;
+    out[3] = ((val4byte.byteVal[3] << 3) | (val4byte.byteVal[2] >> 5)) & 0x7f;
+    out[4] = (val4byte.byteVal[3] >> 4) & 0x7f;
+    return (out[0] + out[1] + out[2] + out[3] + out[4]) & 0x7f;
+  }
+
+  uint8_t sendFloat(float val, uint8_t *out) { val4byte.floatVal = val; return send4(out); }
+  uint8_t sendLong(int32_t val, uint8_t *out) { val4byte.longVal = val; return send4(out); }
+
+  uint8_t readByte(const uint8_t *argv)
+  {
+    val1byte.byteVal[0] = (argv[0] & 0x7f) | (uint8_t)(argv[1] << 7);
+    return val1byte.charVal;
+  }
+
+  int16_t readShort(const uint8_t *argv, bool ignore_high)
+  {
+    val2byte.byteVal[0] = (argv[0] & 0x7f) | (uint8_t)(argv[1] << 7);
+    val2byte.byteVal[1] = (argv[1] >> 1) & 0x7f;
+    if(ignore_high == false)
+    {
+      val2byte.byteVal[1] |= (uint8_t)(argv[2] << 6);
+    }
+    return val2byte.shortVal;
+  }
+
+  void read4(const uint8_t *argv)
+  {
+    val4byte.byteVal[0] = (argv[0] & 0x7f) | (uint8_t)(argv[1] << 7);
+    val4byte.byteVal[1] = ((argv[1] >> 1) & 0x7f) + (uint8_t)(argv[2] << 6);
+    val4byte.byteVal[2] = ((argv[2] >> 2) & 0x7f) + (uint8_t)(argv[3] << 5);
+    val4byte.byteVal[3] = ((argv[3] >> 3) & 0x7f) + (uint8_t)(argv[4] << 4);
+  }
+
+  float readFloat(const uint8_t *argv) { read4(argv); return val4byte.floatVal; }
+  int32_t readLong(const uint8_t *argv) { read4(argv); return val4byte.longVal; }
+}
+
+static MakeblockSmartServo<8> servo;
+static CapturePort port;
+
+// Compares the bytes the driver wrote with the reference encoding
+static void checkEncoding(const char *name, uint32_t raw, uint8_t checksum, const uint8_t *expected, uint8_t refChecksum, uint8_t count)
+{
+  uint8_t i;
+  CHECK(port.tx.size() == count, "%s(0x%08x): %u bytes instead of %u", name, raw, (unsigned)port.tx.size(), count);
+  for(i = 0; (i < count) && (i < port.tx.size()); i++)
+  {
+    CHECK(port.tx[i] == expected[i], "%s(0x%08x): byte %u is 0x%02x, reference 0x%02x", name, raw, i, port.tx[i], expected[i]);
+    CHECK(port.tx[i] < 0x80, "%s(0x%08x): byte %u has the high bit set", name, raw, i);
+  }
+  CHECK(checksum == refChecksum, "%s(0x%08x): checksum 0x%02x, reference 0x%02x", name, raw, checksum, refChecksum);
+  port.tx.clear();
+}
+
+static void roundTrip(uint32_t raw)
+{
+  uint8_t ref[5];
+  uint8_t refChecksum;
+  uint8_t checksum;
+  uint8_t b = raw;
+  int16_t s = raw;
+  int32_t l = raw;
+  float f;
+  float back;
+  memcpy(&f, &raw, sizeof(f));
+
+  refChecksum = reference::sendByte(b, ref);
+  checksum = servo.sendByte(b);
+  checkEncoding("sendByte", raw, checksum, ref, refChecksum, 2);
+  CHECK(servo.readByte(ref, 0) == b, "readByte(sendByte(0x%02x)) = 0x%02x", b, servo.readByte(ref, 0));
+
+  refChecksum = reference::sendShort(s, false, ref);
+  checksum = servo.sendShort(s, false);
+  checkEncoding("sendShort", raw, checksum, ref, refChecksum, 3);
+  CHECK(servo.readShort(ref, 0, false) == s, "readShort(sendShort(%d)) = %d", s, servo.readShort(ref, 0, false));
+
+  // Without the high byte only the low 14 bits are transferred
+  refChecksum = reference::sendShort(s, true, ref);
+  checksum = servo.sendShort(s, true);
+  checkEncoding("sendShort(ignore_high)", raw, checksum, ref, refChecksum, 2);
+  CHECK(servo.readShort(ref, 0, true) == reference::readShort(ref, true), "readShort(ignore_high) of %d: %d, reference %d",
+        s, servo.readShort(ref, 0, true), reference::readShort(ref, true));
+  CHECK((servo.readShort(ref, 0, true) & 0x3fff) == (s & 0x3fff), "readShort(sendShort(%d, ignore_high)) lost low bits", s);
+
+  refChecksum = reference::sendLong(l, ref);
+  checksum = servo.sendLong(l);
+  checkEncoding("sendLong", raw, checksum, ref, refChecksum, 5);
+  CHECK(servo.readLong(ref, 0) == l, "readLong(sendLong(%d)) = %ld", l, servo.readLong(ref, 0));
+
+  refChecksum = reference::sendFloat(f, ref);
+  checksum = servo.sendFloat(f);
+  checkEncoding("sendFloat", raw, checksum, ref, refChecksum, 5);
+  back = servo.readFloat(ref, 0);
+  CHECK(memcmp(&back, &f, sizeof(f)) == 0, "readFloat(sendFloat(0x%08x)) changed the bits", raw);
+}
+
+// Random 7bit input, which is all the parser lets through to the decoders
+static void decodeRandom(void)
+{
+  uint8_t in[5];
+  float a;
+  float b;
+  uint8_t i;
+  for(i = 0; i < 5; i++)
+  {
+    in[i] = random32() & 0x7f;
+  }
+  CHECK(servo.readByte(in, 0) == reference::readByte(in), "readByte differs from reference");
+  CHECK(servo.readShort(in, 0, false) == reference::readShort(in, false), "readShort differs from reference");
+  CHECK(servo.readShort(in, 0, true) == reference::readShort(in, true), "readShort(ignore_high) differs from reference");
+  CHECK(servo.readLong(in, 0) == reference::readLong(in), "readLong differs from reference");
+  a = servo.readFloat(in, 0);
+  b = reference::readFloat(in);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0, "readFloat differs from reference");
+}
+
+static void pushAngleResponse(uint8_t dev, int32_t angle)
+{
+  uint8_t data[5];
+  uint8_t checksum = dev + SMART_SERVO + GET_SERVO_CUR_ANGLE + encode7bit<int32_t>(angle, data);
+  uint8_t i;
+  port.rx.push_back(START_SYSEX);
+  port.rx.push_back(dev);
+  port.rx.push_back(SMART_SERVO);
+  port.rx.push_back(GET_SERVO_CUR_ANGLE);
+  for(i = 0; i < 5; i++)
+  {
+    port.rx.push_back(data[i]);
+  }
+  port.rx.push_back(checksum & 0x7f);
+  port.rx.push_back(END_SYSEX);
+}
+
+// Random bytes, then frames with single bytes changed, then a valid response which must be decoded
+static void fuzzParser(long iteration)
+{
+  uint8_t dev = 1 + random32() % 8;
+  int32_t angle = (int32_t)random32();
+  uint16_t length = random32() % 96;
+  uint16_t i;
+  switch(iteration % 3)
+  {
+    case 0:
+      for(i = 0; i < length; i++)
+      {
+        port.rx.push_back(random32());
+      }
+      break;
+    case 1:
+      // valid looking frames with one corrupted byte
+      pushAngleResponse(1 + random32() % 8, random32());
+      port.rx[port.rx.size() - 1 - random32() % 11] = random32();
+      break;
+    default:
+      // random payload between START_SYSEX and END_SYSEX, sometimes longer than the sysex buffer
+      port.rx.push_back(START_SYSEX);
+      for(i = 0; i < length; i++)
+      {
+        port.rx.push_back(random32() & 0x7f);
+      }
+      port.rx.push_back(END_SYSEX);
+      break;
+  }
+  // the stream may be cut anywhere, the next START_SYSEX starts over
+  while(port.rx.size() > 0 && (random32() & 1))
+  {
+    servo.smartServoEventHandle();
+  }
+  pushAngleResponse(dev, angle);
+  servo.smartServoEventHandle();
+  CHECK(port.rx.empty(), "parser did not consume all bytes");
+  CHECK(servo.getDeviceData(dev).angleValue == angle, "response after garbage not decoded (iteration %ld, dev %u)", iteration, dev);
+}
+
+static double nsPerOp(benchClock::time_point start, long ops)
+{
+  return std::chrono::duration<double, std::nano>(benchClock::now() - start).count() / ops;
+}
+
+static volatile uint32_t sink;
+
+static void benchmark(long iterations)
+{
+  uint8_t buf[5];
+  uint8_t in[5] = {0x12, 0x34, 0x56, 0x78, 0x0a};
+  benchClock::time_point start;
+  long i;
+
+  printf("%-14s %10s %10s\n", "ns/op", "driver", "reference");
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += encode7bit<int16_t>((int16_t)i, buf, 3) + buf[2];
+  printf("%-14s %10.2f", "encode short", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += reference::sendShort((int16_t)i, false, buf) + buf[2];
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += encode7bit<int32_t>((int32_t)i, buf) + buf[4];
+  printf("%-14s %10.2f", "encode long", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += reference::sendLong((int32_t)i, buf) + buf[4];
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += encode7bit<float>((float)i, buf) + buf[4];
+  printf("%-14s %10.2f", "encode float", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) sink += reference::sendFloat((float)i, buf) + buf[4];
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += decode7bit<int16_t>(in, 3); }
+  printf("%-14s %10.2f", "decode short", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += reference::readShort(in, false); }
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += decode7bit<int32_t>(in); }
+  printf("%-14s %10.2f", "decode long", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += reference::readLong(in); }
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += (uint32_t)decode7bit<float>(in); }
+  printf("%-14s %10.2f", "decode float", nsPerOp(start, iterations));
+  start = benchClock::now();
+  for(i = 0; i < iterations; i++) { in[0] = i & 0x7f; sink += (uint32_t)reference::readFloat(in); }
+  printf(" %10.2f\n", nsPerOp(start, iterations));
+
+  start = benchClock::now();
+  for(i = 0; i < iterations / 16; i++)
+  {
+    pushAngleResponse(1 + (i & 7), i);
+    servo.smartServoEventHandle();
+  }
+  printf("%-14s %10.2f\n", "parse frame", nsPerOp(start, iterations / 16));
+}
+
+int main(int argc, char **argv)
+{
+  static const uint32_t edges[] = {0x00000000, 0x00000001, 0x0000007f, 0x00000080, 0x000000ff, 0x00003fff, 0x00004000,
+                                   0x00007fff, 0x00008000, 0x0000ffff, 0x7fffffff, 0x80000000, 0xffffffff, 0x7f800000,
+                                   0xff800000, 0x7fc00000, 0x00800000, 0x3f800000};
+  long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+  long i;
+  servo_bus_stats_type stats;
+
+  randomState = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1;
+  if(randomState == 0)
+  {
+    randomState = 1;
+  }
+  servo.beginSerial(&port);
+
+  for(i = 0; i < (long)(sizeof(edges) / sizeof(edges[0])); i++)
+  {
+    roundTrip(edges[i]);
+  }
+  for(i = 0; i < iterations; i++)
+  {
+    roundTrip(random32());
+    decodeRandom();
+  }
+  printf("codec:  %ld random values and %u edge cases per type\n", iterations, (unsigned)(sizeof(edges) / sizeof(edges[0])));
+
+  servo.resetBusStats();
+  for(i = 0; i < iterations / 10; i++)
+  {
+    fuzzParser(i);
+  }
+  stats = servo.getBusStats();
+  printf("parser: %ld chunks, %u frames, %u overflows, %u checksum errors, %u framing errors\n",
+         iterations / 10, stats.framesReceived, stats.overflows, stats.checksumErrors, stats.framingErrors);
+
+  if(failures != 0)
+  {
+    printf("FAILED: %ld checks\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n\n");
+  benchmark(iterations * 10);
+  return 0;
+}
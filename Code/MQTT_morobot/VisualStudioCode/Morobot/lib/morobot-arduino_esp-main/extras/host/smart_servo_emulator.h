@@ -0,0 +1,178 @@
+/**
+ * @file    smart_servo_emulator.h
+ * @brief   Host emulator of a chain of Makeblock smart servos behind a Stream.
+ *
+ * The driver writes its frames to the emulator like to a HardwareSerial. The emulator decodes them with the
+ * protocol definitions of MakeblockSmartServo.h, moves the virtual servos with a speed limited motion model and
+ * sends the responses back. Every byte becomes readable only after the time it needs on the wire at the
+ * configured baud rate, plus the processing time of the servo and the forwarding delay of the servos in front
+ * of it in the chain. So the driver sees the same timing as on the robot and cycle times and bus utilisation
+ * can be measured on a PC.
+ *
+ * Implemented services:
+ *   CTL_ASSIGN_DEV_ID, CTL_SET_BAUD_RATE, CTL_SYSTEM_RESET, CTL_CMD_TEST,
+ *   SMART_SERVO: SET_SERVO_ABSOLUTE_ANGLE(_LONG), SET_SERVO_RELATIVE_ANGLE(_LONG), SET_SERVO_PWM_MOVE,
+ *   SET_SERVO_INIT_ANGLE, SET_SERVO_CURRENT_ANGLE_ZERO_DEGREES, SET_SERVO_BREAK, SET_SERVO_RGB_LED,
+ *   SERVO_SHARKE_HAND, SET_SERVO_CMD_MODE, SET_SERVO_PID, all GET_SERVO_* requests and
+ *   REPORT_WHEN_REACH_THE_SET_POSITION when an angle move has finished.
+ *
+ * With setSettling() an angle move does not stop exactly at the goal: the position controller is modelled as a
+ * damped second order system whose frequency, damping and steady state error under load follow the gains set
+ * with SET_SERVO_PID, so PID tuning can be tried on the PC.
+ *
+ * The emulator is passive: its state is advanced whenever the driver calls one of the Stream functions.
+ * Frames are forwarded through the chain unchanged, so a servo understands a frame if its own baud rate matches
+ * the driver port, independent of the rates of the servos in front of it.
+ */
+#ifndef SMART_SERVO_EMULATOR_H
+#define SMART_SERVO_EMULATOR_H
+
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#define EMULATOR_MAX_SERVOS       32
+#define EMULATOR_PROCESS_US       300     // Default time a servo needs from the end of a request to the start of its response
+#define EMULATOR_HOP_US           20      // Default delay of forwarding a frame through one servo of the chain
+#define EMULATOR_VOLTAGE          12.0f   // Supply voltage reported by the servos
+#define EMULATOR_AMBIENT_TEMP     28.0f   // Temperature of an idle servo in degree Celsius
+#define EMULATOR_IDLE_CURRENT     0.05f   // Current of a standing servo in A
+#define EMULATOR_MOVE_CURRENT     0.35f   // Additional current of a servo moving at SERVO_MAX_SPEED_RPM in A
+#define EMULATOR_SETTLE_BAND      0.2f    // Deviation in degree from the final angle a settling servo reports its arrival at
+#define EMULATOR_SETTLE_MAX_US    5000000 // Longest settling time in us, a servo which still oscillates is stopped then
+
+typedef struct
+{
+  uint32_t framesReceived;            // complete frames received from the driver
+  uint32_t framesDropped;             // frames with a wrong checksum or sent at a wrong baud rate, not answered
+  uint32_t framesSent;                // responses and arrival reports sent to the driver
+  uint32_t responsesLost;             // responses dropped by the configured loss rate
+  unsigned long txBusyUs;             // time the line from the driver to the servos was busy
+  unsigned long rxBusyUs;             // time the line from the servos to the driver was busy
+}emulator_stats_type;
+
+class SmartServoEmulator : public Stream
+{
+public:
+  /**
+   * \param[in] numServos - number of servos in the chain (1 to EMULATOR_MAX_SERVOS).
+   * \param[in] baudRate - baud rate of the driver port and the servos after power up.
+   */
+  explicit SmartServoEmulator(uint8_t numServos, long baudRate = SMART_SERVO_DEFAULT_BAUD_RATE);
+
+  /* Stream interface used by the driver */
+  size_t write(uint8_t val);
+  size_t write(const uint8_t *buffer, size_t size);
+  int available(void);
+  int read(void);
+  int peek(void);
+  void flush(void);
+
+  /* Changes the baud rate of the driver port like HardwareSerial::begin(). Bytes are lost while it differs from the servos. */
+  void begin(long baudRate);
+  long getBaudRate(void) { return hostBaud; }
+  long getServoBaudRate(uint8_t devId);
+
+  /* Timing of the servos in us */
+  void setLatency(unsigned long processUs, unsigned long hopUs);
+
+  /* Fraction (0 to 1) of responses which are dropped, to exercise the retries of the driver */
+  void setResponseLoss(float loss, unsigned int seed = 1);
+
+  /* Servos which do not send REPORT_WHEN_REACH_THE_SET_POSITION, like old firmware */
+  void setArrivalReports(bool enabled) { arrivalReports = enabled; }
+
+  /* Servos which reject GET_SERVO_STATUS with WRONG_TYPE_OF_SERVICE, to exercise the fallback of the driver */
+  void setStatusReplies(bool enabled) { statusReplies = enabled; }
+
+  /* Load of a servo: scales speed (0 to 1) and adds current, e.g. for a servo lifting the arm */
+  void setLoad(uint8_t devId, float load);
+
+  /* Models the settling of the position controller at the end of angle moves, depending on the PID gains and the load */
+  void setSettling(bool enabled) { settling = enabled; }
+
+  /* State of the virtual servos (devId 1 to numServos) */
+  float getAngle(uint8_t devId);
+  bool isMoving(uint8_t devId);
+  unsigned long getArrivalTime(uint8_t devId);   // time (micros()) the last angle move ends, including settling
+  uint8_t getNumServos(void) { return numServos; }
+
+  /* Statistics of the wire, busy times are counted until now */
+  emulator_stats_type getStats(void);
+  void resetStats(void);
+
+  /* Share of the time since the last resetStats() the lines were busy, 0 to 1 */
+  float getTxUtilisation(void);
+  float getRxUtilisation(void);
+
+private:
+  typedef struct
+  {
+    float startAngle;                 // angle at startTime in degree
+    float targetAngle;                // angle the servo moves to
+    float speed;                      // degree per us, 0 if the servo stands
+    unsigned long startTime;          // time in us the current move started
+    bool continuous;                  // moved with SET_SERVO_PWM_MOVE, turns until the next command
+    bool reportArrival;               // send REPORT_WHEN_REACH_THE_SET_POSITION at the end of the move
+    long baudRate;
+    uint8_t breakStatus;
+    float load;
+    float pid[3];
+    uint8_t rgb[3];
+    float settleOmega;                // natural frequency of the settling in rad/s
+    float settleZeta;                 // damping ratio of the settling
+    float settleSag;                  // steady state error in degree the load leaves
+    float settleVelocity;             // velocity in degree/s the servo passes the goal with
+    unsigned long settleUs;           // time after the end of the ramp until the arrival report, 0 without settling
+  }emulated_servo_type;
+
+  typedef struct
+  {
+    uint8_t val;
+    unsigned long time;               // time in us the byte is completely received by the driver
+  }timed_byte_type;
+
+  void update(void);
+  void receiveFrame(unsigned long frameEnd);
+  void processFrame(uint8_t devId, uint8_t srvId, const uint8_t *payload, uint8_t length, unsigned long frameEnd);
+  void processServoCmd(uint8_t devId, uint8_t cmd, const uint8_t *payload, uint8_t length, unsigned long frameEnd);
+  void resetServo(uint8_t devId);
+  void startMove(uint8_t devId, float target, int16_t rpm, bool report, unsigned long now);
+  void stopAt(uint8_t devId, float angle, unsigned long now);
+  float angleAt(const emulated_servo_type &servo, unsigned long now);
+  float speedAt(const emulated_servo_type &servo, unsigned long now);
+  unsigned long rampEnd(const emulated_servo_type &servo);
+  unsigned long arrivalTime(const emulated_servo_type &servo);
+  float settleError(const emulated_servo_type &servo, float t);
+  void startSettling(emulated_servo_type &servo);
+  void sendArrivalReport(uint8_t devId);
+  void sendAck(uint8_t devId, uint8_t code, unsigned long readyTime);
+  void sendValue(uint8_t devId, uint8_t cmd, const uint8_t *data, uint8_t length, unsigned long readyTime);
+  void sendFrame(uint8_t devId, const std::vector<uint8_t> &frame, unsigned long readyTime);
+  unsigned long byteTime(void) { return 10000000UL / hostBaud; }
+  unsigned long responseTime(uint8_t devId, unsigned long frameEnd);
+  bool randomLoss(void);
+
+  uint8_t numServos;
+  emulated_servo_type servos[EMULATOR_MAX_SERVOS];
+  long hostBaud;
+  unsigned long processUs;
+  unsigned long hopUs;
+  bool arrivalReports;
+  bool statusReplies;
+  bool settling;
+  float responseLoss;
+  unsigned int randomState;
+
+  std::vector<uint8_t> rxFrame;       // frame the servos are receiving from the driver
+  unsigned long txLineFree;           // time the last byte from the driver is on the wire
+  unsigned long rxLineFree;           // time the last byte to the driver is on the wire
+  std::multimap<unsigned long, std::pair<uint8_t, std::vector<uint8_t> > > scheduled;   // responses not yet on the wire by ready time, with sender
+  std::deque<timed_byte_type> rx;     // bytes on the wire to the driver
+  unsigned long statsStart;
+  emulator_stats_type stats;
+};
+
+#endif
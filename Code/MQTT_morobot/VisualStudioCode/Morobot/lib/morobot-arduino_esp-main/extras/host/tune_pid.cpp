@@ -0,0 +1,55 @@
+/**
+ * @file    tune_pid.cpp
+ * @brief   Host tool: PID auto-tuning of the smart servo driver against the settling model of the emulator.
+ *
+ * One emulated servo carries the given load and settles at the end of its moves like a damped position
+ * controller. tunePid() steps it between two angles and searches the gains with the shortest settle time
+ * without overshoot. The step responses before and after the tuning are printed together with the measured
+ * settle times of the single trials, so the search can be checked without a robot.
+ *
+ * Build and run (see README.md):
+ *   g++ -O2 -std=gnu++11 -I. -I../../src tune_pid.cpp smart_servo_emulator.cpp arduino_host.cpp ../../src/MakeblockSmartServo.cpp -o tune_pid
+ *   ./tune_pid [load 0..1] [step in degree] [speed in rpm]
+ */
+#include <Arduino.h>
+#include <MakeblockSmartServo.h>
+#include "smart_servo_emulator.h"
+#include <stdio.h>
+
+static void printResponse(const char *name, const servo_pid_type &pid, const servo_step_response_type &response)
+{
+  printf("%-8s P %6.3f I %6.3f D %6.3f   rise %5lu ms  settle %5lu ms%s  overshoot %ld deg\n", name,
+         pid.p, pid.i, pid.d, response.riseTime, response.settleTime, response.settled ? "" : " (not settled)",
+         response.overshoot);
+}
+
+int main(int argc, char **argv)
+{
+  float load = (argc > 1) ? atof(argv[1]) : 0.5f;
+  long step = (argc > 2) ? atol(argv[2]) : 30;
+  float speed = (argc > 3) ? atof(argv[3]) : 25;
+  SmartServoEmulator bus(1);
+  MakeblockSmartServo<1> servos;
+  servo_pid_tune_type result;
+  unsigned long start;
+
+  printf("load %.2f, steps of %ld deg at %.0f rpm\n", load, step, speed);
+  servos.beginSerial(&bus);
+  if(servos.assignDevIdRequest() == false)
+  {
+    printf("no servos found\n");
+    return 1;
+  }
+  bus.setLoad(1, load);
+  bus.setSettling(true);
+  start = millis();
+  if(servos.tunePid(1, 0, step, speed, &result) == false)
+  {
+    printf("tuning failed\n");
+    return 1;
+  }
+  printResponse("initial", result.initial, result.before);
+  printResponse("tuned", result.pid, result.after);
+  printf("%u trials in %.1f s\n", result.trials, (millis() - start) / 1000.0);
+  return (result.after.settleTime <= result.before.settleTime) ? 0 : 1;
+}
@@ -6,11 +6,14 @@
  *  @date	2020/11/27
  *  \par Method List:
  *  	public:
- *  		morobotClass(uint8_t numSmartServos);
+ *  		morobotClass(morobotStorage<NUM_JOINTS, NUM_SERVOS> &storage);
 			void begin(const char* stream);
+			long negotiateBaudRate(long baudRate);
+			long getBaudRate();
 			void setZero();
 			void moveHome();
 			void setSpeedRPM(uint8_t speed);
+			void setSynchronizedMoves(bool synchronized);
 			virtual void setTCPoffset(float xOffset, float yOffset, float zOffset);
 			virtual bool checkIfAngleValid(uint8_t servoId, float angle);
 			
@@ -21,14 +24,20 @@
 			void setIdle();
 			void waitUntilIsReady();
 			bool checkIfMotorMoves(uint8_t servoId);
+			void setGoalTolerance(float tolerance);
 			
 			long getActAngle(uint8_t servoId);
+			bool getActAngles(long angles[]);
 			float getActPosition(char axis);
 			float getActOrientation(char axis);
-			float getSpeed(uint8_t servoId);
-			float getTemp(uint8_t servoId);
-			float getVoltage(uint8_t servoId);
-			float getCurrent(uint8_t servoId);
+			float getSpeed(uint8_t servoId, bool forceRefresh=false);
+			float getTemp(uint8_t servoId, bool forceRefresh=false);
+			float getVoltage(uint8_t servoId, bool forceRefresh=false);
+			float getCurrent(uint8_t servoId, bool forceRefresh=false);
+			bool readTelemetrySnapshot(morobotTelemetry &snapshot, bool forceRefresh=false);
+			void setCacheTTL(uint8_t field, uint16_t ttl);
+			void printBusStats(Print &out);
+			void resetBusStats();
 			long getJointLimit(uint8_t servoId, bool limitNum);
 			uint8_t getAxisLimit(char axis, bool limitNum);
 			uint8_t getNumSmartServos();
@@ -44,6 +53,49 @@
 			bool moveToPose(float x, float y, float z);
 			bool moveXYZ(float xOffset, float yOffset, float zOffset);
 			bool moveInDirection(char axis, float value);
+			bool moveLinear(float x, float y, float z, float speed);
+			
+			morobotMoveHandle moveToAnglesAsync(long angles[]);
+			morobotMoveHandle moveToAnglesAsync(long angles[], uint8_t speedRPM);
+			morobotMoveHandle moveToPoseAsync(float x, float y, float z);
+			void updateMotion();
+			uint8_t getMoveState(morobotMoveHandle handle);
+			bool isMoveDone(morobotMoveHandle handle);
+			bool waitForMove(morobotMoveHandle handle, unsigned long timeout=TIMEOUT_DELAY);
+			bool cancelMove(morobotMoveHandle handle);
+			
+			bool beginQueue();
+			void endQueue();
+			void updateQueue();
+			morobotMoveHandle enqueueAngles(long angles[]);
+			morobotMoveHandle enqueueAngles(long angles[], uint8_t speedRPM);
+			morobotMoveHandle enqueuePose(float x, float y, float z);
+			morobotMoveHandle enqueueGripper(gripper *eef, bool close);
+			morobotMoveHandle enqueueDwell(unsigned long duration);
+			void setQueueCallback(morobotQueueCb callback);
+			uint8_t getQueueLength();
+			bool isQueueEntryDone(morobotMoveHandle id);
+			void clearQueue();
+			
+			bool beginStreaming(uint16_t periodMs=MOROBOT_STREAM_PERIOD);
+			void endStreaming();
+			bool isStreaming();
+			void updateStreaming();
+			void setStreamAcceleration(float acceleration);
+			void streamAngle(uint8_t servoId, float angle, float velocity);
+			void streamAngles(float angles[], float velocity);
+			void jogJoint(uint8_t servoId, float velocity);
+			void streamPwm(uint8_t servoId, int16_t pwm);
+			float getStreamSetpoint(uint8_t servoId);
+			void setTrajectoryLimits(float velocity, float acceleration, float jerk);
+			float streamTrajectory(float angles[], uint8_t profile=PROFILE_SCURVE);
+			bool isTrajectoryDone();
+			
+			bool setJointPid(uint8_t servoId, float p, float i, float d);
+			bool getJointPid(uint8_t servoId, servo_pid_type &pid);
+			bool autoTuneJoint(uint8_t servoId, long stepAngle=MOROBOT_TUNE_STEP, servo_pid_tune_type *result=NULL);
+			bool saveJointPids(const char* name="morobot");
+			bool loadJointPids(const char* name="morobot");
 			
 			void printAngles(long angles[]);
 			void printTCPpose();
@@ -54,19 +106,37 @@
 			virtual bool calculateAngles(float x, float y, float z);
 			virtual void updateTCPpose(bool output);
 			void autoCalibrateLinearAxis(uint8_t servoId, uint8_t maxMotorCurrent=25);
+			bool moveJointsTo(long angles[], uint8_t speedRPM);
+			bool syncJointSpeeds(long angles[], const bool valid[], uint8_t speedRPM, uint8_t speeds[]);
 		private:
-			bool isReady();
+			bool isReady(unsigned long waitTime = 0);
+			bool pollMotorsStopped(const uint8_t servoIds[], uint8_t numServos);
+			bool readPollAngles(const uint8_t servoIds[], uint8_t numServos, bool first);
+			bool checkIfReady();
+			morobotMoveHandle beginMove(long angles[], uint8_t speedRPM, const float pose[]=NULL);
+			void startMove();
+			morobotMoveHandle enqueue(morobotQueueEntry &entry);
+			void queueStep();
+			uint8_t startQueueEntry(morobotQueueEntry &entry);
+			void finishQueueEntry(uint8_t result);
+			static void queueTask(void *arg);
+			void lockQueue();
+			void unlockQueue();
+			void setPortBaudRate(long baudRate);
+			void streamTick(unsigned long elapsedMs);
+			static void streamTask(void *arg);
+			float limitStreamAngle(uint8_t servoId, float angle);
+			void planTrajectory(morobotTrajectory &traj, float velocity, float acceleration, float jerk);
+			float sampleTrajectory(const morobotTrajectory &traj, float time);
+			bool calculatePathAngles(const float start[], const float travel[], const morobotTrajectory &path, float time, float angles[]);
+			void lockStream();
+			void unlockStream();
  */
 
 #include "morobot.h"
-
-morobotClass::morobotClass(uint8_t numSmartServos){
-	if (numSmartServos > NUM_MAX_SERVOS){
-		Serial.print(F("Too many motors! Maximum number of motors: "));
-		Serial.println(NUM_MAX_SERVOS);
-	}
-	_numSmartServos = numSmartServos;
-}
+#if defined(ESP32)
+	#include <Preferences.h>
+#endif
 
 void morobotClass::begin(const char* stream){
 	Serial.begin(115200);
@@ -131,6 +201,10 @@ void morobotClass::begin(const char* stream){
 	smartServos.beginSerial(_port);
 	delay(5);
 	smartServos.assignDevIdRequest();
+	#if defined(ESP32)
+		// All ports on the ESP32 are hardware serials; responses are processed by a background task from now on
+		smartServos.beginReceiveTask(static_cast<HardwareSerial*>(_port));
+	#endif
 	delay(50);
 	
 	setTCPoffset(0, 0, 0);
@@ -140,13 +214,65 @@ void morobotClass::begin(const char* stream){
 	Serial.println(F("Morobot initialized. Connection to motors established"));
 }
 
+long morobotClass::negotiateBaudRate(long baudRate){
+	bool success = true;
+	if (baudRate == _busBaudRate) return _busBaudRate;
+	
+	// Devices which are not joints (e.g. the smart servo of a gripper) share the bus and have to switch as well
+	uint8_t numDevices = max(_numSmartServos, smartServos.getNumDevices());
+	for (uint8_t i=0; i<numDevices; i++) smartServos.setBaudRate(i+1, baudRate);
+	delay(10);
+	setPortBaudRate(baudRate);
+	delay(10);
+	
+	// Every servo has to answer at the new rate, otherwise the bus would be split
+	for (uint8_t i=0; i<numDevices; i++) {
+		if (smartServos.handSharke(i+1) == false) success = false;
+	}
+	
+	if (success == true) {
+		_busBaudRate = baudRate;
+	} else {
+		// Send the servos which switched back to the default rate
+		for (uint8_t i=0; i<numDevices; i++) smartServos.setBaudRate(i+1, SMART_SERVO_DEFAULT_BAUD_RATE);
+		delay(10);
+		setPortBaudRate(SMART_SERVO_DEFAULT_BAUD_RATE);
+		delay(10);
+		_busBaudRate = SMART_SERVO_DEFAULT_BAUD_RATE;
+		for (uint8_t i=0; i<numDevices; i++) {
+			if (smartServos.handSharke(i+1) == false) {
+				Serial.print(F("WARNING: Motor "));
+				Serial.print(i);
+				Serial.println(F(" does not answer at the default baud rate!"));
+			}
+		}
+		Serial.print(F("Baud rate "));
+		Serial.print(baudRate);
+		Serial.println(F(" not supported by all motors."));
+	}
+	Serial.print(F("Bus baud rate: "));
+	Serial.println(_busBaudRate);
+	return _busBaudRate;
+}
+
+long morobotClass::getBaudRate(){
+	return _busBaudRate;
+}
+
 void morobotClass::setZero(){
-	for (uint8_t i=0; i<_numSmartServos; i++) smartServos.setZero(i+1);
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		smartServos.setZero(i+1);
+		_goalAngles[i] = NAN;
+	}
 	_tcpPoseIsValid = false;
 }
 
 void morobotClass::moveHome(){
-	for (uint8_t i=0; i<_numSmartServos; i++) smartServos.setInitAngle(i+1, 0, 15);
+	// The joints are polled without arrival report, so the goal has to be known before the first reading
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		smartServos.setInitAngle(i+1, 0, 15);
+		_goalAngles[i] = 0;
+	}
 	waitUntilIsReady();
 	_tcpPoseIsValid = false;
 }
@@ -160,6 +286,10 @@ void morobotClass::setSpeedRPM(uint8_t speed){
 	if (speed < 0) _speedRPM = 1;
 }
 
+void morobotClass::setSynchronizedMoves(bool synchronized){
+	_synchronizedMoves = synchronized;
+}
+
 
 /* BREAKS */
 void morobotClass::setBreaks(){
@@ -189,8 +319,9 @@ void morobotClass::waitUntilIsReady(){
 	setBusy();
 	unsigned long startTime = millis();
 	while (true){
-		// Check if the robot is ready yet
-		if (isReady() == true) break;
+		// Check if the robot is ready yet (waits for arrival reports of the motors for the remaining time)
+		unsigned long elapsed = millis() - startTime;
+		if (isReady(elapsed < TIMEOUT_DELAY ? TIMEOUT_DELAY - elapsed : 0) == true) break;
 		// Stop waiting if the robot is not ready after a timeout occurs
 		if ((millis() - startTime) > TIMEOUT_DELAY) {
 			Serial.println(F("TIMEOUT OCCURED WHILE WAITING FOR ROBOT TO FINISH MOVEMENT!"));
@@ -206,12 +337,24 @@ bool morobotClass::checkIfMotorMoves(uint8_t servoId){
 	return false;
 }
 
+void morobotClass::setGoalTolerance(float tolerance){
+	_goalTolerance = tolerance;
+}
+
 
 /* GETTERS */
 long morobotClass::getActAngle(uint8_t servoId){
 	return smartServos.getAngleRequest(servoId+1);
 }
 
+bool morobotClass::getActAngles(long angles[]){
+	smartServoHandle handles[NUM_MAX_SERVOS];
+	for (uint8_t i=0; i<_numSmartServos; i++) handles[i] = smartServos.requestAsync(i+1, GET_SERVO_CUR_ANGLE);
+	bool success = smartServos.waitForAll(handles, _numSmartServos);
+	for (uint8_t i=0; i<_numSmartServos; i++) angles[i] = smartServos.getDeviceData(i+1).angleValue;
+	return success;
+}
+
 float morobotClass::getActPosition(char axis){
 	updateTCPpose();
 	
@@ -230,20 +373,78 @@ float morobotClass::getActOrientation(char axis){
 	else Serial.println(F("ERROR! Invalid axis in getActOrientation();"));
 }
 
-float morobotClass::getSpeed(uint8_t servoId){
-	return smartServos.getSpeedRequest(servoId+1);
+float morobotClass::getSpeed(uint8_t servoId, bool forceRefresh){
+	return smartServos.getSpeedRequest(servoId+1, forceRefresh);
+}
+
+float morobotClass::getTemp(uint8_t servoId, bool forceRefresh){
+	return smartServos.getTempRequest(servoId+1, forceRefresh);
+}
+
+float morobotClass::getVoltage(uint8_t servoId, bool forceRefresh){
+	return smartServos.getVoltageRequest(servoId+1, forceRefresh);
+}
+
+float morobotClass::getCurrent(uint8_t servoId, bool forceRefresh){
+	return smartServos.getCurrentRequest(servoId+1, forceRefresh);
+}
+
+bool morobotClass::readTelemetrySnapshot(morobotTelemetry &snapshot, bool forceRefresh){
+	const uint8_t requests[5] = {GET_SERVO_CUR_ANGLE, GET_SERVO_SPEED, GET_SERVO_TEMPERATURE, GET_SERVO_VOLTAGE, GET_SERVO_ELECTRIC_CURRENT};
+	const uint8_t fields[5] = {SERVO_FIELD_ANGLE, SERVO_FIELD_SPEED, SERVO_FIELD_TEMPERATURE, SERVO_FIELD_VOLTAGE, SERVO_FIELD_CURRENT};
+	smartServoHandle handles[NUM_MAX_SERVOS][5];
+	uint8_t numHandles[NUM_MAX_SERVOS];
+	bool statusAsked[NUM_MAX_SERVOS];
+	bool allValid = true;
+	
+	// Send all requests for values which are not fresh in the cache first, then collect the responses.
+	// Motors which support it are asked for all values with one GET_SERVO_STATUS request.
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		numHandles[i] = 0;
+		statusAsked[i] = false;
+		for (uint8_t r=0; r<5; r++) {
+			if (forceRefresh == false && smartServos.isCacheFresh(i+1, fields[r]) == true) continue;
+			if (smartServos.getStatusSupport(i+1) != SERVO_STATUS_UNSUPPORTED) {
+				handles[i][numHandles[i]++] = smartServos.requestAsync(i+1, GET_SERVO_STATUS);
+				statusAsked[i] = true;
+				break;
+			}
+			handles[i][numHandles[i]++] = smartServos.requestAsync(i+1, requests[r]);
+		}
+	}
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		snapshot.valid[i] = smartServos.waitForAll(handles[i], numHandles[i]);
+		// The first request showed that the motor does not support GET_SERVO_STATUS: ask for the single values
+		if (statusAsked[i] == true && smartServos.getStatusSupport(i+1) == SERVO_STATUS_UNSUPPORTED) {
+			snapshot.valid[i] = smartServos.getStatusRequest(i+1, forceRefresh);
+		}
+		snapshot.servo[i] = smartServos.getDeviceData(i+1);
+		if (snapshot.valid[i] == false) allValid = false;
+	}
+	snapshot.numServos = _numSmartServos;
+	snapshot.timestamp = millis();
+	return allValid;
+}
+
+void morobotClass::setCacheTTL(uint8_t field, uint16_t ttl){
+	smartServos.setCacheTTL(field, ttl);
+}
+
+void morobotClass::printBusStats(Print &out){
+	smartServos.printBusStats(out);
 }
 
-float morobotClass::getTemp(uint8_t servoId){
-	return smartServos.getTempRequest(servoId+1);
+void morobotClass::resetBusStats(){
+	smartServos.resetBusStats();
 }
 
-float morobotClass::getVoltage(uint8_t servoId){
-	return smartServos.getVoltageRequest(servoId+1);
+void morobotClass::beginBusCapture(servo_capture_type *buffer, uint16_t size){
+	smartServos.beginCapture(buffer, size);
 }
 
-float morobotClass::getCurrent(uint8_t servoId){
-	return smartServos.getCurrentRequest(servoId+1);
+void morobotClass::printBusCapture(Print &out){
+	smartServos.endCapture();
+	smartServos.printCapture(out);
 }
 
 long morobotClass::getJointLimit(uint8_t servoId, bool limitNum){
@@ -264,16 +465,15 @@ uint8_t morobotClass::getNumSmartServos(){
 void morobotClass::moveToAngle(uint8_t servoId, long angle){
 	if (checkIfAngleValid(servoId, angle) == true) {
 		smartServos.moveTo(servoId+1, angle, _speedRPM);
+		_goalAngles[servoId] = angle;
 		_tcpPoseIsValid = false;
 	}
 }
 
 void morobotClass::moveToAngle(uint8_t servoId, long angle, uint8_t speedRPM, bool checkValidity){
-	if (checkValidity == false) {
-		smartServos.moveTo(servoId+1, angle, speedRPM);
-		_tcpPoseIsValid = false;
-	} else if (checkIfAngleValid(servoId, angle) == true) {
+	if (checkValidity == false || checkIfAngleValid(servoId, angle) == true) {
 		smartServos.moveTo(servoId+1, angle, speedRPM);
+		_goalAngles[servoId] = angle;
 		_tcpPoseIsValid = false;
 	}
 }
@@ -283,7 +483,7 @@ void morobotClass::moveToAngles(long angles[]){
 	Serial.print(F("Moving to [deg]: "));
 	printAngles(angles);
 	
-	for (uint8_t i=0; i<_numSmartServos; i++) moveToAngle(i, angles[i]);
+	moveJointsTo(angles, _speedRPM);
 }
 
 void morobotClass::moveToAngles(long angles[], uint8_t speedRPM){
@@ -291,7 +491,7 @@ void morobotClass::moveToAngles(long angles[], uint8_t speedRPM){
 	Serial.print(F("Moving to [deg]: "));
 	printAngles(angles);
 	
-	for (uint8_t i=0; i<_numSmartServos; i++) moveToAngle(i, angles[i], speedRPM);
+	moveJointsTo(angles, speedRPM);
 }
 
 void morobotClass::moveToAngles(long phi0, long phi1, long phi2){
@@ -300,18 +500,19 @@ void morobotClass::moveToAngles(long phi0, long phi1, long phi2){
 }
 
 void morobotClass::moveAngle(uint8_t servoId, long angle){
-	if (checkIfAngleValid(servoId, getActAngle(servoId)+angle) == true) {
-		smartServos.move(servoId+1, angle, _speedRPM);
-		_tcpPoseIsValid = false;
-	}
+	moveAngle(servoId, angle, _speedRPM);
 }
 
 void morobotClass::moveAngle(uint8_t servoId, long angle, uint8_t speedRPM, bool checkValidity){
 	if (checkValidity == false) {
 		smartServos.move(servoId+1, angle, speedRPM);
+		_goalAngles[servoId] = NAN;
 		_tcpPoseIsValid = false;
-	} else if (checkIfAngleValid(servoId, getActAngle(servoId)+angle) == true) {
+	} else {
+		long goalAngle = getActAngle(servoId)+angle;
+		if (checkIfAngleValid(servoId, goalAngle) == false) return;
 		smartServos.move(servoId+1, angle, speedRPM);
+		_goalAngles[servoId] = goalAngle;
 		_tcpPoseIsValid = false;
 	}
 }
@@ -344,7 +545,9 @@ bool morobotClass::moveToPose(float x, float y, float z){
 	updateTCPpose();
 	if (calculateAngles(x, y, z) == false) return false;
 	
-	for (uint8_t i=0; i<_numSmartServos; i++) moveToAngle(i, _goalAngles[i]);
+	long goalAngles[NUM_MAX_SERVOS];
+	for (uint8_t i=0; i<_numSmartServos; i++) goalAngles[i] = _goalAngles[i];
+	moveJointsTo(goalAngles, _speedRPM);
 	
 	// Update TCP-Pose
 	_actPos[0] = x;
@@ -373,6 +576,543 @@ bool morobotClass::moveInDirection(char axis, float value){
 	return moveToPose(goalxyz[0], goalxyz[1], goalxyz[2]);
 }
 
+bool morobotClass::moveLinear(float x, float y, float z, float speed){
+	float goal[3] = {x, y, z};
+	float start[3];
+	float travel[3];
+	float angles[NUM_MAX_SERVOS];
+	float lastAngles[NUM_MAX_SERVOS];
+	long goalAngles[NUM_MAX_SERVOS];
+	float previousGoals[NUM_MAX_SERVOS];
+	morobotTrajectory path;
+	float period = MOROBOT_LINEAR_PERIOD/1000.0;
+	float leadTime = MOROBOT_STREAM_LEAD*period;
+	float totalTime;
+	float maxVelocity;
+	if (_streaming == true) {
+		Serial.println(F("ERROR: moveLinear() does not work in the streaming mode!"));
+		return false;
+	}
+	waitUntilIsReady();
+	Serial.print(F("Moving linear to [mm]: "));
+	Serial.print(x);
+	Serial.print(", ");
+	Serial.print(y);
+	Serial.print(", ");
+	Serial.println(z);
+	
+	updateTCPpose();
+	path.distance = 0;
+	for (uint8_t i=0; i<3; i++) {
+		start[i] = _actPos[i];
+		travel[i] = goal[i] - start[i];
+		path.distance += travel[i]*travel[i];
+	}
+	path.distance = sqrt(path.distance);
+	speed = max((float)fabs(speed), 1.0f);
+	
+	// Check every sample of the path before moving; slow down along the whole line if a joint cannot follow.
+	// The inverse kinematics overwrites the goal angles, which are still those of the robot until it moves.
+	for (uint8_t i=0; i<_numSmartServos; i++) previousGoals[i] = _goalAngles[i];
+	do {
+		planTrajectory(path, speed, MOROBOT_LINEAR_ACCEL, MOROBOT_LINEAR_JERK);
+		totalTime = 2*path.accelTime + path.cruiseTime;
+		maxVelocity = 0;
+		for (unsigned long k=0; ; k++) {
+			if (calculatePathAngles(start, travel, path, k*period, angles) == false) {
+				Serial.println(F("ERROR: The straight path to the given point is not reachable"));
+				for (uint8_t i=0; i<_numSmartServos; i++) _goalAngles[i] = previousGoals[i];
+				return false;
+			}
+			for (uint8_t i=0; i<_numSmartServos; i++) {
+				if (k > 0) maxVelocity = max(maxVelocity, (float)fabs(angles[i] - lastAngles[i])/period);
+				lastAngles[i] = angles[i];
+			}
+			if (k*period >= totalTime) break;
+		}
+		if (maxVelocity > MOROBOT_STREAM_MAX_VELOCITY) {
+			speed *= 0.9*MOROBOT_STREAM_MAX_VELOCITY/maxVelocity;
+			Serial.print(F("Speed lowered to [mm/s]: "));
+			Serial.println(speed);
+		}
+	} while (maxVelocity > MOROBOT_STREAM_MAX_VELOCITY);
+	
+	// Like in the streaming mode every joint gets the angle some periods ahead with the speed to get there
+	unsigned long startTime = millis();
+	for (unsigned long k=0; k*period < totalTime; k++) {
+		calculatePathAngles(start, travel, path, k*period, lastAngles);
+		calculatePathAngles(start, travel, path, k*period + leadTime, angles);
+		for (uint8_t i=0; i<_numSmartServos; i++) {
+			float velocity = (angles[i] - lastAngles[i])/leadTime;
+			long angle = lround(angles[i]);
+			if (velocity > 0) angle = (long)ceil(angles[i]);
+			else if (velocity < 0) angle = (long)floor(angles[i]);
+			smartServos.streamMoveTo(i+1, angle, constrain((int)ceil(fabs(velocity)/6), 1, SERVO_MAX_SPEED_RPM));
+		}
+		while (millis() - startTime < (k+1)*MOROBOT_LINEAR_PERIOD) delay(1);
+	}
+	
+	// Acknowledged move to the goal, so waitUntilIsReady() works as after moveToPose()
+	calculatePathAngles(start, travel, path, totalTime, angles);
+	for (uint8_t i=0; i<_numSmartServos; i++) goalAngles[i] = lround(angles[i]);
+	moveJointsTo(goalAngles, _speedRPM);
+	
+	// Update TCP-Pose
+	_actPos[0] = x;
+	_actPos[1] = y;
+	_actPos[2] = z;
+	_tcpPoseIsValid = true;
+	
+	return true;
+}
+
+/* ASYNCHRONOUS MOVEMENTS */
+morobotMoveHandle morobotClass::moveToAnglesAsync(long angles[]){
+	return moveToAnglesAsync(angles, _speedRPM);
+}
+
+morobotMoveHandle morobotClass::moveToAnglesAsync(long angles[], uint8_t speedRPM){
+	if (isMoveDone(_move.handle) == false || _streaming == true) return MOROBOT_NO_MOVE;
+	Serial.print(F("Moving to [deg]: "));
+	printAngles(angles);
+	
+	return beginMove(angles, speedRPM);
+}
+
+morobotMoveHandle morobotClass::moveToPoseAsync(float x, float y, float z){
+	long angles[NUM_MAX_SERVOS];
+	float goalAngles[NUM_MAX_SERVOS];
+	if (isMoveDone(_move.handle) == false || _streaming == true) return MOROBOT_NO_MOVE;
+	Serial.print(F("Moving to [mm]: "));
+	Serial.print(x);
+	Serial.print(", ");
+	Serial.print(y);
+	Serial.print(", ");
+	Serial.println(z);
+	
+	// The goal angles of the previous motion are still needed until the robot is idle
+	for (uint8_t i=0; i<_numSmartServos; i++) goalAngles[i] = _goalAngles[i];
+	updateTCPpose();
+	bool reachable = calculateAngles(x, y, z);
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		angles[i] = _goalAngles[i];
+		_goalAngles[i] = goalAngles[i];
+	}
+	if (reachable == false) return MOROBOT_NO_MOVE;
+	
+	float pose[3] = {x, y, z};
+	return beginMove(angles, _speedRPM, pose);
+}
+
+void morobotClass::updateMotion(){
+	if (_move.state == MOROBOT_MOVE_WAITING) {
+		// As in waitUntilIsReady(): the move is sent after the previous motion finished or a timeout occured
+		if (waitAfterEachMove == true && checkIfReady() == false) {
+			if (millis() - _move.stateTime <= TIMEOUT_DELAY) return;
+			Serial.println(F("TIMEOUT OCCURED WHILE WAITING FOR ROBOT TO FINISH MOVEMENT!"));
+		}
+		startMove();
+	} else if (_move.state == MOROBOT_MOVE_RUNNING) {
+		if (waitAfterEachMove == false) {
+			setIdle();
+		} else if (checkIfReady() == false) {
+			if (millis() - _move.stateTime <= TIMEOUT_DELAY) return;
+			Serial.println(F("TIMEOUT OCCURED WHILE WAITING FOR ROBOT TO FINISH MOVEMENT!"));
+			_move.state = MOROBOT_MOVE_FAILED;
+			return;
+		}
+		_move.state = MOROBOT_MOVE_DONE;
+	}
+}
+
+uint8_t morobotClass::getMoveState(morobotMoveHandle handle){
+	if (handle == MOROBOT_NO_MOVE || handle != _move.handle) return MOROBOT_MOVE_FAILED;
+	updateMotion();
+	return _move.state;
+}
+
+bool morobotClass::isMoveDone(morobotMoveHandle handle){
+	return getMoveState(handle) >= MOROBOT_MOVE_DONE;
+}
+
+bool morobotClass::waitForMove(morobotMoveHandle handle, unsigned long timeout){
+	unsigned long startTime = millis();
+	while (isMoveDone(handle) == false) {
+		if (millis() - startTime > timeout) return false;
+		delay(1);
+	}
+	return getMoveState(handle) == MOROBOT_MOVE_DONE;
+}
+
+bool morobotClass::cancelMove(morobotMoveHandle handle){
+	if (isMoveDone(handle) == true) return false;
+	if (_move.state == MOROBOT_MOVE_RUNNING) {
+		// Acknowledged stop at the actual angles, so the next move waits for the motors as after any other move
+		long angles[NUM_MAX_SERVOS];
+		if (getActAngles(angles) == true) moveJointsTo(angles, _move.speedRPM);
+		else {
+			// Outdated angles would move the motors somewhere else, so stop them where they are
+			Serial.println(F("ERROR: Actual angles could not be read, motors are braked!"));
+			setBreaks();
+		}
+	}
+	_move.state = MOROBOT_MOVE_CANCELLED;
+	return true;
+}
+
+/* MOTION QUEUE */
+bool morobotClass::beginQueue(){
+	if (_queueRunning == true) return true;
+	_queueRunning = true;
+	
+	#if defined(ESP32)
+		if (xTaskCreatePinnedToCore(queueTask, "morobotQueue", MOROBOT_QUEUE_TASK_STACK, this, MOROBOT_QUEUE_TASK_PRIO, &_queueTaskHandle, tskNO_AFFINITY) != pdPASS) {
+			_queueTaskHandle = NULL;
+			_queueRunning = false;
+			Serial.println(F("ERROR: Motion queue task could not be started!"));
+			return false;
+		}
+	#endif
+	return true;
+}
+
+void morobotClass::endQueue(){
+	_queueRunning = false;
+	#if defined(ESP32)
+		// The task finishes its current step and deletes itself
+		while (_queueTaskHandle != NULL) delay(1);
+	#endif
+	_queueCancel = true;
+	queueStep();
+}
+
+void morobotClass::updateQueue(){
+	#if !defined(ESP32)
+		if (_queueRunning == false) return;
+		queueStep();
+	#endif
+}
+
+morobotMoveHandle morobotClass::enqueueAngles(long angles[]){
+	return enqueueAngles(angles, _speedRPM);
+}
+
+morobotMoveHandle morobotClass::enqueueAngles(long angles[], uint8_t speedRPM){
+	morobotQueueEntry entry = {};
+	entry.type = QUEUE_ENTRY_JOINTS;
+	entry.speedRPM = speedRPM;
+	entry.angles = angles;
+	return enqueue(entry);
+}
+
+morobotMoveHandle morobotClass::enqueuePose(float x, float y, float z){
+	morobotQueueEntry entry = {};
+	entry.type = QUEUE_ENTRY_POSE;
+	entry.pose[0] = x;
+	entry.pose[1] = y;
+	entry.pose[2] = z;
+	return enqueue(entry);
+}
+
+morobotMoveHandle morobotClass::enqueueGripper(gripper *eef, bool close){
+	morobotQueueEntry entry = {};
+	if (eef == NULL) return MOROBOT_NO_MOVE;
+	entry.type = QUEUE_ENTRY_GRIPPER;
+	entry.eef = eef;
+	entry.close = close;
+	return enqueue(entry);
+}
+
+morobotMoveHandle morobotClass::enqueueDwell(unsigned long duration){
+	morobotQueueEntry entry = {};
+	entry.type = QUEUE_ENTRY_DWELL;
+	entry.duration = duration;
+	return enqueue(entry);
+}
+
+void morobotClass::setQueueCallback(morobotQueueCb callback){
+	_queueCallback = callback;
+}
+
+uint8_t morobotClass::getQueueLength(){
+	return _queueLength;
+}
+
+bool morobotClass::isQueueEntryDone(morobotMoveHandle id){
+	bool queued = false;
+	lockQueue();
+	for (uint8_t i=0; i<_queueLength; i++) {
+		if (_queue[(_queueHead+i) % MOROBOT_QUEUE_SIZE].id == id) queued = true;
+	}
+	unlockQueue();
+	return !queued;
+}
+
+void morobotClass::clearQueue(){
+	// The entries are cancelled by the next queue step, so a running move is only touched by the queue task
+	_queueCancel = true;
+}
+
+/* STREAMING */
+bool morobotClass::beginStreaming(uint16_t periodMs){
+	long angles[NUM_MAX_SERVOS];
+	if (_streaming == true) return true;
+	if (periodMs == 0) periodMs = 1;
+	
+	// Start from the actual angles so the joints do not jump
+	waitUntilIsReady();
+	if (getActAngles(angles) == false) {
+		Serial.println(F("ERROR: Actual angles could not be read, streaming not started!"));
+		return false;
+	}
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		_streamJoints[i].position = angles[i];
+		_streamJoints[i].velocity = 0;
+		_streamJoints[i].goal = angles[i];
+		_streamJoints[i].start = angles[i];
+		_streamJoints[i].maxVelocity = 0;
+		_streamJoints[i].pwm = 0;
+		_streamJoints[i].mode = STREAM_MODE_VELOCITY;
+	}
+	_trajectory.distance = 0;
+	planTrajectory(_trajectory, _trajVelocity, _trajAccel, 0);
+	_streamPeriod = periodMs;
+	_lastStreamTick = millis();
+	_streaming = true;
+	_tcpPoseIsValid = false;
+	
+	#if defined(ESP32)
+		if (xTaskCreatePinnedToCore(streamTask, "morobotStream", MOROBOT_STREAM_TASK_STACK, this, MOROBOT_STREAM_TASK_PRIO, &_streamTaskHandle, tskNO_AFFINITY) != pdPASS) {
+			_streamTaskHandle = NULL;
+			_streaming = false;
+			Serial.println(F("ERROR: Streaming task could not be started!"));
+			return false;
+		}
+	#endif
+	return true;
+}
+
+void morobotClass::endStreaming(){
+	smartServoHandle handles[NUM_MAX_SERVOS];
+	uint8_t numHandles = 0;
+	if (_streaming == false) return;
+	_streaming = false;
+	#if defined(ESP32)
+		// The task sends the setpoints of its current period and deletes itself
+		while (_streamTaskHandle != NULL) delay(1);
+	#endif
+	
+	// Acknowledged stop at the streamed positions, so waitUntilIsReady() works as after any other move
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (_streamJoints[i].mode == STREAM_MODE_PWM) {
+			smartServos.setPwmMove(i+1, 0);
+			_goalAngles[i] = NAN;
+		} else {
+			handles[numHandles++] = smartServos.moveToAsync(i+1, lround(_streamJoints[i].position), constrain((int)ceil(fabs(_streamJoints[i].velocity)/6), 1, SERVO_MAX_SPEED_RPM));
+			_goalAngles[i] = lround(_streamJoints[i].position);
+		}
+		_streamJoints[i].velocity = 0;
+	}
+	smartServos.waitForAll(handles, numHandles);
+	_tcpPoseIsValid = false;
+}
+
+bool morobotClass::isStreaming(){
+	return _streaming;
+}
+
+void morobotClass::updateStreaming(){
+	#if !defined(ESP32)
+		if (_streaming == false) return;
+		unsigned long now = millis();
+		if (now - _lastStreamTick < _streamPeriod) return;
+		streamTick(now - _lastStreamTick);
+		_lastStreamTick = now;
+	#endif
+}
+
+void morobotClass::setStreamAcceleration(float acceleration){
+	_streamAccel = fabs(acceleration);
+}
+
+void morobotClass::streamAngle(uint8_t servoId, float angle, float velocity){
+	if (servoId >= _numSmartServos) return;
+	// A pwm driven joint has moved without the streamed position following it
+	float actAngle = (_streamJoints[servoId].mode == STREAM_MODE_PWM) ? getActAngle(servoId) : NAN;
+	
+	lockStream();
+	if (!isnan(actAngle)) {
+		_streamJoints[servoId].position = actAngle;
+		_streamJoints[servoId].velocity = 0;
+	}
+	_streamJoints[servoId].goal = limitStreamAngle(servoId, angle);
+	_streamJoints[servoId].maxVelocity = constrain((float)fabs(velocity), 0.0f, MOROBOT_STREAM_MAX_VELOCITY);
+	_streamJoints[servoId].mode = STREAM_MODE_POSITION;
+	unlockStream();
+}
+
+void morobotClass::streamAngles(float angles[], float velocity){
+	for (uint8_t i=0; i<_numSmartServos; i++) streamAngle(i, angles[i], velocity);
+}
+
+void morobotClass::jogJoint(uint8_t servoId, float velocity){
+	if (servoId >= _numSmartServos) return;
+	float actAngle = (_streamJoints[servoId].mode == STREAM_MODE_PWM) ? getActAngle(servoId) : NAN;
+	
+	lockStream();
+	if (!isnan(actAngle)) {
+		_streamJoints[servoId].position = actAngle;
+		_streamJoints[servoId].velocity = 0;
+	}
+	_streamJoints[servoId].maxVelocity = constrain(velocity, -MOROBOT_STREAM_MAX_VELOCITY, MOROBOT_STREAM_MAX_VELOCITY);
+	_streamJoints[servoId].mode = STREAM_MODE_VELOCITY;
+	unlockStream();
+}
+
+void morobotClass::streamPwm(uint8_t servoId, int16_t pwm){
+	if (servoId >= _numSmartServos) return;
+	lockStream();
+	_streamJoints[servoId].pwm = constrain((int)pwm, -255, 255);
+	_streamJoints[servoId].velocity = 0;
+	_streamJoints[servoId].mode = STREAM_MODE_PWM;
+	unlockStream();
+}
+
+float morobotClass::getStreamSetpoint(uint8_t servoId){
+	if (servoId >= _numSmartServos) return NAN;
+	lockStream();
+	float position = _streamJoints[servoId].position;
+	unlockStream();
+	return position;
+}
+
+void morobotClass::setTrajectoryLimits(float velocity, float acceleration, float jerk){
+	_trajVelocity = constrain((float)fabs(velocity), 1.0f, MOROBOT_STREAM_MAX_VELOCITY);
+	if (acceleration != 0) _trajAccel = fabs(acceleration);
+	_trajJerk = fabs(jerk);
+}
+
+float morobotClass::streamTrajectory(float angles[], uint8_t profile){
+	float actAngles[NUM_MAX_SERVOS];
+	if (_streaming == false) return -1;
+	// Pwm driven joints have moved without the streamed position following them
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		actAngles[i] = (_streamJoints[i].mode == STREAM_MODE_PWM) ? getActAngle(i) : NAN;
+	}
+	
+	lockStream();
+	_trajectory.distance = 0;
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		morobotStreamJoint &joint = _streamJoints[i];
+		if (!isnan(actAngles[i])) joint.position = actAngles[i];
+		joint.goal = limitStreamAngle(i, angles[i]);
+		joint.maxVelocity = _trajVelocity;
+		joint.mode = STREAM_MODE_TRAJECTORY;
+		joint.start = joint.position;
+		_trajectory.distance = max(_trajectory.distance, (float)fabs(joint.goal - joint.start));
+	}
+	planTrajectory(_trajectory, _trajVelocity, _trajAccel, (profile == PROFILE_SCURVE) ? _trajJerk : 0);
+	unlockStream();
+	return 2*_trajectory.accelTime + _trajectory.cruiseTime;
+}
+
+bool morobotClass::isTrajectoryDone(){
+	bool done = true;
+	lockStream();
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (_streamJoints[i].mode == STREAM_MODE_TRAJECTORY) done = false;
+	}
+	unlockStream();
+	return done;
+}
+
+/* SERVO CONTROLLER */
+bool morobotClass::setJointPid(uint8_t servoId, float p, float i, float d){
+	if (servoId >= _numSmartServos) return false;
+	return smartServos.setPid(servoId+1, p, i, d);
+}
+
+bool morobotClass::getJointPid(uint8_t servoId, servo_pid_type &pid){
+	if (servoId >= _numSmartServos) return false;
+	return smartServos.getPidRequest(servoId+1, &pid);
+}
+
+bool morobotClass::autoTuneJoint(uint8_t servoId, long stepAngle, servo_pid_tune_type *result){
+	servo_pid_tune_type tune;
+	if (servoId >= _numSmartServos || _streaming == true) return false;
+	waitUntilIsReady();
+	
+	// Step away from the start angle to the side which is inside the joint limits
+	long startAngle = getActAngle(servoId);
+	long otherAngle = startAngle + stepAngle;
+	if (checkIfAngleValid(servoId, otherAngle) == false) {
+		otherAngle = startAngle - stepAngle;
+		if (checkIfAngleValid(servoId, otherAngle) == false) return false;
+	}
+	
+	Serial.print(F("Tuning motor "));
+	Serial.print(servoId);
+	Serial.println(F(", this takes some minutes..."));
+	bool success = smartServos.tunePid(servoId+1, startAngle, otherAngle, _speedRPM, &tune);
+	smartServos.moveTo(servoId+1, startAngle, _speedRPM);
+	_goalAngles[servoId] = startAngle;
+	_tcpPoseIsValid = false;
+	waitUntilIsReady();
+	if (success == false) {
+		Serial.println(F("ERROR: Tuning failed, the initial gains were restored."));
+		return false;
+	}
+	
+	Serial.print(F("PID: "));
+	Serial.print(tune.pid.p, 3);
+	Serial.print(F(", "));
+	Serial.print(tune.pid.i, 3);
+	Serial.print(F(", "));
+	Serial.print(tune.pid.d, 3);
+	Serial.print(F(" Settle time [ms]: "));
+	Serial.print(tune.before.settleTime);
+	Serial.print(F(" -> "));
+	Serial.println(tune.after.settleTime);
+	if (result != NULL) *result = tune;
+	return true;
+}
+
+bool morobotClass::saveJointPids(const char* name){
+	#if defined(ESP32)
+		Preferences prefs;
+		servo_pid_type pid;
+		char key[8];
+		bool success = true;
+		if (prefs.begin(name, false) == false) return false;
+		for (uint8_t i=0; i<_numSmartServos; i++) {
+			snprintf(key, sizeof(key), "pid%u", i);
+			if (getJointPid(i, pid) == false || prefs.putBytes(key, &pid, sizeof(pid)) != sizeof(pid)) success = false;
+		}
+		prefs.end();
+		return success;
+	#else
+		return false;
+	#endif
+}
+
+bool morobotClass::loadJointPids(const char* name){
+	#if defined(ESP32)
+		Preferences prefs;
+		servo_pid_type pid;
+		char key[8];
+		bool success = true;
+		if (prefs.begin(name, true) == false) return false;
+		for (uint8_t i=0; i<_numSmartServos; i++) {
+			snprintf(key, sizeof(key), "pid%u", i);
+			if (prefs.getBytes(key, &pid, sizeof(pid)) != sizeof(pid) || setJointPid(i, pid.p, pid.i, pid.d) == false) success = false;
+		}
+		prefs.end();
+		return success;
+	#else
+		return false;
+	#endif
+}
+
 /* HELPER */
 void morobotClass::printAngles(long angles[]){
 	for (uint8_t i=0; i<_numSmartServos; i++) {
@@ -412,6 +1152,47 @@ void morobotClass::autoCalibrateLinearAxis(uint8_t servoId, uint8_t maxMotorCurr
 	Serial.println(F("Linear axis set zero!"));
 }
 
+bool morobotClass::moveJointsTo(long angles[], uint8_t speedRPM){
+	smartServoHandle handles[NUM_MAX_SERVOS];
+	bool valid[NUM_MAX_SERVOS];
+	uint8_t speeds[NUM_MAX_SERVOS];
+	uint8_t numHandles = 0;
+	
+	// Check all angles before sending anything so the commands can go out back-to-back
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		valid[i] = checkIfAngleValid(i, angles[i]);
+		speeds[i] = speedRPM;
+	}
+	if (_synchronizedMoves == true && syncJointSpeeds(angles, valid, speedRPM, speeds) == false) return false;
+	
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (valid[i] == true) handles[numHandles++] = smartServos.moveToAsync(i+1, angles[i], speeds[i]);
+		_goalAngles[i] = (valid[i] == true) ? angles[i] : NAN;
+	}
+	if (numHandles > 0) _tcpPoseIsValid = false;
+	
+	// Collect the acknowledges after all joints have been started
+	return smartServos.waitForAll(handles, numHandles);
+}
+
+bool morobotClass::syncJointSpeeds(long angles[], const bool valid[], uint8_t speedRPM, uint8_t speeds[]){
+	long actAngles[NUM_MAX_SERVOS];
+	long maxTravel = 0;
+	
+	if (getActAngles(actAngles) == false) return false;
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (valid[i] == true && labs(angles[i] - actAngles[i]) > maxTravel) maxTravel = labs(angles[i] - actAngles[i]);
+	}
+	if (maxTravel == 0) return true;
+	
+	// Travel time is travel / speed, so equal times need speeds proportional to the travel
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		long speed = lround((float)speedRPM * labs(angles[i] - actAngles[i]) / maxTravel);
+		speeds[i] = constrain(speed, 1L, (long)speedRPM);
+	}
+	return true;
+}
+
 bool morobotClass::checkForNANerror(uint8_t servoId, float angle){
 	// The values are NAN if the inverse kinematics does not provide a solution
 	if(isnan(angle)){
@@ -434,13 +1215,431 @@ void morobotClass::printInvalidAngleError(uint8_t servoId, float angle){
 	_tcpPoseIsValid = false;
 }
 
-/* ROBOT STATUS PRIVATE */
-bool morobotClass::isReady(){
+/* BUS PRIVATE */
+void morobotClass::setPortBaudRate(long baudRate){
+	// All ports used in begin() are hardware serials
+	HardwareSerial* uart = static_cast<HardwareSerial*>(_port);
+	uart->flush();
+	#if defined(ESP32) || defined(ESP8266)
+		uart->updateBaudRate(baudRate);	// Keeps the pin mapping of begin()
+	#else
+		uart->begin(baudRate);
+	#endif
+}
+
+/* STREAMING PRIVATE */
+void morobotClass::streamTick(unsigned long elapsedMs){
+	long angles[NUM_MAX_SERVOS];
+	uint8_t speeds[NUM_MAX_SERVOS];
+	int16_t pwm[NUM_MAX_SERVOS];
+	bool pwmMode[NUM_MAX_SERVOS];
+	
+	// After a long blocking call the joints continue where they were instead of jumping
+	if (elapsedMs > 4UL*_streamPeriod) elapsedMs = 4UL*_streamPeriod;
+	float dt = elapsedMs / 1000.0;
+	float leadTime = MOROBOT_STREAM_LEAD*_streamPeriod/1000.0;
+	
+	lockStream();
+	// Position along the trajectory now and at the setpoint ahead, shared by all joints following it
+	_trajectory.time += dt;
+	float trajPosition = sampleTrajectory(_trajectory, _trajectory.time);
+	float trajLead = sampleTrajectory(_trajectory, _trajectory.time + leadTime);
+	bool trajDone = (_trajectory.time >= 2*_trajectory.accelTime + _trajectory.cruiseTime);
+	
 	for (uint8_t i=0; i<_numSmartServos; i++) {
-		if (_angleReached[i] == false) {
-			if (checkIfMotorMoves(i) == false) continue;
-			return false;
+		morobotStreamJoint &joint = _streamJoints[i];
+		pwmMode[i] = (joint.mode == STREAM_MODE_PWM);
+		if (pwmMode[i] == true) {
+			pwm[i] = joint.pwm;
+			continue;
+		}
+		
+		if (joint.mode == STREAM_MODE_TRAJECTORY) {
+			// The velocity is the average up to the setpoint ahead, so the servo arrives there when the trajectory does
+			float scale = (_trajectory.distance > 0) ? (joint.goal - joint.start)/_trajectory.distance : 0;
+			joint.position = joint.start + scale*trajPosition;
+			joint.velocity = scale*(trajLead - trajPosition)/leadTime;
+			if (trajDone == true) {
+				joint.position = joint.goal;
+				joint.velocity = 0;
+				joint.mode = STREAM_MODE_POSITION;
+			}
+		} else {
+			// Velocity the joint should have: the jog velocity, or towards the goal as fast as it can still brake
+			float desired = joint.maxVelocity;
+			float distance = joint.goal - joint.position;
+			if (joint.mode == STREAM_MODE_POSITION) {
+				if (_streamAccel > 0) desired = min(desired, (float)sqrt(2*_streamAccel*fabs(distance)));
+				if (distance < 0) desired = -desired;
+			}
+			if (_streamAccel > 0) joint.velocity = constrain(desired, joint.velocity - _streamAccel*dt, joint.velocity + _streamAccel*dt);
+			else joint.velocity = desired;
+			joint.position += joint.velocity*dt;
+			
+			if (joint.mode == STREAM_MODE_POSITION && distance*(joint.goal - joint.position) <= 0) {
+				joint.position = joint.goal;
+				joint.velocity = 0;
+			}
+		}
+		float limited = limitStreamAngle(i, joint.position);
+		if (limited != joint.position) {
+			joint.position = limited;
+			joint.velocity = 0;
+		}
+		
+		// The servo gets a setpoint some periods ahead at the streamed velocity, so it moves on until the next setpoint arrives
+		float setpoint = joint.position + joint.velocity*leadTime;
+		if (joint.mode != STREAM_MODE_VELOCITY && (joint.goal - joint.position)*(joint.goal - setpoint) <= 0) {
+			angles[i] = lround(joint.goal);
+		} else {
+			// Angles are whole degrees: round in the direction of motion so the servo does not wait behind the streamed position
+			setpoint = limitStreamAngle(i, setpoint);
+			if (joint.velocity > 0) angles[i] = (long)ceil(setpoint);
+			else if (joint.velocity < 0) angles[i] = (long)floor(setpoint);
+			else angles[i] = lround(setpoint);
+		}
+		speeds[i] = constrain((int)ceil(fabs(joint.velocity)/6), 1, SERVO_MAX_SPEED_RPM);
+	}
+	unlockStream();
+	
+	// No acknowledges are waited for: a lost setpoint is replaced by the next one
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (pwmMode[i] == true) smartServos.streamPwmMove(i+1, pwm[i]);
+		else smartServos.streamMoveTo(i+1, angles[i], speeds[i]);
+	}
+}
+
+void morobotClass::streamTask(void *arg){
+	#if defined(ESP32)
+		morobotClass* robot = (morobotClass*)arg;
+		TickType_t period = pdMS_TO_TICKS(robot->_streamPeriod);
+		if (period == 0) period = 1;
+		TickType_t lastWake = xTaskGetTickCount();
+		while (robot->_streaming == true) {
+			vTaskDelayUntil(&lastWake, period);
+			unsigned long now = millis();
+			robot->streamTick(now - robot->_lastStreamTick);
+			robot->_lastStreamTick = now;
 		}
+		robot->_streamTaskHandle = NULL;
+		vTaskDelete(NULL);
+	#endif
+}
+
+float morobotClass::limitStreamAngle(uint8_t servoId, float angle){
+	if (servoId >= _numSmartServos) return angle;
+	return constrain(angle, (float)_robotJointLimits[servoId][0], (float)_robotJointLimits[servoId][1]);
+}
+
+void morobotClass::planTrajectory(morobotTrajectory &traj, float velocity, float acceleration, float jerk){
+	bool scurve = (jerk > 0);
+	traj.time = 0;
+	traj.velocity = velocity;
+	traj.acceleration = acceleration;
+	traj.jerk = scurve ? jerk : 0;
+	traj.jerkTime = 0;
+	traj.accelTime = 0;
+	traj.cruiseTime = 0;
+	if (traj.distance <= 0) return;
+	
+	// An S-curve only reaches the acceleration limit if both jerk phases fit below the velocity limit
+	if (scurve) traj.acceleration = min(traj.acceleration, (float)sqrt(traj.velocity*traj.jerk));
+	if (scurve) traj.jerkTime = traj.acceleration/traj.jerk;
+	traj.accelTime = traj.velocity/traj.acceleration + traj.jerkTime;
+	
+	// Too short to reach the velocity limit: lower the peak velocity so acceleration and deceleration cover the distance
+	if (traj.velocity*traj.accelTime > traj.distance) {
+		if (scurve == false) {
+			traj.velocity = sqrt(traj.distance*traj.acceleration);
+		} else {
+			float a = acceleration;
+			traj.velocity = a/2*(sqrt(pow(a/traj.jerk, 2) + 4*traj.distance/a) - a/traj.jerk);
+			traj.acceleration = a;
+			if (traj.velocity < pow(a, 2)/traj.jerk) {
+				// The acceleration limit is not reached either, the profile consists of the jerk phases only
+				traj.velocity = pow(pow(traj.distance, 2)*traj.jerk/4, 1.0/3);
+				traj.acceleration = sqrt(traj.velocity*traj.jerk);
+			}
+			traj.jerkTime = traj.acceleration/traj.jerk;
+		}
+		traj.accelTime = traj.velocity/traj.acceleration + traj.jerkTime;
+	}
+	traj.cruiseTime = max(0.0f, (traj.distance - traj.velocity*traj.accelTime)/traj.velocity);
+}
+
+float morobotClass::sampleTrajectory(const morobotTrajectory &traj, float time){
+	float totalTime = 2*traj.accelTime + traj.cruiseTime;
+	float accelDistance = traj.velocity*traj.accelTime/2;
+	if (time <= 0) return 0;
+	if (time >= totalTime) return traj.distance;
+	if (time >= traj.accelTime && time <= traj.accelTime + traj.cruiseTime) return accelDistance + traj.velocity*(time - traj.accelTime);
+	
+	// The deceleration mirrors the acceleration
+	bool decelerating = (time > traj.accelTime);
+	float t = decelerating ? totalTime - time : time;
+	float position;
+	if (t < traj.jerkTime) {
+		position = traj.jerk*t*t*t/6;
+	} else if (t <= traj.accelTime - traj.jerkTime) {
+		float u = t - traj.jerkTime;
+		position = traj.jerk*pow(traj.jerkTime, 3)/6 + traj.acceleration*traj.jerkTime/2*u + traj.acceleration*u*u/2;
+	} else {
+		float u = traj.accelTime - t;
+		position = accelDistance - (traj.velocity*u - traj.jerk*u*u*u/6);
 	}
+	return decelerating ? traj.distance - position : position;
+}
+
+bool morobotClass::calculatePathAngles(const float start[], const float travel[], const morobotTrajectory &path, float time, float angles[]){
+	float scale = (path.distance > 0) ? sampleTrajectory(path, time)/path.distance : 1;
+	if (calculateAngles(start[0] + scale*travel[0], start[1] + scale*travel[1], start[2] + scale*travel[2]) == false) return false;
+	for (uint8_t i=0; i<_numSmartServos; i++) angles[i] = _goalAngles[i];
 	return true;
 }
+
+void morobotClass::lockStream(){
+	#if defined(ESP32)
+		portENTER_CRITICAL(&_streamMux);
+	#endif
+}
+
+void morobotClass::unlockStream(){
+	#if defined(ESP32)
+		portEXIT_CRITICAL(&_streamMux);
+	#endif
+}
+
+/* ROBOT STATUS PRIVATE */
+bool morobotClass::isReady(unsigned long waitTime){
+	uint8_t reportingIds[NUM_MAX_SERVOS];
+	uint8_t numReporting = 0;
+	uint8_t pollIds[NUM_MAX_SERVOS];
+	uint8_t numPolled = 0;
+	
+	// Motors which report reaching their position are waited for without reading their angles
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (_angleReached[i] == false && smartServos.getMoveState(i+1) == MOVE_STATE_MOVING && smartServos.reportsPositionReached(i+1) == true) {
+			reportingIds[numReporting++] = i+1;
+		}
+	}
+	if (numReporting > 0) smartServos.waitForPositionReached(reportingIds, numReporting, waitTime);
+	
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (_angleReached[i] == true) continue;
+		uint8_t moveState = smartServos.getMoveState(i+1);
+		if (moveState == MOVE_STATE_IDLE) {
+			_angleReached[i] = true;
+			continue;
+		}
+		if (moveState == MOVE_STATE_MOVING && smartServos.reportsPositionReached(i+1) == true && smartServos.isReportOverdue(i+1) == false) return false;
+		pollIds[numPolled++] = i;
+	}
+	
+	// Fallback for moves and firmware without arrival report: check if the motors still move
+	if (numPolled == 0) return true;
+	return pollMotorsStopped(pollIds, numPolled);
+}
+
+bool morobotClass::pollMotorsStopped(const uint8_t servoIds[], uint8_t numServos){
+	// Motors already at their goal are done without the second reading, the others share one interval
+	if (readPollAngles(servoIds, numServos, true) == true) return true;
+	delay(MOROBOT_POLL_INTERVAL);
+	return readPollAngles(servoIds, numServos, false);
+}
+
+bool morobotClass::readPollAngles(const uint8_t servoIds[], uint8_t numServos, bool first){
+	smartServoHandle handles[NUM_MAX_SERVOS];
+	bool moving = false;
+	
+	for (uint8_t i=0; i<numServos; i++) {
+		handles[i] = (_angleReached[servoIds[i]] == false) ? smartServos.requestAsync(servoIds[i]+1, GET_SERVO_CUR_ANGLE) : SMART_SERVO_INVALID_HANDLE;
+	}
+	for (uint8_t i=0; i<numServos; i++) {
+		uint8_t id = servoIds[i];
+		if (_angleReached[id] == true) continue;
+		if (handles[i] == SMART_SERVO_INVALID_HANDLE || smartServos.waitFor(handles[i]) == false) {
+			_pollValid[id] = false;
+			moving = true;
+			continue;
+		}
+		
+		// Done at the goal angle or if the angle did not change since the previous reading
+		long angle = smartServos.getDeviceData(id+1).angleValue;
+		bool atGoal = (_goalTolerance >= 0 && !isnan(_goalAngles[id]) && fabs(angle - _goalAngles[id]) <= _goalTolerance);
+		bool stopped = (first == false && _pollValid[id] == true && angle == _pollAngles[id]);
+		if (atGoal == true || stopped == true) {
+			smartServos.setPositionReached(id+1);
+			_angleReached[id] = true;
+			_pollValid[id] = false;
+			continue;
+		}
+		_pollAngles[id] = angle;
+		_pollValid[id] = true;
+		moving = true;
+	}
+	return !moving;
+}
+
+bool morobotClass::checkIfReady(){
+	uint8_t pollIds[NUM_MAX_SERVOS];
+	uint8_t numPolled = 0;
+	bool waiting = false;
+	
+	smartServos.smartServoEventHandle();
+	for (uint8_t i=0; i<_numSmartServos; i++) {
+		if (_angleReached[i] == true) continue;
+		uint8_t moveState = smartServos.getMoveState(i+1);
+		if (moveState == MOVE_STATE_IDLE) {
+			_angleReached[i] = true;
+			continue;
+		}
+		// A joint whose arrival report is overdue is polled like one without report
+		if (moveState == MOVE_STATE_MOVING && smartServos.reportsPositionReached(i+1) == true && smartServos.isReportOverdue(i+1) == false) {
+			waiting = true;
+			continue;
+		}
+		pollIds[numPolled++] = i;
+	}
+	if (numPolled == 0) {
+		_pollStarted = false;
+		return !waiting;
+	}
+	
+	// Motors without arrival report are read once per interval and compared with their previous reading
+	if (_pollStarted == true && millis() - _pollTime < MOROBOT_POLL_INTERVAL) return false;
+	_pollStarted = !readPollAngles(pollIds, numPolled, !_pollStarted);
+	_pollTime = millis();
+	return !waiting && !_pollStarted;
+}
+
+/* ASYNCHRONOUS MOVEMENTS PRIVATE */
+morobotMoveHandle morobotClass::beginMove(long angles[], uint8_t speedRPM, const float pose[]){
+	_move.handle = _nextMoveHandle;
+	_nextMoveHandle = (_nextMoveHandle == INT16_MAX) ? 0 : _nextMoveHandle + 1;
+	for (uint8_t i=0; i<_numSmartServos; i++) _move.angles[i] = angles[i];
+	_move.speedRPM = speedRPM;
+	_move.hasPose = (pose != NULL);
+	if (pose != NULL) for (uint8_t i=0; i<3; i++) _move.pose[i] = pose[i];
+	_move.state = MOROBOT_MOVE_WAITING;
+	_move.stateTime = millis();
+	setBusy();
+	_pollStarted = false;
+	
+	// Starts right away if the robot is idle
+	updateMotion();
+	return _move.handle;
+}
+
+void morobotClass::startMove(){
+	bool acknowledged = moveJointsTo(_move.angles, _move.speedRPM);
+	if (_move.hasPose == true) {
+		_actPos[0] = _move.pose[0];
+		_actPos[1] = _move.pose[1];
+		_actPos[2] = _move.pose[2];
+		_tcpPoseIsValid = true;
+	}
+	_move.state = (acknowledged == true) ? MOROBOT_MOVE_RUNNING : MOROBOT_MOVE_FAILED;
+	_move.stateTime = millis();
+	setBusy();
+	_pollStarted = false;
+}
+
+/* MOTION QUEUE PRIVATE */
+morobotMoveHandle morobotClass::enqueue(morobotQueueEntry &entry){
+	morobotMoveHandle id = MOROBOT_NO_MOVE;
+	lockQueue();
+	if (_queueLength < MOROBOT_QUEUE_SIZE) {
+		id = _nextQueueId;
+		_nextQueueId = (_nextQueueId == INT16_MAX) ? 0 : _nextQueueId + 1;
+		entry.id = id;
+		// The angles are copied into the storage of the queue slot, the caller's array may go out of scope
+		morobotQueueEntry &slot = _queue[(_queueHead + _queueLength) % MOROBOT_QUEUE_SIZE];
+		long *slotAngles = slot.angles;
+		if (entry.type == QUEUE_ENTRY_JOINTS) for (uint8_t i=0; i<_numSmartServos; i++) slotAngles[i] = entry.angles[i];
+		slot = entry;
+		slot.angles = slotAngles;
+		_queueLength++;
+	}
+	unlockQueue();
+	return id;
+}
+
+void morobotClass::queueStep(){
+	// Requested by clearQueue(): stop a running move and report all entries as cancelled
+	if (_queueCancel == true) {
+		_queueCancel = false;
+		if (_queueLength > 0 && _queueEntryStarted == true && _queueEntryResult == MOROBOT_MOVE_RUNNING) cancelMove(_move.handle);
+		while (_queueLength > 0) finishQueueEntry(MOROBOT_MOVE_CANCELLED);
+		return;
+	}
+	if (_queueLength == 0) return;
+	
+	morobotQueueEntry &entry = _queue[_queueHead];
+	if (_queueEntryStarted == false) {
+		_queueEntryStarted = true;
+		_queueEntryTime = millis();
+		_queueEntryResult = startQueueEntry(entry);
+	}
+	
+	uint8_t result = _queueEntryResult;
+	if (result == MOROBOT_MOVE_RUNNING) {
+		if (entry.type == QUEUE_ENTRY_DWELL) {
+			if (millis() - _queueEntryTime >= entry.duration) result = MOROBOT_MOVE_DONE;
+		} else {
+			result = getMoveState(_move.handle);
+		}
+	}
+	if (result >= MOROBOT_MOVE_DONE) finishQueueEntry(result);
+}
+
+uint8_t morobotClass::startQueueEntry(morobotQueueEntry &entry){
+	morobotMoveHandle handle = MOROBOT_NO_MOVE;
+	if (entry.type == QUEUE_ENTRY_JOINTS) {
+		handle = moveToAnglesAsync(entry.angles, entry.speedRPM);
+	} else if (entry.type == QUEUE_ENTRY_POSE) {
+		handle = moveToPoseAsync(entry.pose[0], entry.pose[1], entry.pose[2]);
+	} else if (entry.type == QUEUE_ENTRY_GRIPPER) {
+		// The gripper functions wait until the gripper finished moving
+		if (entry.close == true) entry.eef->close();
+		else entry.eef->open();
+		return MOROBOT_MOVE_DONE;
+	} else {
+		return MOROBOT_MOVE_RUNNING;
+	}
+	return (handle == MOROBOT_NO_MOVE) ? MOROBOT_MOVE_FAILED : MOROBOT_MOVE_RUNNING;
+}
+
+void morobotClass::finishQueueEntry(uint8_t result){
+	morobotMoveHandle id;
+	lockQueue();
+	id = _queue[_queueHead].id;
+	_queueHead = (_queueHead + 1) % MOROBOT_QUEUE_SIZE;
+	_queueLength--;
+	unlockQueue();
+	_queueEntryStarted = false;
+	if (_queueCallback != NULL) _queueCallback(id, result);
+}
+
+void morobotClass::queueTask(void *arg){
+	#if defined(ESP32)
+		morobotClass* robot = (morobotClass*)arg;
+		while (robot->_queueRunning == true) {
+			robot->queueStep();
+			vTaskDelay(pdMS_TO_TICKS(MOROBOT_QUEUE_PERIOD));
+		}
+		robot->_queueTaskHandle = NULL;
+		vTaskDelete(NULL);
+	#endif
+}
+
+void morobotClass::lockQueue(){
+	#if defined(ESP32)
+		portENTER_CRITICAL(&_queueMux);
+	#endif
+}
+
+void morobotClass::unlockQueue(){
+	#if defined(ESP32)
+		portEXIT_CRITICAL(&_queueMux);
+	#endif
+}
@@ -6,11 +6,14 @@
  *  @date	2020/11/27
  *  \par Method List:
  *  	public:
- *  		morobotClass(uint8_t numSmartServos);
+ *  		morobotClass(morobotStorage<NUM_JOINTS, NUM_SERVOS> &storage);
 			void begin(const char* stream);
+			long negotiateBaudRate(long baudRate);
+			long getBaudRate();
 			void setZero();
 			void moveHome();
 			void setSpeedRPM(uint8_t speed);
+			void setSynchronizedMoves(bool synchronized);
 			virtual void setTCPoffset(float xOffset, float yOffset, float zOffset);
 			virtual bool checkIfAngleValid(uint8_t servoId, float angle);
 			
@@ -21,14 +24,22 @@
 			void setIdle();
 			void waitUntilIsReady();
 			bool checkIfMotorMoves(uint8_t servoId);
+			void setGoalTolerance(float tolerance);
 			
 			long getActAngle(uint8_t servoId);
+			bool getActAngles(long angles[]);
 			float getActPosition(char axis);
 			float getActOrientation(char axis);
-			float getSpeed(uint8_t servoId);
-			float getTemp(uint8_t servoId);
-			float getVoltage(uint8_t servoId);
-			float getCurrent(uint8_t servoId);
+			float getSpeed(uint8_t servoId, bool forceRefresh=false);
+			float getTemp(uint8_t servoId, bool forceRefresh=false);
+			float getVoltage(uint8_t servoId, bool forceRefresh=false);
+			float getCurrent(uint8_t servoId, bool forceRefresh=false);
+			bool readTelemetrySnapshot(morobotTelemetry &snapshot, bool forceRefresh=false);
+			void setCacheTTL(uint8_t field, uint16_t ttl);
+			void printBusStats(Print &out);
+			void resetBusStats();
+			void beginBusCapture(servo_capture_type *buffer, uint16_t size);
+			void printBusCapture(Print &out);
 			long getJointLimit(uint8_t servoId, bool limitNum);
 			uint8_t getAxisLimit(char axis, bool limitNum);
 			uint8_t getNumSmartServos();
@@ -44,6 +55,49 @@
 			bool moveToPose(float x, float y, float z);
 			bool moveXYZ(float xOffset, float yOffset, float zOffset);
 			bool moveInDirection(char axis, float value);
+			bool moveLinear(float x, float y, float z, float speed);
+			
+			morobotMoveHandle moveToAnglesAsync(long angles[]);
+			morobotMoveHandle moveToAnglesAsync(long angles[], uint8_t speedRPM);
+			morobotMoveHandle moveToPoseAsync(float x, float y, float z);
+			void updateMotion();
+			uint8_t getMoveState(morobotMoveHandle handle);
+			bool isMoveDone(morobotMoveHandle handle);
+			bool waitForMove(morobotMoveHandle handle, unsigned long timeout=TIMEOUT_DELAY);
+			bool cancelMove(morobotMoveHandle handle);
+			
+			bool beginQueue();
+			void endQueue();
+			void updateQueue();
+			morobotMoveHandle enqueueAngles(long angles[]);
+			morobotMoveHandle enqueueAngles(long angles[], uint8_t speedRPM);
+			morobotMoveHandle enqueuePose(float x, float y, float z);
+			morobotMoveHandle enqueueGripper(gripper *eef, bool close);
+			morobotMoveHandle enqueueDwell(unsigned long duration);
+			void setQueueCallback(morobotQueueCb callback);
+			uint8_t getQueueLength();
+			bool isQueueEntryDone(morobotMoveHandle id);
+			void clearQueue();
+			
+			bool beginStreaming(uint16_t periodMs=MOROBOT_STREAM_PERIOD);
+			void endStreaming();
+			bool isStreaming();
+			void updateStreaming();
+			void setStreamAcceleration(float acceleration);
+			void streamAngle(uint8_t servoId, float angle, float velocity);
+			void streamAngles(float angles[], float velocity);
+			void jogJoint(uint8_t servoId, float velocity);
+			void streamPwm(uint8_t servoId, int16_t pwm);
+			float getStreamSetpoint(uint8_t servoId);
+			void setTrajectoryLimits(float velocity, float acceleration, float jerk);
+			float streamTrajectory(float angles[], uint8_t profile=PROFILE_SCURVE);
+			bool isTrajectoryDone();
+			
+			bool setJointPid(uint8_t servoId, float p, float i, float d);
+			bool getJointPid(uint8_t servoId, servo_pid_type &pid);
+			bool autoTuneJoint(uint8_t servoId, long stepAngle=MOROBOT_TUNE_STEP, servo_pid_tune_type *result=NULL);
+			bool saveJointPids(const char* name="morobot");
+			bool loadJointPids(const char* name="morobot");
 			
 			void printAngles(long angles[]);
 			void printTCPpose();
@@ -54,8 +108,31 @@
 			virtual bool calculateAngles(float x, float y, float z);
 			virtual void updateTCPpose(bool output);
 			void autoCalibrateLinearAxis(uint8_t servoId, uint8_t maxMotorCurrent=25);
+			bool moveJointsTo(long angles[], uint8_t speedRPM);
+			bool syncJointSpeeds(long angles[], const bool valid[], uint8_t speedRPM, uint8_t speeds[]);
 		private:
-			bool isReady();
+			bool isReady(unsigned long waitTime = 0);
+			bool pollMotorsStopped(const uint8_t servoIds[], uint8_t numServos);
+			bool readPollAngles(const uint8_t servoIds[], uint8_t numServos, bool first);
+			bool checkIfReady();
+			morobotMoveHandle beginMove(long angles[], uint8_t speedRPM, const float pose[]=NULL);
+			void startMove();
+			morobotMoveHandle enqueue(morobotQueueEntry &entry);
+			void queueStep();
+			uint8_t startQueueEntry(morobotQueueEntry &entry);
+			void finishQueueEntry(uint8_t result);
+			static void queueTask(void *arg);
+			void lockQueue();
+			void unlockQueue();
+			void setPortBaudRate(long baudRate);
+			void streamTick(unsigned long elapsedMs);
+			static void streamTask(void *arg);
+			float limitStreamAngle(uint8_t servoId, float angle);
+			void planTrajectory(morobotTrajectory &traj, float velocity, float acceleration, float jerk);
+			float sampleTrajectory(const morobotTrajectory &traj, float time);
+			bool calculatePathAngles(const float start[], const float travel[], const morobotTrajectory &path, float time, float angles[]);
+			void lockStream();
+			void unlockStream();
  */
 
 #include <Arduino.h>
@@ -74,15 +151,142 @@
 #define BREAK_LOOSE  1			//!< Defines if a break of a smart-servo is loose
 #define BREAK_BRAKED 0			//!< Defines if a break of a smart-servo is set
 #define NUM_MAX_SERVOS 10		//!< Maximum number of smart servos usable in one robot object
+#define MOROBOT_EEF_SERVOS 1	//!< Smart servos on the bus of a robot in addition to its joints (a gripper gets the id after the last joint)
 #define TIMEOUT_DELAY 15000		//!< Delaytime until the robot stops waiting for motors to finish their movement
+#define MOROBOT_POLL_INTERVAL 150	//!< Time in ms between the two angle readings that check if motors without arrival report still move
+#define MOROBOT_GOAL_TOLERANCE 1	//!< Default deviation in degrees from the goal angle a polled motor counts as arrived with
+#define MOROBOT_STREAM_PERIOD 20	//!< Default period in ms at which the streaming mode sends setpoints to all joints
+#define MOROBOT_STREAM_LEAD 3		//!< Number of periods an angle setpoint is sent ahead of the streamed position, so a servo does not stop between two setpoints
+#define MOROBOT_STREAM_ACCEL 200	//!< Default acceleration of streamed joints in degrees/s^2
+#define MOROBOT_STREAM_MAX_VELOCITY (6.0f * SERVO_MAX_SPEED_RPM)	//!< Highest velocity of streamed joints in degrees/s
+#define MOROBOT_STREAM_TASK_STACK 3072	//!< Stack size of the streaming task (ESP32)
+#define MOROBOT_STREAM_TASK_PRIO 4	//!< Priority of the streaming task, below the receive task of the smart servo driver (ESP32)
+#define MOROBOT_TRAJ_VELOCITY 240	//!< Default velocity limit of trajectories in degrees/s (40 RPM)
+#define MOROBOT_TRAJ_ACCEL 600		//!< Default acceleration limit of trajectories in degrees/s^2
+#define MOROBOT_TRAJ_JERK 4000		//!< Default jerk limit of S-curve trajectories in degrees/s^3
+#define MOROBOT_LINEAR_PERIOD 20	//!< Period in ms at which moveLinear() solves the inverse kinematics and sends setpoints
+#define MOROBOT_LINEAR_ACCEL 500	//!< Acceleration limit of the TCP along the path of moveLinear() in mm/s^2
+#define MOROBOT_LINEAR_JERK 5000	//!< Jerk limit of the TCP along the path of moveLinear() in mm/s^3
+#define MOROBOT_TUNE_STEP 30		//!< Default step in degrees a joint is moved back and forth with while its PID gains are tuned
+#define MOROBOT_QUEUE_SIZE 8		//!< Number of entries the motion queue holds
+#define MOROBOT_QUEUE_PERIOD 5		//!< Time in ms between two steps of the motion queue task (ESP32)
+#define MOROBOT_QUEUE_TASK_STACK 4096	//!< Stack size of the motion queue task (ESP32)
+#define MOROBOT_QUEUE_TASK_PRIO 3	//!< Priority of the motion queue task, below the streaming task (ESP32)
+
+#define STREAM_MODE_VELOCITY 0		//!< Streamed joint moves with a velocity (jogging)
+#define STREAM_MODE_POSITION 1		//!< Streamed joint moves towards a goal angle
+#define STREAM_MODE_PWM 2			//!< Streamed joint is driven with a pwm value
+#define STREAM_MODE_TRAJECTORY 3	//!< Streamed joint follows the trajectory of morobotClass::streamTrajectory()
+
+#define PROFILE_TRAPEZOID 0			//!< Trajectory with limited velocity and acceleration (the acceleration jumps)
+#define PROFILE_SCURVE 1			//!< Trajectory with limited velocity, acceleration and jerk (the acceleration ramps)
+
+#define MOROBOT_NO_MOVE -1			//!< Returned instead of a move handle if the move could not be started
+#define MOROBOT_MOVE_WAITING 0		//!< Asynchronous move waits until the previous motion of the robot has finished
+#define MOROBOT_MOVE_RUNNING 1		//!< Asynchronous move has been sent, the joints are moving
+#define MOROBOT_MOVE_DONE 2			//!< All joints of the asynchronous move reached their position
+#define MOROBOT_MOVE_CANCELLED 3	//!< Asynchronous move was cancelled with morobotClass::cancelMove()
+#define MOROBOT_MOVE_FAILED 4		//!< A joint did not acknowledge the move or did not stop before TIMEOUT_DELAY (also returned for unknown handles)
+
+#define QUEUE_ENTRY_JOINTS 0		//!< Queue entry moves all joints to angles
+#define QUEUE_ENTRY_POSE 1			//!< Queue entry moves the TCP to a position
+#define QUEUE_ENTRY_GRIPPER 2		//!< Queue entry opens or closes a gripper
+#define QUEUE_ENTRY_DWELL 3			//!< Queue entry waits for a time
+
+typedef int16_t morobotMoveHandle;	//!< Handle of an asynchronous move or id of a queue entry, see morobotClass::moveToAnglesAsync()
+typedef void (*morobotQueueCb)(morobotMoveHandle id, uint8_t result);	//!< Called when a queue entry is done, result is MOROBOT_MOVE_DONE, _CANCELLED or _FAILED
+
+class gripper;
+
+/**
+ *  \brief Telemetry of all smart servos of a robot. Filled by morobotClass::readTelemetrySnapshot()
+ */
+typedef struct {
+	uint8_t numServos;							//!< Number of valid entries in the arrays (number of smart servos of the robot)
+	servo_device_type servo[NUM_MAX_SERVOS];	//!< Angle, speed, voltage, temperature and current of each motor (first motor has index 0)
+	bool valid[NUM_MAX_SERVOS];					//!< False if at least one value of the motor was not received
+	unsigned long timestamp;					//!< Time (millis()) at which the snapshot was completed
+} morobotTelemetry;
+
+/**
+ *  \brief State of one joint in the streaming mode. See morobotClass::beginStreaming()
+ */
+typedef struct {
+	float position;		//!< Streamed position in degrees, advanced every period
+	float velocity;		//!< Velocity of the streamed position in degrees/s
+	float goal;			//!< Goal angle in degrees (STREAM_MODE_POSITION, STREAM_MODE_TRAJECTORY)
+	float start;		//!< Streamed position at the start of the trajectory in degrees (STREAM_MODE_TRAJECTORY)
+	float maxVelocity;	//!< Jog velocity (STREAM_MODE_VELOCITY) or maximum velocity towards the goal (STREAM_MODE_POSITION) in degrees/s
+	int16_t pwm;		//!< Pwm value (STREAM_MODE_PWM)
+	uint8_t mode;		//!< STREAM_MODE_VELOCITY, STREAM_MODE_POSITION, STREAM_MODE_PWM or STREAM_MODE_TRAJECTORY
+} morobotStreamJoint;
+
+/**
+ *  \brief Time-parameterized point-to-point move of all joints in the streaming mode. See morobotClass::streamTrajectory()
+ *  		All joints follow the same profile scaled to their travel, so they move on a straight line in joint space.
+ *  		The profile is planned for the joint with the longest travel and consists of acceleration, cruise and deceleration phases;
+ *  		for PROFILE_SCURVE each acceleration phase starts and ends with a phase of constant jerk.
+ *  		The start and goal angle of each joint are kept in its morobotStreamJoint.
+ */
+typedef struct {
+	float distance;					//!< Travel of the joint with the longest travel in degrees (length of the profile)
+	float velocity;					//!< Peak velocity of the profile in degrees/s
+	float acceleration;				//!< Peak acceleration of the profile in degrees/s^2
+	float jerk;						//!< Jerk of the profile in degrees/s^3 (PROFILE_SCURVE)
+	float jerkTime;					//!< Duration of each constant jerk phase in s (0 for PROFILE_TRAPEZOID)
+	float accelTime;				//!< Duration of the acceleration, and of the deceleration, in s
+	float cruiseTime;				//!< Duration of the constant velocity in s
+	float time;						//!< Time since the start of the trajectory in s
+} morobotTrajectory;
+
+/**
+ *  \brief State of the asynchronous move of a robot. See morobotClass::moveToAnglesAsync()
+ */
+typedef struct {
+	morobotMoveHandle handle;		//!< Handle of the move, MOROBOT_NO_MOVE before the first move
+	uint8_t state;					//!< MOROBOT_MOVE_WAITING, _RUNNING, _DONE, _CANCELLED or _FAILED
+	long *angles;					//!< Goal angles of the joints in degrees, one per smart servo (storage of the robot)
+	uint8_t speedRPM;				//!< Speed of the joints in RPM
+	bool hasPose;					//!< True if the move goes to a TCP position (morobotClass::moveToPoseAsync())
+	float pose[3];					//!< TCP position of the move in mm (in base frame)
+	unsigned long stateTime;		//!< Time (millis()) at which the move entered its state
+} morobotMove;
+
+/**
+ *  \brief Entry of the motion queue. See morobotClass::enqueueAngles()
+ */
+typedef struct {
+	morobotMoveHandle id;			//!< Id of the entry, reported when the entry is done
+	uint8_t type;					//!< QUEUE_ENTRY_JOINTS, _POSE, _GRIPPER or _DWELL
+	uint8_t speedRPM;				//!< Speed of the joints in RPM (joints)
+	long *angles;					//!< Goal angles of the joints in degrees, one per smart servo (joints)
+	float pose[3];					//!< TCP position in mm in base frame (pose)
+	gripper *eef;					//!< Gripper to open or close (gripper)
+	bool close;						//!< True to close the gripper, false to open it (gripper)
+	unsigned long duration;			//!< Time to wait in ms (dwell)
+} morobotQueueEntry;
+
+template<uint8_t NUM_JOINTS, uint8_t NUM_SERVOS> class morobotStorage;
 
 class morobotClass {
 	public:
 		/**
 		 *  \brief Constructor of morobot class
-		 *  \param [in] numSmartServos Number of smart servos of the robot
+		 *  \details The storage is provided by the child class, which derives from morobotStorage before morobotClass.
+		 *  		The number of smart servos of the robot is the number of joints of the storage, so all arrays fit.
+		 *  \param [in] storage Smart servo bus, joint limits and state arrays of the robot
 		 */
-		morobotClass(uint8_t numSmartServos);
+		template<uint8_t NUM_JOINTS, uint8_t NUM_SERVOS>
+		morobotClass(morobotStorage<NUM_JOINTS, NUM_SERVOS> &storage)
+			: smartServos(storage._servoBus), _numSmartServos(NUM_JOINTS), _robotJointLimits(storage._jointLimits),
+			  _angleReached(storage._angleReachedStorage), _goalAngles(storage._goalAnglesStorage), _streamJoints(storage._streamJointsStorage),
+			  _pollAngles(storage._pollAnglesStorage), _pollValid(storage._pollValidStorage){
+			for (uint8_t i=0; i<_numSmartServos; i++) _goalAngles[i] = NAN;
+			_move.handle = MOROBOT_NO_MOVE;
+			_move.state = MOROBOT_MOVE_FAILED;
+			_move.angles = storage._moveAnglesStorage;
+			for (uint8_t i=0; i<MOROBOT_QUEUE_SIZE; i++) _queue[i].angles = &storage._queueAnglesStorage[i*NUM_JOINTS];
+		};
 		
 		/**
 		 *  \brief Starts the communication with the smartservos of the robot
@@ -91,6 +295,22 @@ class morobotClass {
 		 */
 		void begin(const char* stream);
 		
+		/**
+		 *  \brief Switches the bus to a faster baud rate (opt-in, call after begin()).
+		 *  \details Every servo enumerated on the bus (the joints and e.g. the smart servo of a gripper) is told to switch and is checked with a handshake at the new rate afterwards.
+		 *  		 If any servo does not answer, all servos and the port are switched back to 115200 baud.
+		 *  		 The achieved rate is printed to the serial monitor.
+		 *  \param [in] baudRate Desired baud rate of the bus (e.g. 1000000)
+		 *  \return Baud rate the bus runs at after the negotiation.
+		 */
+		long negotiateBaudRate(long baudRate);
+		
+		/**
+		 *  \brief Returns the baud rate the bus to the servos runs at
+		 *  \return Baud rate of the bus
+		 */
+		long getBaudRate();
+		
 		/**
 		 *  \brief Sets the current position as origin (zero position)
 		 *  \details Call this function after bringing the motors into their initial (zero position) to store it permanently as 0 degrees
@@ -111,6 +331,16 @@ class morobotClass {
 		 */
 		void setSpeedRPM(uint8_t speed);
 		
+		/**
+		 *  \brief Switches the synchronized point-to-point mode on or off (default off).
+		 *  \details In the synchronized mode moveToAngles(), moveToPose() and the asynchronous and queued moves read the actual angles first
+		 *  		 and scale the speed of each joint to its travel, so all joints arrive at the same time on a straight line in joint space.
+		 *  		 The joint with the longest travel moves with the given speed. The speeds are rounded to whole RPM, which is the resolution of the servos,
+		 *  		 so joints with a short travel can arrive slightly early or late.
+		 *  \param [in] synchronized True to synchronize the joints, false to move every joint with the same speed
+		 */
+		void setSynchronizedMoves(bool synchronized);
+		
 		/**
 		 *  \brief Sets the position of the TCP (tool center point) with respect to the center of the flange of the last robot axis.
 					Virtual function. Defined individually for each robot type in the respective child classes.
@@ -161,6 +391,7 @@ class morobotClass {
 		/**
 		 *  \brief Waits until the robot is ready for new commants (all motors have stopped moving) or a timeout occurs.
 		 *  \details Function sets the robot idle only when all motors have stopped moving or a timeout occurs.
+		 *  		 Uses the arrival reports of the motors; motors whose firmware does not send them are polled.
 		 *  		 If a timeout occurs this is printed to the serial monitor.
 		 */
 		void waitUntilIsReady();
@@ -173,6 +404,15 @@ class morobotClass {
 		 */
 		bool checkIfMotorMoves(uint8_t servoId);
 		
+		/**
+		 *  \brief Sets the deviation from the goal angle a motor counts as arrived with when it is polled.
+		 *  \details Motors whose firmware does not report reaching their position are polled by waitUntilIsReady().
+		 *  		 A motor whose angle is within this tolerance of its last absolute goal is done without waiting
+		 *  		 for the second reading. Negative values disable the check, the motor is then done when it stops.
+		 *  \param [in] tolerance Deviation in degrees (default MOROBOT_GOAL_TOLERANCE)
+		 */
+		void setGoalTolerance(float tolerance);
+		
 		/* GETTERS */
 		/**
 		 *  \brief Returns angle-position of motor in degrees.
@@ -181,6 +421,15 @@ class morobotClass {
 		 */
 		long getActAngle(uint8_t servoId);
 		
+		/**
+		 *  \brief Reads the angle-positions of all motors in degrees.
+		 *  		The requests for all motors are sent at once and the responses are collected afterwards,
+		 *  		so reading the whole robot takes about one bus round trip instead of one per motor.
+		 *  \param [out] angles[] Array to store the angle-positions in (at least getNumSmartServos() elements)
+		 *  \return Returns true if all motors answered; false if a request failed, then the angles of the failed motors are outdated
+		 */
+		bool getActAngles(long angles[]);
+		
 		/**
 		 *  \brief Returns position of TCP in mm in given axis (in robot base frame).
 		 *  \param [in] axis Possible parameters: 'x', 'y', 'z'
@@ -198,30 +447,81 @@ class morobotClass {
 		/**
 		 *  \brief Returns current speed of motor in RPM (rounds per minute).
 		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] forceRefresh Request the value from the motor even if a recently received value is stored (optional)
 		 *  \return Current speed of motor in RPM.
 		 */
-		float getSpeed(uint8_t servoId);
+		float getSpeed(uint8_t servoId, bool forceRefresh=false);
 		
 		/**
 		 *  \brief Returns current temperature of motor in degrees Celsius.
 		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] forceRefresh Request the value from the motor even if a recently received value is stored (optional)
 		 *  \return Current temperature of motor in degrees Celsius.
 		 */
-		float getTemp(uint8_t servoId);
+		float getTemp(uint8_t servoId, bool forceRefresh=false);
 		
 		/**
 		 *  \brief Returns current voltage of motor.
 		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] forceRefresh Request the value from the motor even if a recently received value is stored (optional)
 		 *  \return Current voltage of motor.
 		 */
-		float getVoltage(uint8_t servoId);
+		float getVoltage(uint8_t servoId, bool forceRefresh=false);
 		
 		/**
 		 *  \brief Returns current current consumption of motor in Ampere.
 		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] forceRefresh Request the value from the motor even if a recently received value is stored (optional)
 		 *  \return Current current consumption of motor in Ampere.
 		 */
-		float getCurrent(uint8_t servoId);
+		float getCurrent(uint8_t servoId, bool forceRefresh=false);
+		
+		/**
+		 *  \brief Reads angle, speed, temperature, voltage and current of all motors at once.
+		 *  		All requests are sent back-to-back and the responses are collected afterwards,
+		 *  		instead of one bus round trip per value and motor. Motors which support GET_SERVO_STATUS
+		 *  		return all values with one response, the others are asked for every value.
+		 *  		Values which are still fresh in the cache of the smart servo driver are not requested again.
+		 *  \param [out] snapshot Structure to store the values in
+		 *  \param [in] forceRefresh Request all values from the motors, ignoring the cache (optional)
+		 *  \return Returns true if all values of all motors were received.
+		 */
+		bool readTelemetrySnapshot(morobotTelemetry &snapshot, bool forceRefresh=false);
+		
+		/**
+		 *  \brief Sets how long a received value is reused by getSpeed(), getTemp(), getVoltage(), getCurrent() and readTelemetrySnapshot()
+		 *  		before it is requested from the motor again. By default temperature and voltage are cached for 2 seconds, all other values are not cached.
+		 *  \param [in] field SERVO_FIELD_ANGLE, SERVO_FIELD_SPEED, SERVO_FIELD_VOLTAGE, SERVO_FIELD_TEMPERATURE or SERVO_FIELD_CURRENT
+		 *  \param [in] ttl Time in milliseconds, 0 disables the cache of this value
+		 */
+		void setCacheTTL(uint8_t field, uint16_t ttl);
+		
+		/**
+		 *  \brief Prints frame counters, round trip times, retries, timeouts and latency histograms of the servo bus,
+		 *  		one line per motor and per service id.
+		 *  \param [in] out Where the text is printed to (e.g. Serial)
+		 */
+		void printBusStats(Print &out);
+		
+		/**
+		 *  \brief Clears all counters and latency histograms of the servo bus.
+		 */
+		void resetBusStats();
+		
+		/**
+		 *  \brief Starts recording every byte sent to and received from the motors with a timestamp in us.
+		 *  		When the buffer is full, the oldest bytes are overwritten, so it always holds the latest traffic.
+		 *  \param [in] buffer Memory for the recording, e.g. a static array of servo_capture_type (8 bytes per entry)
+		 *  \param [in] size Number of entries of the buffer
+		 */
+		void beginBusCapture(servo_capture_type *buffer, uint16_t size);
+		
+		/**
+		 *  \brief Stops the recording started with beginBusCapture() and prints it, one byte per line.
+		 *  		Save the output to a file and decode it with extras/host/decode_capture on a PC.
+		 *  \param [in] out Where the text is printed to (e.g. Serial)
+		 */
+		void printBusCapture(Print &out);
 
 		/**
 		 *  \brief Returns the limits of a given axis
@@ -354,6 +654,320 @@ class morobotClass {
 		 */
 		bool moveInDirection(char axis, float value);
 		
+		/**
+		 *  \brief Moves the TCP (tool center point) of the robot on a straight line to a desired position.
+		 *  \details moveToPose() solves the inverse kinematics for the goal only, so the TCP follows whatever curve the joints produce.
+		 *  		 moveLinear() samples the line every MOROBOT_LINEAR_PERIOD ms along an S-curve profile of the path length,
+		 *  		 solves the inverse kinematics for every sample and streams the angles to the servos without waiting for acknowledges.
+		 *  		 The whole path is checked before the robot moves; if a sample is not reachable or outside the joint limits, the robot does not move.
+		 *  		 If a joint could not follow the path at the given speed (e.g. close to a singularity), the speed is lowered.
+		 *  		 Waits until the robot is ready before moving and returns when the goal has been sent. Does not work in the streaming mode.
+		 *			 For morobot-s (rrp) the parameter "z" is not the z-position but the rotation around the z-axis in degrees!
+		 *  \param [in] x Desired x-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] y Desired y-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] z Desired z-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] speed Speed of the TCP along the line in mm/s
+		 *  \return Returns true if the whole path is reachable and the robot moved; false if it did not move.
+		 */
+		bool moveLinear(float x, float y, float z, float speed);
+		
+		/* ASYNCHRONOUS MOVEMENTS */
+		/**
+		 *  \brief Moves all motors to the given angles without blocking and returns a handle of the move right away.
+		 *  \details The move waits in the background until the previous motion of the robot has finished, is sent and
+		 *  		 finishes when all motors reached their position, like moveToAngles() followed by waitUntilIsReady().
+		 *  		 It is advanced by updateMotion(), isMoveDone(), getMoveState() and waitForMove(), so call one of them in loop().
+		 *  		 Only one asynchronous move runs at a time; do not mix it with blocking moves before it is done.
+		 *  \param [in] angles[] Angles in degrees, one per motor
+		 *  \return Handle of the move; MOROBOT_NO_MOVE if another asynchronous move is not done yet or the robot is streaming
+		 */
+		morobotMoveHandle moveToAnglesAsync(long angles[]);
+		
+		/**
+		 *  \brief Moves all motors to the given angles with the given speed without blocking, see moveToAnglesAsync(long angles[])
+		 *  \param [in] angles[] Angles in degrees, one per motor
+		 *  \param [in] speedRPM Speed of the motors in RPM
+		 *  \return Handle of the move; MOROBOT_NO_MOVE if another asynchronous move is not done yet or the robot is streaming
+		 */
+		morobotMoveHandle moveToAnglesAsync(long angles[], uint8_t speedRPM);
+		
+		/**
+		 *  \brief Moves the TCP (tool center point) of the robot to a desired position without blocking.
+		 *  		The inverse kinematics is solved right away, the move runs in the background like moveToAnglesAsync().
+		 *  \param [in] x Desired x-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] y Desired y-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] z Desired z-coordinate of the TCP in mm (in base frame)
+		 *  \return Handle of the move; MOROBOT_NO_MOVE if the position is not reachable, another asynchronous move is not done yet or the robot is streaming
+		 */
+		morobotMoveHandle moveToPoseAsync(float x, float y, float z);
+		
+		/**
+		 *  \brief Advances the asynchronous move: starts it when the robot is idle and checks if the motors reached their position.
+		 *  		Never waits longer than one bus round trip per motor.
+		 */
+		void updateMotion();
+		
+		/**
+		 *  \brief Returns the state of an asynchronous move after advancing it with updateMotion()
+		 *  \param [in] handle Handle of the move
+		 *  \return MOROBOT_MOVE_WAITING, _RUNNING, _DONE, _CANCELLED or _FAILED (only the last move is known, older handles are reported as failed)
+		 */
+		uint8_t getMoveState(morobotMoveHandle handle);
+		
+		/**
+		 *  \brief Checks without blocking if an asynchronous move is done (reached, cancelled or failed)
+		 *  \param [in] handle Handle of the move
+		 *  \return Returns true if the move is done; false if it waits or runs
+		 */
+		bool isMoveDone(morobotMoveHandle handle);
+		
+		/**
+		 *  \brief Waits until an asynchronous move is done or a timeout occurs
+		 *  \param [in] handle Handle of the move
+		 *  \param [in] timeout Maximum time to wait in ms (optional)
+		 *  \return Returns true if all motors reached their position; false if the move timed out, was cancelled or failed
+		 */
+		bool waitForMove(morobotMoveHandle handle, unsigned long timeout=TIMEOUT_DELAY);
+		
+		/**
+		 *  \brief Cancels an asynchronous move. A waiting move is not sent; running motors are stopped at their actual angles.
+		 *  		If the actual angles cannot be read, the motors are stopped with setBreaks() instead.
+		 *  \param [in] handle Handle of the move
+		 *  \return Returns true if the move was cancelled; false if it was already done
+		 */
+		bool cancelMove(morobotMoveHandle handle);
+		
+		/* MOTION QUEUE */
+		/**
+		 *  \brief Starts executing the motion queue in the background.
+		 *  		The entries run back-to-back in the order they were added, each one starts when the previous one is done.
+		 *  		Moves run like moveToAnglesAsync(): they wait for the robot to be idle and finish when all joints reached their position.
+		 *  		On the ESP32 a task executes the queue; on other boards updateQueue() has to be called from loop().
+		 *  		Do not use the other movement functions while the queue runs.
+		 *  \return Returns true if the queue runs.
+		 */
+		bool beginQueue();
+		
+		/**
+		 *  \brief Stops executing the motion queue and cancels all entries which are not done yet.
+		 */
+		void endQueue();
+		
+		/**
+		 *  \brief Executes the next step of the motion queue. Call from loop() on boards without FreeRTOS; does nothing on the ESP32.
+		 */
+		void updateQueue();
+		
+		/**
+		 *  \brief Adds a move of all joints to the given angles to the motion queue
+		 *  \param [in] angles[] Angles in degrees, one per motor
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueueAngles(long angles[]);
+		
+		/**
+		 *  \brief Adds a move of all joints to the given angles with the given speed to the motion queue
+		 *  \param [in] angles[] Angles in degrees, one per motor
+		 *  \param [in] speedRPM Speed of the motors in RPM
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueueAngles(long angles[], uint8_t speedRPM);
+		
+		/**
+		 *  \brief Adds a move of the TCP to a position to the motion queue.
+		 *  		The inverse kinematics is solved when the entry starts; the entry fails if the position is not reachable.
+		 *  \param [in] x Desired x-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] y Desired y-coordinate of the TCP in mm (in base frame)
+		 *  \param [in] z Desired z-coordinate of the TCP in mm (in base frame)
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueuePose(float x, float y, float z);
+		
+		/**
+		 *  \brief Adds opening or closing a gripper to the motion queue. The entry is done when the gripper finished moving.
+		 *  \param [in] eef Gripper attached to the robot
+		 *  \param [in] close True to close the gripper, false to open it
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueueGripper(gripper *eef, bool close);
+		
+		/**
+		 *  \brief Adds waiting for a time to the motion queue (e.g. to let a gripper settle)
+		 *  \param [in] duration Time to wait in ms
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueueDwell(unsigned long duration);
+		
+		/**
+		 *  \brief Sets a function which is called with the id and the result of each queue entry when it is done.
+		 *  		On the ESP32 it is called from the queue task, so it should only store the result (e.g. in a volatile variable).
+		 *  \param [in] callback Function to call, NULL to call none
+		 */
+		void setQueueCallback(morobotQueueCb callback);
+		
+		/**
+		 *  \brief Returns the number of entries in the motion queue, including the running one
+		 *  \return Number of entries which are not done yet
+		 */
+		uint8_t getQueueLength();
+		
+		/**
+		 *  \brief Checks if an entry of the motion queue is done (reached, cancelled or failed)
+		 *  \param [in] id Id of the entry
+		 *  \return Returns true if the entry is not in the queue any more
+		 */
+		bool isQueueEntryDone(morobotMoveHandle id);
+		
+		/**
+		 *  \brief Cancels all entries of the motion queue. A running move is stopped at the actual angles; the queue keeps running.
+		 */
+		void clearQueue();
+		
+		/* STREAMING */
+		/**
+		 *  \brief Starts the streaming mode for continuous motion of the joints.
+		 *  		Every period fresh setpoints are sent to all joints (absolute angle with a matching speed, or pwm) without waiting for acknowledges.
+		 *  		So the joints follow changing goals and velocities smoothly instead of stopping at each point.
+		 *  		All joints start at their current angle and stand still until streamAngle(), jogJoint() or streamPwm() is called.
+		 *  		On the ESP32 a task sends the setpoints; on other boards updateStreaming() has to be called from loop() at least once per period.
+		 *  		Do not use the other movement functions while streaming.
+		 *  \param [in] periodMs (Optional) Time in ms between two setpoints. The bus needs about 1 ms per joint at 115200 baud.
+		 *  \return Returns true if the streaming mode runs; false if the task could not be started or the actual angles could not be read.
+		 */
+		bool beginStreaming(uint16_t periodMs=MOROBOT_STREAM_PERIOD);
+		
+		/**
+		 *  \brief Stops the streaming mode. All joints stop at their streamed position (without deceleration), pwm driven joints are stopped.
+		 */
+		void endStreaming();
+		
+		/**
+		 *  \brief Returns if the streaming mode runs
+		 *  \return Returns true if the streaming mode runs.
+		 */
+		bool isStreaming();
+		
+		/**
+		 *  \brief Sends the setpoints of the next period if it is due. Call from loop() on boards without FreeRTOS; does nothing on the ESP32.
+		 */
+		void updateStreaming();
+		
+		/**
+		 *  \brief Sets the acceleration used to change the velocity of streamed joints (angle and velocity modes).
+		 *  \param [in] acceleration Acceleration in degrees/s^2, 0 changes the velocity instantly
+		 */
+		void setStreamAcceleration(float acceleration);
+		
+		/**
+		 *  \brief Moves a joint towards a goal angle in the streaming mode. The goal can be changed at any time without stopping the joint.
+		 *  		The joint accelerates and decelerates with the stream acceleration. Goals outside the joint limits are limited.
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] angle Goal angle in degrees
+		 *  \param [in] velocity Maximum velocity in degrees/s (up to 6 * SERVO_MAX_SPEED_RPM)
+		 */
+		void streamAngle(uint8_t servoId, float angle, float velocity);
+		
+		/**
+		 *  \brief Moves all joints towards goal angles in the streaming mode. See streamAngle().
+		 *  \param [in] angles[] Goal angles in degrees
+		 *  \param [in] velocity Maximum velocity of each joint in degrees/s
+		 */
+		void streamAngles(float angles[], float velocity);
+		
+		/**
+		 *  \brief Moves a joint with a constant velocity in the streaming mode (jogging) until a new velocity is set or the joint limit is reached.
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] velocity Velocity in degrees/s, negative values move backwards, 0 stops the joint
+		 */
+		void jogJoint(uint8_t servoId, float velocity);
+		
+		/**
+		 *  \brief Drives a joint with a pwm value in the streaming mode (SET_SERVO_PWM_MOVE), e.g. for wheels or continuous rotation. Joint limits are not checked.
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] pwm Pwm value (-255 to 255), 0 stops the motor
+		 */
+		void streamPwm(uint8_t servoId, int16_t pwm);
+		
+		/**
+		 *  \brief Returns the streamed position of a joint
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \return Position in degrees the joint is streamed to at the moment
+		 */
+		float getStreamSetpoint(uint8_t servoId);
+		
+		/**
+		 *  \brief Sets the limits of the trajectories of streamTrajectory(). They apply to the joint with the longest travel, the others move slower.
+		 *  \param [in] velocity Velocity limit in degrees/s (up to 6 * SERVO_MAX_SPEED_RPM)
+		 *  \param [in] acceleration Acceleration limit in degrees/s^2 (0 keeps the previous limit)
+		 *  \param [in] jerk Jerk limit in degrees/s^3 (PROFILE_SCURVE; with 0 all trajectories are trapezoidal)
+		 */
+		void setTrajectoryLimits(float velocity, float acceleration, float jerk);
+		
+		/**
+		 *  \brief Moves all joints to the given angles on a time-parameterized trajectory in the streaming mode.
+		 *  \details The trajectory is planned from the streamed positions with the limits of setTrajectoryLimits().
+		 *  		 Every period the joints are sent the point of the trajectory some periods ahead with the average speed to get there,
+		 *  		 so the servos follow the planned velocity and acceleration instead of their own acceleration ramp.
+		 *  		 The trajectory starts at rest, so call it when the streamed joints stand still.
+		 *  		 All joints start and arrive together. Afterwards they hold the goal like after streamAngle().
+		 *  		 Goals outside the joint limits are limited. Call beginStreaming() first.
+		 *  \param [in] angles[] Goal angles in degrees, one per motor
+		 *  \param [in] profile (Optional) PROFILE_TRAPEZOID or PROFILE_SCURVE
+		 *  \return Duration of the trajectory in s; a negative value if the robot is not streaming
+		 */
+		float streamTrajectory(float angles[], uint8_t profile=PROFILE_SCURVE);
+		
+		/**
+		 *  \brief Returns if the trajectory of streamTrajectory() has been completed
+		 *  \return Returns true if no joint follows a trajectory any more.
+		 */
+		bool isTrajectoryDone();
+		
+		/* SERVO CONTROLLER */
+		/**
+		 *  \brief Sets the gains of the position controller of a motor
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] p Proportional gain
+		 *  \param [in] i Integral gain
+		 *  \param [in] d Derivative gain
+		 *  \return Returns true if the motor acknowledged the gains
+		 */
+		bool setJointPid(uint8_t servoId, float p, float i, float d);
+		
+		/**
+		 *  \brief Reads the gains of the position controller of a motor
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [out] pid The gains of the motor
+		 *  \return Returns true if the motor answered
+		 */
+		bool getJointPid(uint8_t servoId, servo_pid_type &pid);
+		
+		/**
+		 *  \brief Tunes the gains of the position controller of a motor for the shortest settle time without overshoot.
+		 *  		The motor is moved back and forth by stepAngle from its current angle (towards the side inside the joint limits)
+		 *  		with the default speed and measured while the gains are changed. Afterwards it is moved back.
+		 *  		Tune with the load the joint carries in operation; the other joints are not moved.
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] stepAngle (Optional) Step in degrees the motor is moved by
+		 *  \param [out] result (Optional) Initial and tuned gains and their step responses
+		 *  \return Returns true if the tuning finished and the gains were written to the motor
+		 */
+		bool autoTuneJoint(uint8_t servoId, long stepAngle=MOROBOT_TUNE_STEP, servo_pid_tune_type *result=NULL);
+		
+		/**
+		 *  \brief Reads the gains of all motors and stores them in the flash (ESP32 non-volatile storage), so they survive a restart of the servos.
+		 *  \param [in] name (Optional) Name the gains are stored under, use different names for several robots on one board (up to 15 characters)
+		 *  \return Returns true if the gains of all motors were stored; false on other boards
+		 */
+		bool saveJointPids(const char* name="morobot");
+		
+		/**
+		 *  \brief Writes the gains stored with saveJointPids() to the motors. Call after begin().
+		 *  \param [in] name (Optional) Name the gains were stored under
+		 *  \return Returns true if gains were stored for all motors and the motors acknowledged them; false on other boards
+		 */
+		bool loadJointPids(const char* name="morobot");
+		
 		/* HELPER */
 		/**
 		 *  \brief Prints an array of angles to the serial monitor.
@@ -387,7 +1001,7 @@ class morobotClass {
 		virtual String getType()=0;
 		
 		/* PUBLIC VARIABLES */
-		MakeblockSmartServo smartServos;	//!< Makeblock smartservo object
+		MakeblockSmartServoBase &smartServos;	//!< Makeblock smartservo object
 		bool waitAfterEachMove = true;		//!< Defines if the robot waits after moving or does not wait until movement has finished
 		
 	protected:
@@ -416,6 +1030,28 @@ class morobotClass {
 		 *  \param [in] maxMotorCurrent (Optional) Current limit at which zero position is reached an calibration stops
 		 */
 		void autoCalibrateLinearAxis(uint8_t servoId, uint8_t maxMotorCurrent=80);
+		
+		/**
+		 *  \brief Moves all motors to desired angles with a coordinated start (absolute movement).
+		 *  		All angles are checked first, then the commands for all valid joints are sent in one burst and the acknowledges are collected afterwards.
+		 *  		This way all joints start moving within about one frame time of each other instead of one acknowledge round trip apart.
+		 *  		Joints with an invalid angle are not moved. In the synchronized mode the speeds are scaled with syncJointSpeeds().
+		 *  \param [in] angles[] Desired goal angles in degrees.
+		 *  \param [in] speedRPM Desired velocity of the motors in RPM (rounds per minute).
+		 *  \return Returns true if all sent commands were acknowledged; false if a command failed or the speeds could not be synchronized (nothing is sent then).
+		 */
+		bool moveJointsTo(long angles[], uint8_t speedRPM);
+		
+		/**
+		 *  \brief Scales the speed of each joint to its travel from the actual angle, so all joints arrive at the same time.
+		 *  		The joint with the longest travel gets speedRPM, the others a proportionally lower speed rounded to whole RPM (at least 1 RPM).
+		 *  \param [in] angles[] Desired goal angles in degrees.
+		 *  \param [in] valid[] True for the joints which are moved.
+		 *  \param [in] speedRPM Velocity of the joint with the longest travel in RPM.
+		 *  \param [out] speeds[] Speed of each joint in RPM.
+		 *  \return Returns true if the speeds were scaled; false if the actual angles could not be read
+		 */
+		bool syncJointSpeeds(long angles[], const bool valid[], uint8_t speedRPM, uint8_t speeds[]);
 
 		/**
 		 *  \brief Checks if a given angle is NAN-value and prints an error message. The values are NAN if the inverse kinematics does not provide a solution.
@@ -433,23 +1069,247 @@ class morobotClass {
 		void printInvalidAngleError(uint8_t servoId, float angle);
 
 		uint8_t _numSmartServos;			//!< Number of smart servos of robot
-		long _robotJointLimits[3][2];	//!< Limits for all joints
+		long (*_robotJointLimits)[2];	//!< Limits for all joints, one per smart servo (stored in morobotStorage)
 		uint8_t _robotAxisLimits[3][2];		//!< Limits of x, y, z axis
 		uint8_t _speedRPM;					//!< Default speed (used if movement-funtions to not provide specific speed)
 		float _actPos[3];					//!< Robot TCP position (in base frame)
 		float _actOri[3];					//!< Robot TCP orientation (rotation in degrees around base frame)
 		bool _tcpPoseIsValid = false;		//!< Status of TCP-pose: When the robot is moved without updating pose, it is set to false;
-		bool _angleReached[NUM_MAX_SERVOS];	//!< Variables that indicate if a motor is busy (is moving and has not reached final position)
-		float _goalAngles[NUM_MAX_SERVOS];	//!< Variable for inverse kinematics to store goal Angles of the motors
+		bool *_angleReached;				//!< Variables that indicate if a motor is busy (is moving and has not reached final position), one per smart servo
+		float *_goalAngles;					//!< Goal angles of the motors (from the inverse kinematics or the last absolute move, NAN if unknown), one per smart servo
+		morobotStreamJoint *_streamJoints;	//!< State of the streaming mode, one per smart servo
 		Stream* _port;						//!< Port used for communication with the robot (e.g. Serial1)
 	private:
 		/**
 		 *  \brief Checks if the robot is busy or idle.
 		 *  		Checks if internal variables indicate the robot is idle.
-		 *  		If a motor is not already set idle, it checks if the motor is still moving.
+		 *  		Motors whose firmware reports reaching the set position are waited for event-driven.
+		 *  		Other motors are polled together with pollMotorsStopped().
+		 *  \param [in] waitTime (Optional) Maximum time in ms to wait for arrival reports
+		 *  \return Returns true if the robot is idle; false if the robot is busy
+		 */
+		bool isReady(unsigned long waitTime = 0);
+		
+		/**
+		 *  \brief Checks if motors without arrival report have stopped, reading all of them in one pass.
+		 *  		The angles of all motors are requested at once; motors within the goal tolerance of their goal angle are done.
+		 *  		The others are read again after one shared MOROBOT_POLL_INTERVAL and are done if their angle did not change.
+		 *  		Motors that are done are marked as having reached their position.
+		 *  \param [in] servoIds Numbers of the motors to check (first motor has ID 0)
+		 *  \param [in] numServos Number of motors in servoIds
+		 *  \return Returns true if all motors are done; false if at least one still moves
+		 */
+		bool pollMotorsStopped(const uint8_t servoIds[], uint8_t numServos);
+		
+		/**
+		 *  \brief Reads the angles of motors without arrival report in one burst and marks the motors that are done.
+		 *  		A motor is done if it is within the goal tolerance of its goal angle or, except for the first reading,
+		 *  		if its angle did not change since the previous reading.
+		 *  \param [in] servoIds Numbers of the motors to read (first motor has ID 0)
+		 *  \param [in] numServos Number of motors in servoIds
+		 *  \param [in] first True for the first reading of a check, there is no previous angle to compare with
+		 *  \return Returns true if all motors are done; false if at least one still moves
+		 */
+		bool readPollAngles(const uint8_t servoIds[], uint8_t numServos, bool first);
+		
+		/**
+		 *  \brief Checks if the robot is idle without blocking, used by the asynchronous moves.
+		 *  		Like isReady(), but arrival reports are not waited for and motors without arrival report
+		 *  		are read once per MOROBOT_POLL_INTERVAL instead of waiting between two readings.
 		 *  \return Returns true if the robot is idle; false if the robot is busy
 		 */
-		bool isReady();
+		bool checkIfReady();
+		
+		/**
+		 *  \brief Stores a new asynchronous move and starts it if the robot is idle
+		 *  \param [in] angles[] Angles in degrees, one per motor
+		 *  \param [in] speedRPM Speed of the motors in RPM
+		 *  \param [in] pose TCP position the angles were solved for, stored as TCP pose when the move is sent (optional)
+		 *  \return Handle of the move
+		 */
+		morobotMoveHandle beginMove(long angles[], uint8_t speedRPM, const float pose[] = NULL);
+		
+		/**
+		 *  \brief Sends the asynchronous move to all motors
+		 */
+		void startMove();
+		
+		/**
+		 *  \brief Gives a queue entry an id and appends it to the motion queue
+		 *  \param [in] entry Entry to append
+		 *  \return Id of the entry; MOROBOT_NO_MOVE if the queue is full
+		 */
+		morobotMoveHandle enqueue(morobotQueueEntry &entry);
+		
+		/**
+		 *  \brief Starts the first entry of the motion queue or checks if it is done, called by the queue task or updateQueue()
+		 */
+		void queueStep();
+		
+		/**
+		 *  \brief Starts a queue entry
+		 *  \param [in] entry Entry to start
+		 *  \return MOROBOT_MOVE_RUNNING if the entry runs, otherwise the result of the entry
+		 */
+		uint8_t startQueueEntry(morobotQueueEntry &entry);
+		
+		/**
+		 *  \brief Removes the first entry from the motion queue and reports its result to the queue callback
+		 *  \param [in] result MOROBOT_MOVE_DONE, _CANCELLED or _FAILED
+		 */
+		void finishQueueEntry(uint8_t result);
+		
+		/**
+		 *  \brief Body of the motion queue task (ESP32), executes the queue every MOROBOT_QUEUE_PERIOD
+		 *  \param [in] arg The morobotClass object
+		 */
+		static void queueTask(void *arg);
+		
+		/**
+		 *  \brief Protects the motion queue against the queue task while an entry is added or removed (ESP32)
+		 */
+		void lockQueue();
+		
+		/**
+		 *  \brief Releases the motion queue, see lockQueue()
+		 */
+		void unlockQueue();
+		
+		/**
+		 *  \brief Changes the baud rate of the serial port the robot is connected to
+		 *  \param [in] baudRate New baud rate
+		 */
+		void setPortBaudRate(long baudRate);
+		
+		/**
+		 *  \brief Advances the streamed positions of all joints and sends their setpoints
+		 *  \param [in] elapsedMs Time since the last setpoints in ms
+		 */
+		void streamTick(unsigned long elapsedMs);
+		
+		/**
+		 *  \brief Body of the streaming task (ESP32), sends the setpoints once per period
+		 *  \param [in] arg The morobotClass object
+		 */
+		static void streamTask(void *arg);
+		
+		/**
+		 *  \brief Limits an angle to the joint limits of a motor
+		 *  \param [in] servoId Number of motor (first motor has ID 0)
+		 *  \param [in] angle Angle in degrees
+		 *  \return Angle inside the joint limits
+		 */
+		float limitStreamAngle(uint8_t servoId, float angle);
+		
+		/**
+		 *  \brief Plans the timing of a trajectory profile for its distance and the given limits.
+		 *  		If the distance is too short to reach the velocity (or, for an S-curve, the acceleration) limit, the peak values are lowered.
+		 *  		The profile is used for joint angles (streamTrajectory()) as well as for the path length of moveLinear().
+		 *  \param [in] traj Trajectory with morobotTrajectory::distance set, gets the timing
+		 *  \param [in] velocity Velocity limit in units/s (degrees or mm)
+		 *  \param [in] acceleration Acceleration limit in units/s^2
+		 *  \param [in] jerk Jerk limit in units/s^3; 0 plans a trapezoidal profile
+		 */
+		void planTrajectory(morobotTrajectory &traj, float velocity, float acceleration, float jerk);
+		
+		/**
+		 *  \brief Returns the position of a trajectory profile at a time
+		 *  \param [in] traj Trajectory planned by planTrajectory()
+		 *  \param [in] time Time since the start of the trajectory in s
+		 *  \return Position along the profile, 0 at the start and morobotTrajectory::distance at the end
+		 */
+		float sampleTrajectory(const morobotTrajectory &traj, float time);
+		
+		/**
+		 *  \brief Solves the inverse kinematics for a point of the straight path of moveLinear()
+		 *  \param [in] start[] TCP position at the start of the path in mm
+		 *  \param [in] travel[] Vector from the start to the goal of the path in mm
+		 *  \param [in] path Profile of the path length
+		 *  \param [in] time Time since the start of the path in s
+		 *  \param [out] angles[] Angles of the motors at the point in degrees
+		 *  \return Returns true if the point is reachable; false if it is not.
+		 */
+		bool calculatePathAngles(const float start[], const float travel[], const morobotTrajectory &path, float time, float angles[]);
+		
+		/**
+		 *  \brief Protects the stream state against the streaming task while a setter changes it (ESP32)
+		 */
+		void lockStream();
+		
+		/**
+		 *  \brief Releases the stream state, see lockStream()
+		 */
+		void unlockStream();
+		
+		long _busBaudRate = SMART_SERVO_DEFAULT_BAUD_RATE;	//!< Baud rate of the bus to the servos
+		float _goalTolerance = MOROBOT_GOAL_TOLERANCE;		//!< Deviation in degrees from the goal angle a polled motor counts as arrived with
+		bool _synchronizedMoves = false;					//!< True if the speeds of the joints are scaled so all joints arrive at the same time
+		long *_pollAngles;									//!< Angles of the previous reading of polled motors, one per smart servo
+		bool *_pollValid;									//!< True if _pollAngles holds a reading of the motor, one per smart servo
+		bool _pollStarted = false;							//!< True while a non-blocking check waits for the next reading of polled motors
+		unsigned long _pollTime = 0;						//!< Time (millis()) of the last reading of polled motors
+		morobotMove _move = {};	//!< State of the asynchronous move
+		morobotMoveHandle _nextMoveHandle = 0;				//!< Handle of the next asynchronous move
+		morobotQueueEntry _queue[MOROBOT_QUEUE_SIZE];		//!< Entries of the motion queue (ring buffer)
+		uint8_t _queueHead = 0;								//!< Index of the first (running) entry of the motion queue
+		volatile uint8_t _queueLength = 0;					//!< Number of entries in the motion queue
+		morobotMoveHandle _nextQueueId = 0;					//!< Id of the next queue entry
+		volatile bool _queueRunning = false;				//!< True while the motion queue is executed
+		volatile bool _queueCancel = false;					//!< Set by clearQueue(), the next queue step cancels all entries
+		bool _queueEntryStarted = false;					//!< True if the first entry of the motion queue has been started
+		uint8_t _queueEntryResult = MOROBOT_MOVE_RUNNING;	//!< Result of the first entry if it finished when it was started
+		unsigned long _queueEntryTime = 0;					//!< Time (millis()) the first entry was started
+		morobotQueueCb _queueCallback = NULL;				//!< Called when a queue entry is done
+		volatile bool _streaming = false;					//!< True while the streaming mode runs
+		uint16_t _streamPeriod = MOROBOT_STREAM_PERIOD;		//!< Time between two setpoints in ms
+		float _streamAccel = MOROBOT_STREAM_ACCEL;			//!< Acceleration of streamed joints in degrees/s^2
+		morobotTrajectory _trajectory;						//!< Trajectory followed by joints in STREAM_MODE_TRAJECTORY
+		float _trajVelocity = MOROBOT_TRAJ_VELOCITY;		//!< Velocity limit of trajectories in degrees/s
+		float _trajAccel = MOROBOT_TRAJ_ACCEL;				//!< Acceleration limit of trajectories in degrees/s^2
+		float _trajJerk = MOROBOT_TRAJ_JERK;				//!< Jerk limit of S-curve trajectories in degrees/s^3
+		unsigned long _lastStreamTick = 0;					//!< Time of the last setpoints (millis())
+		#if defined(ESP32)
+			TaskHandle_t _streamTaskHandle = NULL;						//!< Task sending the setpoints
+			portMUX_TYPE _streamMux = portMUX_INITIALIZER_UNLOCKED;	//!< Protects the stream state shared with the task
+			TaskHandle_t _queueTaskHandle = NULL;						//!< Task executing the motion queue
+			portMUX_TYPE _queueMux = portMUX_INITIALIZER_UNLOCKED;		//!< Protects the motion queue shared with the task
+		#endif
+};
+
+/**
+ *  \brief Storage of a robot with NUM_JOINTS smart servo joints on a bus with NUM_SERVOS smart servos.
+ *  		Robot classes derive from it before morobotClass and pass getStorage() to the constructor of morobotClass,
+ *  		so the arrays are sized exactly for the robot at compile time and the number of joints cannot differ from them.
+ *  		A robot with 3 joints and a gripper uses morobotStorage<3, 3 + MOROBOT_EEF_SERVOS>.
+ */
+template<uint8_t NUM_JOINTS, uint8_t NUM_SERVOS = NUM_JOINTS + MOROBOT_EEF_SERVOS>
+class morobotStorage {
+	static_assert(NUM_JOINTS >= 1 && NUM_JOINTS <= NUM_MAX_SERVOS, "morobotStorage: number of joints has to be 1 to NUM_MAX_SERVOS");
+	static_assert(NUM_SERVOS >= NUM_JOINTS, "morobotStorage: the bus needs at least one smart servo per joint");
+	friend class morobotClass;
+	protected:
+		/**
+		 *  \brief Constructor of the storage
+		 *  \param [in] jointLimits Lower and upper limit in degrees of each joint
+		 */
+		morobotStorage(const long (&jointLimits)[NUM_JOINTS][2]){memcpy(_jointLimits, jointLimits, sizeof(_jointLimits));};
+		
+		/**
+		 *  \brief Returns the storage for the constructor of morobotClass.
+		 *  		Passing the robot itself would select the copy constructor of morobotClass.
+		 *  \return Returns the storage of the robot
+		 */
+		morobotStorage &getStorage(){return *this;};
+		
+		MakeblockSmartServo<NUM_SERVOS> _servoBus;	//!< Smart servo bus with the values of all servos of the robot
+		long _jointLimits[NUM_JOINTS][2];			//!< Limits for all joints
+		bool _angleReachedStorage[NUM_JOINTS] = {};	//!< Storage of morobotClass::_angleReached
+		float _goalAnglesStorage[NUM_JOINTS] = {};	//!< Storage of morobotClass::_goalAngles
+		morobotStreamJoint _streamJointsStorage[NUM_JOINTS] = {};	//!< Storage of morobotClass::_streamJoints
+		long _pollAnglesStorage[NUM_JOINTS] = {};	//!< Storage of morobotClass::_pollAngles
+		bool _pollValidStorage[NUM_JOINTS] = {};	//!< Storage of morobotClass::_pollValid
+		long _moveAnglesStorage[NUM_JOINTS] = {};	//!< Storage of the angles of morobotClass::_move
+		long _queueAnglesStorage[MOROBOT_QUEUE_SIZE*NUM_JOINTS] = {};	//!< Storage of the angles of morobotClass::_queue
 };
 
 #endif
\ No newline at end of file
@@ -16,6 +16,8 @@
  
 #include "morobot_2d.h"
 
+constexpr long morobot_2d::_defaultJointLimits[2][2];
+
 void morobot_2d::setTCPoffset(float xOffset, float yOffset, float zOffset){
 	// Add given tcp-offset and default offsets
 	_tcpOffset[0] = xOffset;
@@ -80,8 +82,10 @@ void morobot_2d::updateTCPpose(bool output){
 	waitUntilIsReady();
 	
 	// Recalculate angles because of motor mounting orientations
-	float phi1 = - (getActAngle(0) - 90);
-	float phi2 = getActAngle(1) + 90;
+	long actAngles[NUM_MAX_SERVOS];
+	if (getActAngles(actAngles) == false) return;
+	float phi1 = - (actAngles[0] - 90);
+	float phi2 = actAngles[1] + 90;
 	phi1 = convertToRad(phi1);
 	phi2 = convertToRad(phi2);
 	
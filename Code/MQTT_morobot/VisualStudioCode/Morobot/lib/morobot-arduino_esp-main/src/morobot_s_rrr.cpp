@@ -17,6 +17,8 @@
  
 #include "morobot_s_rrr.h"
 
+constexpr long morobot_s_rrr::_defaultJointLimits[3][2];
+
 void morobot_s_rrr::setTCPoffset(float xOffset, float yOffset, float zOffset){
 	_tcpOffset[0] = xOffset;
 	_tcpOffset[1] = yOffset;
@@ -106,8 +108,10 @@ void morobot_s_rrr::updateTCPpose(bool output){
 	waitUntilIsReady();
 	
 	// Get anlges of all motors
+	long rawAngles[NUM_MAX_SERVOS];
+	if (getActAngles(rawAngles) == false) return;
 	float actAngles[_numSmartServos];
-	for (uint8_t i=0; i<_numSmartServos; i++) actAngles[i] = convertToRad(getActAngle(i));
+	for (uint8_t i=0; i<_numSmartServos; i++) actAngles[i] = convertToRad(rawAngles[i]);
 	
 	// Change orientation or angle because of motor mounting orientation
 	actAngles[0] = -actAngles[0];
@@ -16,6 +16,8 @@
  
 #include <newRobotClass_Template.h>
 
+constexpr long newRobotClass_Template::_defaultJointLimits[3][2];
+
 void newRobotClass_Template::setTCPoffset(float xOffset, float yOffset, float zOffset){
 	_tcpOffset[0] = xOffset;
 	_tcpOffset[1] = yOffset;
@@ -10,6 +10,9 @@
 #define MOROBOT_TYPE   morobot_s_rrp // morobot_s_rrr, morobot_s_rrp, morobot_2d, morobot_3d, morobot_p
 #define SERIAL_PORT   "Serial1"   // "Serial", "Serial1", "Serial2", "Serial3" (not all supported for all microcontroller - see readme)
 #define ESP32 ESP32
+#define BUS_BAUD_RATE 115200      // Baud rate of the servo bus; a higher value (e.g. 1000000) is negotiated with all servos after begin()
+#define BUS_STATS_INTERVAL 10000  // ms between two publishes of the servo bus statistics on "Fruitsystem/robot/busstats"
+#define TELEMETRY_INTERVAL 2000   // ms between two publishes of the hottest motor temperature on "Fruitsystem/robot" (temperatures are cached as long)
 
 MOROBOT_TYPE morobot;   // And change the class-name here
 String messageTemp;
@@ -23,19 +26,60 @@ const char* mqtt_server = "mqtt.eclipseprojects.io";
 WiFiClient espClient;
 PubSubClient client(espClient);
 DistanceSensor ultraSensor (4, 2);
+unsigned long lastBusStatsPublish = 0;
+unsigned long lastTelemetryPublish = 0;
+morobotMoveHandle sortMove = MOROBOT_NO_MOVE;  //move to the bin of the last fruit, "OnPosition" is published when it is done
+
+//publishes printed text as one MQTT message per line, so any number of lines fits into the MQTT buffer
+class LinePublisher : public Print
+{
+  public:
+    char line[256];
+    size_t length = 0;
+    const char* topic;
+
+    LinePublisher(const char* topic) : topic(topic) {}
+
+    size_t write(uint8_t c)
+    {
+      if (c == '\r') return 1;
+      if (c == '\n')
+      {
+        flush();
+        return 1;
+      }
+      //a line longer than the buffer is continued in the next message instead of being cut off
+      if (length >= sizeof(line) - 1) flush();
+      line[length++] = c;
+      return 1;
+    }
+
+    void flush()
+    {
+      if (length == 0) return;
+      line[length] = '\0';
+      client.publish(topic, line);
+      length = 0;
+    }
+};
 
 void setup_wifi();
 void reconnect();
 void callback(char* topic, byte* payload, unsigned int length);
+void publishTelemetry();
+void publishBusStats();
+void handleSerialCommands();
 
 void setup() {
   morobot.begin(SERIAL_PORT);
+  if (BUS_BAUD_RATE != SMART_SERVO_DEFAULT_BAUD_RATE) morobot.negotiateBaudRate(BUS_BAUD_RATE);
   morobot.setZero();  // reset angles / moveHome()
   //morobot.moveZAxisIn(); doesnt seem to work well moves too much     // Set the global speed for all motors here. This value can be overwritten temporarily if a function is called with a speed parameter explicitely.
   Serial.begin(115200);
   setup_wifi();
   client.setServer(mqtt_server, 1883);
   client.setCallback(callback);
+  client.setBufferSize(sizeof(LinePublisher::line) + 64);
 }
 
 void loop() 
@@ -51,27 +95,34 @@ void loop()
   float yMove = 45;
 
 
-  if (String(Topic) == "Fruitsystem/color")
+  //the move runs in the background, so the MQTT client keeps being served while the robot moves
+  if (sortMove != MOROBOT_NO_MOVE && morobot.isMoveDone(sortMove))
+  {
+    client.publish("Fruitsystem/robot", "OnPosition");
+    sortMove = MOROBOT_NO_MOVE;
+  }
+
+  if (String(Topic) == "Fruitsystem/color" && sortMove == MOROBOT_NO_MOVE)
   { 
     if(messageTemp.toInt() == Ripe)//the number it gets when red
     { 
       Serial.println("Ripe");
       messageTemp = "";
-      morobot.moveToAngles(-xMove, yMove, 0); //moves to absolute angles
-      morobot.waitUntilIsReady();
-      client.publish("Fruitsystem/robot", "OnPosition");
+      long angles[3] = {(long)-xMove, (long)yMove, 0};
+      sortMove = morobot.moveToAnglesAsync(angles); //moves to absolute angles
     }
     else if(messageTemp.toInt() == Unripe)//the number it gets when green
     {
       Serial.println("Unripe");
       messageTemp = "";
-      morobot.moveToAngles(xMove, -yMove, 0);
-      morobot.waitUntilIsReady();
-      client.publish("Fruitsystem/robot", "OnPosition");
+      long angles[3] = {(long)xMove, (long)-yMove, 0};
+      sortMove = morobot.moveToAnglesAsync(angles);
     }
     Topic = "";
   }
-  client.publish("Fruitsystem/robot", "Temp: %d", morobot.getTemp());
+  publishTelemetry();
+  publishBusStats();
+  handleSerialCommands();
   if(ultraSensor.getFlag() == true)
   {
     Serial.println("Something just passed");
@@ -125,6 +176,54 @@ void reconnect() {
   }
 }
 
+//publishes the temperature of the hottest motor every TELEMETRY_INTERVAL ms
+void publishTelemetry()
+{
+  if (millis() - lastTelemetryPublish < TELEMETRY_INTERVAL) return;
+  lastTelemetryPublish = millis();
+
+  //only the temperatures are read, they are served from the cache while they are fresh
+  float maxTemp = morobot.getTemp(0);
+  for (uint8_t i = 1; i < morobot.getNumSmartServos(); i++)
+  {
+      float temp = morobot.getTemp(i);
+      if (temp > maxTemp) maxTemp = temp;
+  }
+
+  char payload[24];
+  snprintf(payload, sizeof(payload), "Temp: %.1f", maxTemp);
+  client.publish("Fruitsystem/robot", payload);
+}
+
+//publishes the frame counters and latency histograms of the servo bus every BUS_STATS_INTERVAL ms
+void publishBusStats()
+{
+  if (millis() - lastBusStatsPublish < BUS_STATS_INTERVAL) return;
+  lastBusStatsPublish = millis();
+
+  LinePublisher stats("Fruitsystem/robot/busstats");
+  morobot.printBusStats(stats);
+  stats.flush();
+}
+
+//"stats" prints the servo bus statistics, "stats reset" clears them
+void handleSerialCommands()
+{
+  if (!Serial.available()) return;
+  String command = Serial.readStringUntil('\n');
+  command.trim();
+
+  if (command == "stats")
+  {
+    morobot.printBusStats(Serial);
+  }
+  else if (command == "stats reset")
+  {
+    morobot.resetBusStats();
+    Serial.println("Bus statistics cleared");
+  }
+}
+
 //gets the message and sends it to the main loop
 void callback(char* topic, byte* message, unsigned int length) 
 {